@@ -0,0 +1,142 @@
+// 请求解析的基准测试：比较HttpRequest::Parse与原先的正则表达式解析，以及各级别查找实现的扫描速度
+// 用法：./parserbench [解析次数]
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../buffer/buffer.h"
+#include "../http/httprequest.h"
+#include "../http/simdscan.h"
+
+namespace {
+
+const char kRequest[] =
+    "GET /static/js/app.3f2a9c.js?v=20240101 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "Referer: https://www.example.com/index.html\r\n"
+    "If-None-Match: \"5f3c-18a2b4c9d00\"\r\n"
+    "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; lang=zh\r\n"
+    "\r\n";
+
+// 原先的解析方式：逐行std::search查找"\r\n"并复制成std::string，每行构造正则表达式匹配，请求头存入散列表
+struct LegacyRequest {
+    std::string method, path, version;
+    std::unordered_map<std::string, std::string> header;
+};
+
+bool LegacyParse(const char* begin, const char* end, LegacyRequest& request) {
+    const char crlf[] = "\r\n";
+    bool request_line = true;
+    request.header.clear();
+    while (begin < end) {
+        const char* line_end = std::search(begin, end, crlf, crlf + 2);
+        std::string line(begin, line_end);
+        if (request_line) {
+            std::regex pattern("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+            std::smatch sub_match;
+            if (!std::regex_match(line, sub_match, pattern)) return false;
+            request.method = sub_match[1];
+            request.path = sub_match[2];
+            request.version = sub_match[3];
+            request_line = false;
+        } else {
+            std::regex pattern("^([^:]*): ?(.*)$");
+            std::smatch sub_match;
+            if (!std::regex_match(line, sub_match, pattern)) break;  // 空行，请求头结束
+            request.header[sub_match[1]] = sub_match[2];
+        }
+        begin = line_end + 2;
+    }
+    return true;
+}
+
+double NsPerOp(std::chrono::steady_clock::time_point start, size_t ops) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    const size_t len = sizeof(kRequest) - 1;
+
+    Buffer buff;
+    HttpRequest request;
+    size_t ok = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        buff.Append(kRequest, len);
+        ok += request.Parse(buff) == HttpRequest::COMPLETE;
+    }
+    double parse_ns = NsPerOp(start, count);
+    if (ok != count) {
+        fprintf(stderr, "HttpRequest::Parse failed\n");
+        return 1;
+    }
+
+    // 正则表达式慢两个数量级，按比例减少次数
+    size_t legacy_count = std::max<size_t>(count / 100, 1000);
+    LegacyRequest legacy;
+    ok = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < legacy_count; ++i) ok += LegacyParse(kRequest, kRequest + len, legacy);
+    double legacy_ns = NsPerOp(start, legacy_count);
+    if (ok != legacy_count || legacy.header.size() != 10) {
+        fprintf(stderr, "legacy parse failed\n");
+        return 1;
+    }
+
+    printf("request %zu bytes, %zu headers\n", len, legacy.header.size());
+    printf("%-24s %10.1f ns/req %8.1f MB/s\n", "HttpRequest::Parse", parse_ns, len * 1e3 / parse_ns);
+    printf("%-24s %10.1f ns/req %8.1f MB/s\n", "regex (before)", legacy_ns, len * 1e3 / legacy_ns);
+
+    // 长扫描：在64KB没有目标字符的数据中查找；短扫描：每8~128字节一个'\r'，相当于逐行查找请求头
+    std::string data(64 * 1024, 'a');
+    std::string lines(1 << 20, 'a');
+    std::mt19937 rng(1);
+    size_t line_count = 0;
+    for (size_t pos = rng() % 120 + 8; pos < lines.size(); pos += rng() % 120 + 8, ++line_count) lines[pos] = '\r';
+    const size_t rounds = 20000;
+    printf("%-8s %16s %16s %16s\n", "impl", "FindChar GB/s", "FindEither GB/s", "lines ns/line");
+    for (int level = SimdScan::SCALAR; level <= SimdScan::Best(); ++level) {
+        auto lv = static_cast<SimdScan::Level>(level);
+        const char* end = data.data() + data.size();
+        size_t misses = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < rounds; ++i) misses += SimdScan::FindChar(lv, data.data() + (i & 7), end, '\r') == end;
+        double char_ns = NsPerOp(start, rounds);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < rounds; ++i) misses += SimdScan::FindEither(lv, data.data() + (i & 7), end, '%', '+') == end;
+        double either_ns = NsPerOp(start, rounds);
+
+        size_t hits = 0;
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < 20; ++round) {
+            const char* p = lines.data();
+            const char* lines_end = p + lines.size();
+            while ((p = SimdScan::FindChar(lv, p, lines_end, '\r')) < lines_end) {
+                ++p;
+                ++hits;
+            }
+        }
+        double line_ns = NsPerOp(start, hits);
+        if (misses != rounds * 2 || hits != line_count * 20) return 1;
+        printf("%-8s %16.2f %16.2f %16.2f\n", SimdScan::Name(lv), data.size() / char_ns, data.size() / either_ns,
+               line_ns);
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+// 路由查找的基准测试：注册10到10000条路由，比较前缀树散列表与逐条匹配的查找耗时
+// 用法：./routerbench [查找次数]
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../http/router.h"
+
+namespace {
+
+// 第i条路由，四种形状轮流出现：普通段、参数段、两个参数段、前缀
+std::string Pattern(int i) {
+    switch (i % 4) {
+        case 0:
+            return "/api/v" + std::to_string(i % 8) + "/item" + std::to_string(i);
+        case 1:
+            return "/api/res" + std::to_string(i) + "/:id";
+        case 2:
+            return "/api/res" + std::to_string(i) + "/:id/sub/:sub";
+        default:
+            return "/static" + std::to_string(i) + "/*";
+    }
+}
+
+// 匹配第i条路由的请求路径，第2种形状的路径要经过第1种的参数节点再匹配"sub"
+std::string PathFor(int i) {
+    switch (i % 4) {
+        case 0:
+            return "/api/v" + std::to_string(i % 8) + "/item" + std::to_string(i);
+        case 1:
+            return "/api/res" + std::to_string(i) + "/42";
+        case 2:
+            return "/api/res" + std::to_string(i) + "/42/sub/7";
+        default:
+            return "/static" + std::to_string(i) + "/css/site.css";
+    }
+}
+
+// 对照组：按注册顺序逐条比较各段，相当于没有索引的路由表
+class LinearRouter {
+public:
+    void Add(const std::string& pattern) { routes_.push_back(Split(pattern)); }
+
+    int Match(std::string_view path) const {
+        std::vector<std::string_view> segments = Split(path);
+        for (size_t i = 0; i < routes_.size(); ++i) {
+            const std::vector<std::string_view>& route = routes_[i];
+            size_t n = 0;
+            for (; n < route.size() && n < segments.size(); ++n) {
+                if (route[n] == "*") return i;
+                if (route[n][0] != ':' && route[n] != segments[n]) break;
+            }
+            if (n == route.size() && n == segments.size()) return i;
+            if (n == segments.size() && n + 1 == route.size() && route[n] == "*") return i;
+        }
+        return -1;
+    }
+
+private:
+    static std::vector<std::string_view> Split(std::string_view path) {
+        std::vector<std::string_view> segments;
+        size_t begin = 1;
+        while (begin <= path.size()) {
+            size_t end = path.find('/', begin);
+            if (end == std::string_view::npos) end = path.size();
+            segments.push_back(path.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        return segments;
+    }
+
+    std::vector<std::vector<std::string_view>> routes_;  // 指向调用者保存的路由字符串
+};
+
+double NsPerOp(std::chrono::steady_clock::time_point start, size_t ops) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t lookups = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+    printf("%8s %12s %14s %14s\n", "routes", "compile(ms)", "trie(ns/op)", "linear(ns/op)");
+    for (int count : {10, 100, 1000, 10000}) {
+        std::vector<std::string> patterns;
+        for (int i = 0; i < count; ++i) patterns.push_back(Pattern(i));
+
+        auto start = std::chrono::steady_clock::now();
+        Router router;
+        for (const std::string& pattern : patterns) router.Get(pattern, [](HttpRequest&, HttpResponse&) {});
+        router.Compile();
+        double compile_ms = NsPerOp(start, 1) / 1e6;
+
+        LinearRouter linear;
+        for (const std::string& pattern : patterns) linear.Add(pattern);
+
+        // 路径随机取自各条路由，十分之一是不存在的路径
+        std::mt19937 rng(count);
+        std::vector<std::string> paths;
+        for (int i = 0; i < 4096; ++i) {
+            int route = rng() % count;
+            paths.push_back(i % 10 == 9 ? "/missing/" + std::to_string(route) : PathFor(route));
+        }
+
+        size_t hits = 0;
+        Router::Params params;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < lookups; ++i) {
+            params.clear();
+            hits += router.Match("GET", paths[i & 4095], params) != nullptr;
+        }
+        double trie_ns = NsPerOp(start, lookups);
+
+        // 逐条匹配在路由多时很慢，按比例减少次数
+        size_t linear_lookups = std::max<size_t>(lookups / std::max(1, count / 10), 4096);
+        size_t linear_hits = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < linear_lookups; ++i) linear_hits += linear.Match(paths[i & 4095]) >= 0;
+        double linear_ns = NsPerOp(start, linear_lookups);
+
+        printf("%8d %12.2f %14.1f %14.1f\n", count, compile_ms, trie_ns, linear_ns);
+        if (hits == 0 || linear_hits == 0) return 1;  // 防止查找被优化掉
+    }
+    return 0;
+}
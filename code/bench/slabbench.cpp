@@ -0,0 +1,96 @@
+// 连接表的基准测试：以fd为下标的ConnSlab与原先的unordered_map<int, HttpConn>，
+// 在1万、10万、100万个连接时比较随机查找的耗时与常驻内存(每种情况在单独的子进程中测量)
+// 用法：./slabbench [查找次数]
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "../server/connslab.h"
+
+namespace {
+
+size_t ResidentBytes() {
+    long size = 0, resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (!fp) return 0;
+    if (fscanf(fp, "%ld %ld", &size, &resident) != 2) resident = 0;
+    fclose(fp);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// 随机的已打开fd序列，模拟事件循环按就绪顺序访问连接
+std::vector<int> RandomFds(int count, size_t lookups) {
+    std::mt19937 rng(count);
+    std::vector<int> fds(lookups);
+    for (int& fd : fds) fd = rng() % count + 1;
+    return fds;
+}
+
+void BenchSlab(int count, size_t lookups) {
+    std::vector<int> fds = RandomFds(count, lookups);
+    size_t base = ResidentBytes();
+    ConnSlab slab(count + 1);
+    for (int fd = 1; fd <= count; ++fd) slab.Acquire(fd, 0);
+    size_t resident = ResidentBytes() - base;
+
+    size_t open = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int fd : fds) {
+        ConnSlot* slot = slab.Get(fd);
+        open += slot && slot->IsOpenIn(0) && slot->interest == 0;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (open != fds.size()) exit(1);
+    printf("%-14s %9d %12.1f %12.1f %10.0f\n", "ConnSlab", count,
+           std::chrono::duration<double, std::nano>(elapsed).count() / fds.size(), resident / 1048576.0,
+           (double)resident / count);
+}
+
+void BenchMap(int count, size_t lookups) {
+    std::vector<int> fds = RandomFds(count, lookups);
+    size_t base = ResidentBytes();
+    std::unordered_map<int, HttpConn> users;
+    for (int fd = 1; fd <= count; ++fd) users[fd];
+    size_t resident = ResidentBytes() - base;
+
+    size_t open = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int fd : fds) {
+        auto it = users.find(fd);
+        open += it != users.end() && it->second.IsKeepAlive() == false;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (open != fds.size()) exit(1);
+    printf("%-14s %9d %12.1f %12.1f %10.0f\n", "unordered_map", count,
+           std::chrono::duration<double, std::nano>(elapsed).count() / fds.size(), resident / 1048576.0,
+           (double)resident / count);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t lookups = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000000;
+    printf("sizeof(ConnSlot) %zu, sizeof(HttpConn) %zu\n", sizeof(ConnSlot), sizeof(HttpConn));
+    printf("%-14s %9s %12s %12s %10s\n", "table", "conns", "lookup(ns)", "rss(MB)", "bytes/conn");
+    for (int count : {10000, 100000, 1000000}) {
+        for (auto bench : {BenchSlab, BenchMap}) {
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                bench(count, lookups);
+                fflush(stdout);
+                _exit(0);
+            }
+            int status = 0;
+            waitpid(pid, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "blockpool.h"
+
+// 线程的空闲链表销毁后置为true；thread_local的Buffer可能在它之后析构，此时直接释放
+static thread_local bool lists_destroyed = false;
+
+BlockPool::Lists::~Lists() {
+    for (int i = 0; i < kClasses; ++i) {
+        while (head[i]) {
+            FreeBlock* block = head[i];
+            head[i] = block->next;
+            delete[] reinterpret_cast<char*>(block);
+        }
+    }
+    lists_destroyed = true;
+}
+
+BlockPool::Lists* BlockPool::Local_() {
+    if (lists_destroyed) return nullptr;
+    static thread_local Lists lists;
+    return &lists;
+}
+
+int BlockPool::Class_(size_t size, size_t* cap) {
+    if (size > kMaxPooled) {
+        *cap = size;
+        return -1;
+    }
+    int cls = 0;
+    size_t block = kMinBlock;
+    while (block < size) {
+        block <<= 1;
+        ++cls;
+    }
+    *cap = block;
+    return cls;
+}
+
+char* BlockPool::Allocate(size_t size, size_t* cap) {
+    int cls = Class_(size, cap);
+    Lists* lists = cls >= 0 ? Local_() : nullptr;
+    if (lists && lists->head[cls]) {
+        FreeBlock* block = lists->head[cls];
+        lists->head[cls] = block->next;
+        lists->bytes[cls] -= *cap;
+        return reinterpret_cast<char*>(block);
+    }
+    return new char[*cap];  // 不初始化
+}
+
+void BlockPool::Free(char* block, size_t cap) {
+    if (!block) return;
+    size_t class_cap;
+    int cls = Class_(cap, &class_cap);
+    Lists* lists = cls >= 0 && class_cap == cap ? Local_() : nullptr;
+    if (!lists || lists->bytes[cls] + cap > kMaxCachedBytes) {
+        delete[] block;
+        return;
+    }
+    FreeBlock* free_block = reinterpret_cast<FreeBlock*>(block);
+    free_block->next = lists->head[cls];
+    lists->head[cls] = free_block;
+    lists->bytes[cls] += cap;
+}
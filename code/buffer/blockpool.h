@@ -0,0 +1,38 @@
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <stddef.h>
+
+// 内存块池：块的大小按2的幂从512B分级到1MB，每个线程有自己的空闲链表，分配与释放都不加锁。
+// 块可以在分配它之外的线程释放，释放时放入当前线程的空闲链表；每级缓存的字节数有上限，超过时直接释放。
+// 超过1MB的块不缓存，直接new/delete
+class BlockPool {
+public:
+    // 分配不小于size的块，实际大小写入cap
+    static char* Allocate(size_t size, size_t* cap);
+    // 释放Allocate得到的块，cap为其实际大小
+    static void Free(char* block, size_t cap);
+
+    static const size_t kMinBlock = 512;  // 只收到部分请求的空闲连接只占一个小块
+    static const size_t kMaxPooled = 1024 * 1024;
+    static const size_t kMaxCachedBytes = 4 * 1024 * 1024;  // 每个线程每级最多缓存的字节数
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static const int kClasses = 12;  // 512B, 1KB, ..., 1MB
+
+    // 线程的空闲链表，线程退出时释放缓存的块
+    struct Lists {
+        FreeBlock* head[kClasses] = {};
+        size_t bytes[kClasses] = {};
+        ~Lists();
+    };
+
+    static Lists* Local_();                     // 线程退出后返回nullptr
+    static int Class_(size_t size, size_t* cap);  // size所在的级别，超过kMaxPooled时返回-1
+};
+
+#endif
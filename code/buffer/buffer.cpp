@@ -1,8 +1,35 @@
 #include "buffer.h"
 
-Buffer::Buffer(int init_buff_size) : buffer_(init_buff_size), read_pos_(0), write_pos_(0) {}
+Buffer::Buffer(int init_buff_size)
+    : buffer_(nullptr), capacity_(0), init_size_(init_buff_size), read_pos_(0), write_pos_(0) {}
+
+Buffer::~Buffer() { BlockPool::Free(buffer_, capacity_); }
+
+Buffer::Buffer(Buffer&& other) noexcept
+    : buffer_(other.buffer_),
+      capacity_(other.capacity_),
+      init_size_(other.init_size_),
+      read_pos_(other.read_pos_),
+      write_pos_(other.write_pos_) {
+    other.buffer_ = nullptr;
+    other.capacity_ = other.read_pos_ = other.write_pos_ = 0;
+}
 
-size_t Buffer::WritableBytes() const { return buffer_.size() - write_pos_; }
+Buffer& Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        BlockPool::Free(buffer_, capacity_);
+        buffer_ = other.buffer_;
+        capacity_ = other.capacity_;
+        init_size_ = other.init_size_;
+        read_pos_ = other.read_pos_;
+        write_pos_ = other.write_pos_;
+        other.buffer_ = nullptr;
+        other.capacity_ = other.read_pos_ = other.write_pos_ = 0;
+    }
+    return *this;
+}
+
+size_t Buffer::WritableBytes() const { return capacity_ - write_pos_; }
 
 size_t Buffer::ReadableBytes() const { return write_pos_ - read_pos_; }
 
@@ -20,6 +47,7 @@ void Buffer::HasWritten(size_t len) { write_pos_ += len; }
 void Buffer::Retrieve(size_t len) {
     assert(len <= ReadableBytes());
     read_pos_ += len;
+    if (read_pos_ == write_pos_) read_pos_ = write_pos_ = 0;  // 读完时从头写，不需要移动数据
 }
 
 void Buffer::RetrieveUntil(const char* end) {
@@ -27,9 +55,12 @@ void Buffer::RetrieveUntil(const char* end) {
     Retrieve(end - Peek());
 }
 
-void Buffer::RetrieveAll() {
-    buffer_.clear();
-    read_pos_ = write_pos_ = 0;
+void Buffer::RetrieveAll() { read_pos_ = write_pos_ = 0; }
+
+void Buffer::Release() {
+    BlockPool::Free(buffer_, capacity_);
+    buffer_ = nullptr;
+    capacity_ = read_pos_ = write_pos_ = 0;
 }
 
 std::string Buffer::RetrieveAllToStr() {
@@ -46,8 +77,9 @@ void Buffer::Append(const std::string& str) { Append(str.data(), str.length());
 
 void Buffer::Append(const char* str, size_t len) {
     assert(str);
+    if (len == 0) return;
     EnsureWriteable(len);
-    std::copy(str, str + len, BeginWrite());
+    memcpy(BeginWrite(), str, len);
     HasWritten(len);
 }
 
@@ -59,24 +91,43 @@ void Buffer::Append(const void* data, size_t len) {
 void Buffer::Append(const Buffer& buff) { Append(buff.Peek(), buff.ReadableBytes()); }
 
 ssize_t Buffer::ReadFd(int fd, int* save_errno) {
-    char buff[65535];
+    // 还没有内存块时不预先分配，数据直接读入块池中的尾块，读完再决定接管尾块还是复制到合适大小的块
+    size_t spill_cap;
+    char* spill = BlockPool::Allocate(kSpillSize, &spill_cap);
     struct iovec iov[2];
+    int iovcnt = 0;
     const size_t writable = WritableBytes();
-    // 分散读，保证数据全部读完
-    iov[0].iov_base = BeginPtr_() + write_pos_;
-    iov[0].iov_len = writable;
-    iov[1].iov_base = buff;
-    iov[1].iov_len = sizeof(buff);
+    if (writable > 0) {
+        iov[iovcnt].iov_base = BeginPtr_() + write_pos_;
+        iov[iovcnt].iov_len = writable;
+        ++iovcnt;
+    }
+    iov[iovcnt].iov_base = spill;
+    iov[iovcnt].iov_len = spill_cap;
+    ++iovcnt;
 
-    const ssize_t len = readv(fd, iov, 2);
+    const ssize_t len = readv(fd, iov, iovcnt);
     if (len < 0) {
         *save_errno = errno;
     } else if (static_cast<size_t>(len) <= writable) {  // 够写
         write_pos_ += len;
-    } else {  // 不够写，再追加
-        write_pos_ = buffer_.size();
-        Append(buff, len - writable);
+    } else {
+        const size_t extra = len - writable;
+        if (writable == 0 && ReadableBytes() == 0 && extra >= kAdoptSize) {
+            // 数据全部在尾块中且读到的多：尾块直接作为缓冲区，不复制
+            BlockPool::Free(buffer_, capacity_);
+            buffer_ = spill;
+            capacity_ = spill_cap;
+            read_pos_ = 0;
+            write_pos_ = extra;
+            spill = nullptr;
+        } else {
+            write_pos_ = capacity_;
+            // 缓冲区要求数据连续，已有未读数据时溢出部分只能追加复制
+            Append(spill, extra);
+        }
     }
+    BlockPool::Free(spill, spill_cap);
     return len;
 }
 
@@ -91,18 +142,26 @@ ssize_t Buffer::WriteFd(int fd, int* save_errno) {
     return len;
 }
 
-char* Buffer::BeginPtr_() { return &(*buffer_.begin()); }
+char* Buffer::BeginPtr_() { return buffer_; }
 
-const char* Buffer::BeginPtr_() const { return &(*buffer_.begin()); };
+const char* Buffer::BeginPtr_() const { return buffer_; }
 
 void Buffer::MakeSpace_(size_t len) {
     if (WritableBytes() + PrependableBytes() < len) {
-        buffer_.resize(write_pos_ + len + 1);
-        // 这里即使resize没有原地扩展，也没有影响，因为读索引和写索引都是相对于buffer_的首地址的偏移量
+        // 换用更大的块，只复制未读的数据，新块不需要清零
+        size_t readable = ReadableBytes();
+        size_t cap;
+        char* block = BlockPool::Allocate(std::max(readable + len, std::max(init_size_, capacity_ * 2)), &cap);
+        if (readable > 0) memcpy(block, BeginPtr_() + read_pos_, readable);
+        BlockPool::Free(buffer_, capacity_);
+        buffer_ = block;
+        capacity_ = cap;
+        read_pos_ = 0;
+        write_pos_ = readable;
     } else {
         // 将数据往前移动，保证可写空间
         size_t readable = ReadableBytes();
-        std::copy(BeginPtr_() + read_pos_, BeginPtr_() + write_pos_, BeginPtr_());
+        memmove(BeginPtr_(), BeginPtr_() + read_pos_, readable);
         read_pos_ = 0;
         write_pos_ = read_pos_ + readable;
         assert(readable == ReadableBytes());
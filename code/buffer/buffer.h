@@ -4,17 +4,24 @@
 #include <sys/uio.h>  // readv
 #include <unistd.h>   // write
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <cstring>  // perror
 #include <iostream>
 #include <vector>
 
+#include "blockpool.h"
+
+// 连续的读写缓冲区，内存块从当前线程的块池中分配，扩容时换用更大的块，清空时保留块不释放；
+// 只在所属的线程(或加锁)访问，读写索引不需要原子类型
 class Buffer {
 public:
-    // 使用init_buff_size初始化数组大小
+    // 首次写入时分配不小于init_buff_size的块
     Buffer(int init_buff_size = 1024);
-    ~Buffer() = default;
+    ~Buffer();
+    Buffer(Buffer&& other) noexcept;
+    Buffer& operator=(Buffer&& other) noexcept;
 
     size_t WritableBytes() const;  // 返回缓冲区中可写数据的长度
     size_t ReadableBytes() const;  // 返回缓冲区中可读数据的长度
@@ -32,8 +39,11 @@ public:
     void Retrieve(size_t len);
     // 更新读索引，直到读索引指向end
     void RetrieveUntil(const char* end);
-    // 清空缓冲区。
+    // 清空缓冲区，保留内存块
     void RetrieveAll();
+    // 清空缓冲区并把内存块还给当前线程的块池，连接关闭时调用
+    void Release();
+    size_t Capacity() const { return capacity_; }
     // 将缓冲区内可读的数据全部读出，并清空缓冲区
     std::string RetrieveAllToStr();
 
@@ -48,13 +58,20 @@ public:
     void Append(const Buffer& buff);
 
     // 从fd中读取数据并写入缓冲区，返回读取到的数据的长度，如果发生错误，则将错误码保存在
-    // save_errno指向的变量中。
+    // save_errno指向的变量中。可写空间之后再接一个块池中的尾块，一次readv读完；缓冲区为空且读到的数据
+    // 不少于kAdoptSize时接管尾块，否则把溢出的部分追加到缓冲区
     ssize_t ReadFd(int fd, int* save_errno);
     // 将缓冲区中的数据写入fd中，回写入的数据的长度。如果发生错误，则将错误码保存在 save_errno
     // 指向的变量中。
     ssize_t WriteFd(int fd, int* save_errno);
 
+    static const size_t kSpillSize = 64 * 1024;  // ReadFd的尾块大小
+    static const size_t kAdoptSize = 16 * 1024;  // 读到的数据不少于该值时接管尾块，少于时复制
+
 private:
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
     // 返回缓冲区的起始位置的地址
     char* BeginPtr_();
     const char* BeginPtr_() const;
@@ -62,10 +79,11 @@ private:
     // 调整空间，以保证能够向其中写入len个char
     void MakeSpace_(size_t len);
 
-    std::vector<char> buffer_;  // char 数组，用于存储数据
-    // 使用对应的原子类型，避免竞态条件
-    std::atomic<std::size_t> read_pos_;   // 读索引
-    std::atomic<std::size_t> write_pos_;  // 写索引
+    char* buffer_;           // 块池中的内存块，未写入过时为nullptr
+    size_t capacity_;        // 内存块的大小
+    size_t init_size_;       // 首次分配的最小大小
+    std::size_t read_pos_;   // 读索引
+    std::size_t write_pos_;  // 写索引
 };
 
 #endif
\ No newline at end of file
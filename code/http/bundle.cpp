@@ -0,0 +1,239 @@
+#include "bundle.h"
+
+#include <algorithm>
+
+#include "compressor.h"
+#include "httpresponse.h"
+
+const char StaticBundle::MAGIC[8] = {'W', 'S', 'B', 'U', 'N', 'D', 'L', 'E'};
+
+uint64_t StaticBundle::Hash_(std::string_view path) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char ch : path) {
+        hash ^= ch;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool StaticBundle::Collect_(const std::string& root, const std::string& rel, std::vector<std::string>& paths,
+                            int depth) {
+    if (depth > kMaxDepth) return true;
+    DIR* dir = opendir((root + rel).c_str());
+    if (!dir) return false;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        std::string name = ent->d_name;
+        if (name == "." || name == "..") continue;
+        std::string child = rel + "/" + name;
+        struct stat st;
+        if (stat((root + child).c_str(), &st) < 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            Collect_(root, child, paths, depth + 1);
+        } else if (S_ISREG(st.st_mode) && (st.st_mode & S_IROTH)) {  // 与文件缓存一样，只提供其他用户可读的文件
+            paths.push_back(child);
+        }
+    }
+    closedir(dir);
+    return true;
+}
+
+int StaticBundle::Pack(const std::string& root_dir, const std::string& out) {
+    std::string root = root_dir;
+    while (!root.empty() && root.back() == '/') root.pop_back();
+    std::vector<std::string> paths;
+    if (!Collect_(root, "", paths, 0)) {
+        LOG_ERROR("bundle: cannot open %s", root_dir.c_str());
+        return -1;
+    }
+    std::sort(paths.begin(), paths.end());  // 相同的目录生成相同的打包文件
+
+    std::string tmp = out + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (!fp) return -1;
+
+    uint64_t offset = sizeof(Header);
+    bool ok = fseek(fp, offset, SEEK_SET) == 0;
+    auto append = [&](std::string_view data) {
+        Ref ref = {offset, data.size()};
+        if (!data.empty() && fwrite(data.data(), 1, data.size(), fp) != data.size()) ok = false;
+        offset += data.size();
+        return ref;
+    };
+    auto write_variant = [&](const CachedFile& file, std::string_view data) {
+        Variant variant;
+        variant.data = append(data);
+        variant.etag = append(file.etag);
+        variant.type_header = append(file.type_header);
+        variant.encoding_header = append(file.encoding_header);
+        variant.validator_header = append(file.validator_header);
+        return variant;
+    };
+
+    std::vector<Entry> entries;
+    std::string data;
+    Buffer gzip_buff;
+    for (const std::string& path : paths) {
+        int fd = open((root + path).c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            if (fd >= 0) close(fd);
+            continue;
+        }
+        data.resize(st.st_size);
+        size_t read_len = 0;
+        while (read_len < data.size()) {
+            ssize_t len = pread(fd, &data[read_len], data.size() - read_len, read_len);
+            if (len < 0 && errno == EINTR) continue;
+            if (len <= 0) break;
+            read_len += len;
+        }
+        close(fd);
+        if (read_len < data.size()) continue;
+
+        // 只压缩一次，与文件缓存一样使用最高压缩级别，压缩后不小于原大小的7/8时不保留
+        gzip_buff.RetrieveAll();
+        bool has_gzip = false;
+        if (FileCache::Compressible(path) && data.size() >= 256) {
+            Compressor& compressor = Compressor::Local();
+            has_gzip = compressor.Begin(Compressor::GZIP, 9) &&
+                       compressor.Update(data.data(), data.size(), gzip_buff) && compressor.Finish(gzip_buff) &&
+                       gzip_buff.ReadableBytes() < data.size() - data.size() / 8;
+        }
+
+        // ETag由内容散列生成，同样的内容在不同版本的打包文件中ETag相同
+        char etag[32];
+        snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long)Hash_(data));
+        CachedFile file;
+        file.etag = etag;
+        file.last_modified.resize(HttpParser::kHttpDateLen + 1);
+        file.last_modified.resize(HttpParser::FormatHttpDate(st.st_mtime, &file.last_modified[0]));
+        HttpResponse::BuildFileHeader(path, std::string_view(), has_gzip, file);
+
+        Entry entry = {};
+        entry.hash = Hash_(path);
+        entry.mtime = st.st_mtime;
+        entry.path = append(path);
+        entry.type = append(HttpResponse::MimeType(path));
+        entry.last_modified = append(file.last_modified);
+        entry.file = write_variant(file, data);
+        if (has_gzip) {
+            CachedFile gzip;
+            gzip.etag = file.etag.substr(0, file.etag.size() - 1) + "-gz\"";
+            gzip.last_modified = file.last_modified;
+            HttpResponse::BuildFileHeader(path, "gzip", true, gzip);
+            entry.gzip = write_variant(gzip, std::string_view(gzip_buff.Peek(), gzip_buff.ReadableBytes()));
+        }
+        entries.push_back(entry);
+    }
+
+    // 条目数组按8字节对齐，之后是槽位数为条目数2倍以上的开放寻址散列表
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = kVersion;
+    header.count = entries.size();
+    header.slots = 16;
+    while (header.slots < entries.size() * 2) header.slots <<= 1;
+    append(std::string(-offset & 7, '\0'));
+    header.entries = offset;
+    append(std::string_view((const char*)entries.data(), entries.size() * sizeof(Entry)));
+    std::vector<uint32_t> table(header.slots, 0);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        uint32_t slot = entries[i].hash & (header.slots - 1);
+        while (table[slot]) slot = (slot + 1) & (header.slots - 1);
+        table[slot] = i + 1;
+    }
+    header.table = offset;
+    append(std::string_view((const char*)table.data(), table.size() * sizeof(uint32_t)));
+
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), out.c_str()) < 0) {
+        unlink(tmp.c_str());
+        return -1;
+    }
+    return entries.size();
+}
+
+bool StaticBundle::Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    // MAP_POPULATE预先读入并建立页表，请求期间不再缺页
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return false;
+    mapping_ = std::shared_ptr<const void>(addr, [size](const void* p) { munmap(const_cast<void*>(p), size); });
+    base_ = (const char*)addr;
+    size_ = size;
+
+    const Header* header = (const Header*)base_;
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != kVersion || header->slots == 0 ||
+        (header->slots & (header->slots - 1)) != 0 || header->entries % 8 != 0 || header->table % 4 != 0 ||
+        !Valid_({header->entries, (uint64_t)header->count * sizeof(Entry)}) ||
+        !Valid_({header->table, (uint64_t)header->slots * sizeof(uint32_t)}) || header->count >= header->slots) {
+        mapping_.reset();
+        return false;
+    }
+    entries_ = (const Entry*)(base_ + header->entries);
+    table_ = (const uint32_t*)(base_ + header->table);
+    slots_ = header->slots;
+
+    // 启动时为每个文件建立缓存条目，内容与响应头都来自打包文件
+    files_.clear();
+    for (uint32_t i = 0; i < header->count; ++i) {
+        const Entry& entry = entries_[i];
+        for (const Ref* ref : {&entry.path, &entry.type, &entry.last_modified, &entry.file.data, &entry.file.etag,
+                               &entry.file.type_header, &entry.file.encoding_header, &entry.file.validator_header,
+                               &entry.gzip.data, &entry.gzip.etag, &entry.gzip.type_header,
+                               &entry.gzip.encoding_header, &entry.gzip.validator_header}) {
+            if (!Valid_(*ref)) {
+                files_.clear();
+                mapping_.reset();
+                return false;
+            }
+        }
+        std::shared_ptr<CachedFile> file = MakeFile_(entry, entry.file);
+        if (entry.gzip.data.len > 0) {
+            file->gzip = MakeFile_(entry, entry.gzip);
+            file->vary = true;
+        }
+        files_.push_back(std::move(file));
+    }
+    return true;
+}
+
+std::shared_ptr<CachedFile> StaticBundle::MakeFile_(const Entry& entry, const Variant& variant) const {
+    auto file = std::make_shared<CachedFile>();
+    file->path = View_(entry.path);
+    file->data = variant.data.len > 0 ? const_cast<char*>(base_ + variant.data.offset) : nullptr;
+    file->size = variant.data.len;
+    file->storage = mapping_;
+    file->st.st_mode = S_IFREG | 0444;
+    file->st.st_size = variant.data.len;
+    file->st.st_mtime = entry.mtime;
+    file->etag = View_(variant.etag);
+    file->last_modified = View_(entry.last_modified);
+    file->type_header = View_(variant.type_header);
+    file->encoding_header = View_(variant.encoding_header);
+    file->validator_header = View_(variant.validator_header);
+    return file;
+}
+
+std::shared_ptr<const CachedFile> StaticBundle::Find(std::string_view path) const {
+    if (slots_ == 0) return nullptr;
+    uint64_t hash = Hash_(path);
+    uint32_t slot = hash & (slots_ - 1);
+    for (uint32_t probe = 0; probe < slots_; ++probe, slot = (slot + 1) & (slots_ - 1)) {
+        uint32_t index = table_[slot];
+        if (index == 0 || index > files_.size()) return nullptr;
+        const Entry& entry = entries_[index - 1];
+        if (entry.hash == hash && View_(entry.path) == path) return files_[index - 1];
+    }
+    return nullptr;
+}
@@ -0,0 +1,88 @@
+#ifndef STATIC_BUNDLE_H
+#define STATIC_BUNDLE_H
+
+#include <dirent.h>    // opendir
+#include <fcntl.h>     // open
+#include <stdint.h>
+#include <stdio.h>     // rename
+#include <sys/mman.h>  // mmap, munmap
+#include <sys/stat.h>  // stat
+#include <unistd.h>    // close, pread
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "filecache.h"
+
+// 静态资源打包文件：把资源目录下的文件连同索引、类型、预先生成的响应头、ETag与gzip版本打包为一个文件。
+// 服务器启动时mmap一次，按路径散列表查找，请求期间不访问文件系统；打包文件以rename原子替换，不会重新加载，替换后重启生效。
+// 文件布局：Header | 各文件的字符串与内容 | Entry数组 | 散列表(uint32_t槽位，存条目下标+1，0为空)
+class StaticBundle {
+public:
+    StaticBundle() : base_(nullptr), size_(0), entries_(nullptr), table_(nullptr), slots_(0) {}
+
+    // 将root目录下所有其他用户可读的普通文件打包到out(先写临时文件再改名)，返回打包的文件数，失败返回-1
+    static int Pack(const std::string& root, const std::string& out);
+
+    bool Open(const std::string& path);  // 映射打包文件并为每个文件建立缓存条目
+    // path为规范化后的相对路径，如"/css/style.css"，找不到时返回空
+    std::shared_ptr<const CachedFile> Find(std::string_view path) const;
+    size_t Count() const { return files_.size(); }
+
+private:
+    struct Ref {  // 打包文件中的一段数据
+        uint64_t offset;
+        uint64_t len;
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;    // 文件数
+        uint32_t slots;    // 散列表槽位数，2的幂
+        uint32_t reserved;
+        uint64_t entries;  // Entry数组的偏移
+        uint64_t table;    // 散列表的偏移
+    };
+
+    // 文件或其gzip版本的一种表示
+    struct Variant {
+        Ref data;
+        Ref etag;
+        Ref type_header;  // 与CachedFile中预先生成的响应头对应
+        Ref encoding_header;
+        Ref validator_header;
+    };
+
+    struct Entry {
+        uint64_t hash;   // 相对路径的散列
+        int64_t mtime;   // 修改时间
+        Ref path;        // 相对路径
+        Ref type;        // MIME类型
+        Ref last_modified;
+        Variant file;
+        Variant gzip;    // data.len为0表示没有压缩版本
+    };
+
+    static uint64_t Hash_(std::string_view path);  // FNV-1a
+    static bool Collect_(const std::string& root, const std::string& rel, std::vector<std::string>& paths, int depth);
+    std::shared_ptr<CachedFile> MakeFile_(const Entry& entry, const Variant& variant) const;
+    bool Valid_(const Ref& ref) const { return ref.offset <= size_ && ref.len <= size_ - ref.offset; }
+    std::string_view View_(const Ref& ref) const { return std::string_view(base_ + ref.offset, ref.len); }
+
+    static const char MAGIC[8];
+    static const uint32_t kVersion = 1;
+    static const int kMaxDepth = 32;  // 目录的最大深度，避免符号链接形成的环
+
+    std::shared_ptr<const void> mapping_;  // 整个打包文件的映射，缓存条目持有它，内容直接指向其中
+    const char* base_;
+    size_t size_;
+    const Entry* entries_;
+    const uint32_t* table_;
+    uint32_t slots_;
+    std::vector<std::shared_ptr<const CachedFile>> files_;  // 按条目下标
+};
+
+#endif
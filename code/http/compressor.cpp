@@ -0,0 +1,81 @@
+#include "compressor.h"
+
+bool Compressor::enable_ = true;
+int Compressor::level_ = 6;
+size_t Compressor::min_size_ = 1024;
+
+Compressor::Compressor() : inited_{}, levels_{}, cur_(nullptr) {}
+
+Compressor::~Compressor() {
+    for (int i = 0; i < ENCODING_COUNT; ++i) {
+        if (inited_[i]) deflateEnd(&streams_[i]);
+    }
+}
+
+Compressor& Compressor::Local() {
+    thread_local Compressor compressor;
+    return compressor;
+}
+
+bool Compressor::Begin(ENCODING encoding, int level) {
+    z_stream& stream = streams_[encoding];
+    if (!inited_[encoding]) {
+        stream = {};
+        // windowBits加16输出gzip格式，否则为zlib格式
+        int window_bits = encoding == GZIP ? 15 + 16 : 15;
+        if (deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            LOG_ERROR("deflateInit2 error");
+            return false;
+        }
+        inited_[encoding] = true;
+        levels_[encoding] = level;
+    } else {
+        deflateReset(&stream);
+        // 刚重置的流还没有输入，修改级别不会产生输出
+        if (levels_[encoding] != level && deflateParams(&stream, level, Z_DEFAULT_STRATEGY) == Z_OK) {
+            levels_[encoding] = level;
+        }
+    }
+    cur_ = &stream;
+    return true;
+}
+
+bool Compressor::Update(const char* data, size_t len, Buffer& out) { return Deflate_(data, len, Z_NO_FLUSH, out); }
+
+bool Compressor::Finish(Buffer& out) {
+    bool ok = Deflate_(nullptr, 0, Z_FINISH, out);
+    cur_ = nullptr;
+    return ok;
+}
+
+bool Compressor::Deflate_(const char* data, size_t len, int flush, Buffer& out) {
+    assert(cur_);
+    cur_->next_in = (Bytef*)data;
+    cur_->avail_in = len;
+    while (true) {
+        // 输出直接写入Buffer的可写区域
+        size_t avail = std::max<size_t>(deflateBound(cur_, cur_->avail_in), 256);
+        out.EnsureWriteable(avail);
+        cur_->next_out = (Bytef*)out.BeginWrite();
+        cur_->avail_out = avail;
+        int ret = deflate(cur_, flush);
+        out.HasWritten(avail - cur_->avail_out);
+        if (ret == Z_STREAM_END) return true;
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            LOG_ERROR("deflate error: %d", ret);
+            return false;
+        }
+        if (flush == Z_NO_FLUSH && cur_->avail_in == 0) return true;
+    }
+}
+
+bool Compressor::Compressible(std::string_view content_type) {
+    content_type = content_type.substr(0, content_type.find(';'));
+    if (content_type.compare(0, 6, "image/") == 0) return content_type == "image/svg+xml" || content_type == "image/x-icon";
+    if (content_type.compare(0, 6, "video/") == 0 || content_type.compare(0, 6, "audio/") == 0) return false;
+    return content_type != "application/x-gzip" && content_type != "application/gzip" &&
+           content_type != "application/zip" && content_type != "application/x-tar" &&
+           content_type != "application/pdf" && content_type.compare(0, 9, "font/woff") != 0;
+}
+
+std::string_view Compressor::Name(ENCODING encoding) { return encoding == GZIP ? "gzip" : "deflate"; }
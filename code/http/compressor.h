@@ -0,0 +1,55 @@
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <zlib.h>  // deflate
+
+#include <algorithm>
+#include <cassert>
+#include <string_view>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+
+// 响应正文的流式压缩：数据分段送入，压缩结果依次追加到Buffer中。
+// 每个线程一个压缩器(Local)，zlib的状态在响应之间通过deflateReset复用，不为每个响应分配
+class Compressor {
+public:
+    enum ENCODING {
+        GZIP = 0,  // gzip格式
+        DEFLATE,   // HTTP的deflate，即zlib格式
+        ENCODING_COUNT,
+    };
+
+    Compressor();
+    ~Compressor();
+
+    static Compressor& Local();  // 当前线程的压缩器
+
+    // 开始压缩一个新的正文，level为zlib压缩级别(1~9)
+    bool Begin(ENCODING encoding, int level);
+    // 压缩一段数据，输出追加到out
+    bool Update(const char* data, size_t len, Buffer& out);
+    // 结束压缩，输出剩余的数据与结尾
+    bool Finish(Buffer& out);
+
+    // 是否值得压缩，图片(SVG除外)、音视频与压缩包等已压缩的类型返回false
+    static bool Compressible(std::string_view content_type);
+    static std::string_view Name(ENCODING encoding);  // Content-Encoding中的名称
+
+    static bool enable_;      // 是否压缩动态生成的正文
+    static int level_;        // 压缩级别
+    static size_t min_size_;  // 小于该大小的正文不压缩
+
+private:
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+
+    bool Deflate_(const char* data, size_t len, int flush, Buffer& out);
+
+    z_stream streams_[ENCODING_COUNT];  // 按需初始化，之后一直复用
+    bool inited_[ENCODING_COUNT];
+    int levels_[ENCODING_COUNT];         // 各流当前的压缩级别
+    z_stream* cur_;                      // 正在压缩的流
+};
+
+#endif
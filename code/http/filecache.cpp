@@ -0,0 +1,496 @@
+#include "filecache.h"
+
+#include "bundle.h"
+#include "httpresponse.h"
+
+size_t FileCache::max_bytes_ = 64 * 1024 * 1024;
+size_t FileCache::small_file_size_ = 16 * 1024;
+size_t FileCache::sendfile_threshold_ = 256 * 1024;
+bool FileCache::gzip_ = true;
+size_t FileCache::max_compress_size_ = 8 * 1024 * 1024;
+size_t FileCache::inline_compress_size_ = 32 * 1024;
+bool FileCache::check_residency_ = true;
+size_t FileCache::prefetch_size_ = 4 * 1024 * 1024;
+
+const std::unordered_set<std::string_view> FileCache::COMPRESS_SUFFIX = {
+    ".html", ".htm", ".xhtml", ".xml", ".txt", ".rtf", ".css", ".js",
+    ".json", ".svg", ".ttf", ".otf", ".eot", ".ico",
+};
+
+// 文件内容、权限、目录结构的变化；IN_IGNORED总会上报
+static const uint32_t kWatchMask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                   IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+CachedFile::~CachedFile() {
+    if (fd >= 0) close(fd);
+    if (probe) munmap(probe, size);
+    if (!data || storage) return;
+    if (mapped) {
+        munmap(data, size);
+    } else {
+        delete[] data;
+    }
+}
+
+FileCache& FileCache::Instance() {
+    static FileCache cache;
+    return cache;
+}
+
+FileCache::FileCache() : epoch_(0), cold_(0), prefetched_(0), prefetch_us_(0), compress_pool_(nullptr) {
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (inotify_fd_ < 0 || stop_fd_ < 0) {
+        // 无法得知文件变化时不缓存，每次请求都重新打开
+        LOG_WARN("inotify unavailable, file cache disabled");
+        if (inotify_fd_ >= 0) close(inotify_fd_);
+        if (stop_fd_ >= 0) close(stop_fd_);
+        inotify_fd_ = stop_fd_ = -1;
+        return;
+    }
+    watch_thread_ = std::thread(&FileCache::WatchLoop_, this);
+}
+
+FileCache::~FileCache() {
+    if (watch_thread_.joinable()) {
+        uint64_t one = 1;
+        ssize_t ret = write(stop_fd_, &one, sizeof(one));
+        (void)ret;
+        watch_thread_.join();
+    }
+    if (inotify_fd_ >= 0) close(inotify_fd_);
+    if (stop_fd_ >= 0) close(stop_fd_);
+}
+
+bool FileCache::UseBundle(const std::string& path) {
+    std::unique_ptr<StaticBundle> bundle(new StaticBundle());
+    if (!bundle->Open(path)) {
+        LOG_ERROR("bundle %s open error", path.c_str());
+        return false;
+    }
+    LOG_INFO("serving %zu files from bundle %s", bundle->Count(), path.c_str());
+    bundle_ = std::move(bundle);
+    Clear();
+    return true;
+}
+
+std::shared_ptr<const CachedFile> FileCache::Get(const std::string& root, std::string_view path) {
+    thread_local std::string key;  // 命中时不分配内存
+    size_t base = 0;
+    if (bundle_) {  // 打包文件只读，查找不加锁；找不到时返回共享的404结果
+        static const std::shared_ptr<const CachedFile> not_found = [] {
+            auto file = std::make_shared<CachedFile>();
+            file->err = ENOENT;
+            return file;
+        }();
+        if (!Normalize_(std::string(), path, key, base)) return not_found;
+        std::shared_ptr<const CachedFile> file = bundle_->Find(key);
+        return file ? file : not_found;
+    }
+    if (!Normalize_(root, path, key, base)) {
+        auto file = std::make_shared<CachedFile>();
+        file->err = ENOENT;
+        return file;
+    }
+
+    Shard& shard = ShardOf_(key);
+    {
+        std::lock_guard<std::mutex> locker(shard.mtx);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            ++shard.hits;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            return *it->second;
+        }
+        ++shard.misses;
+    }
+
+    // 先记下事件批次再开始监视与加载，加载期间文件发生变化时结果不放入缓存
+    uint64_t epoch = epoch_.load();
+    bool watched = Watch_(std::string_view(key).substr(0, base), key);
+    std::shared_ptr<CachedFile> file = Load_(key, watched);
+    if (!watched) return file;
+
+    {
+        std::lock_guard<std::mutex> locker(shard.mtx);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) return *it->second;  // 其它线程已加载
+        if (epoch_.load() != epoch || !Insert_(shard, file)) return file;
+    }
+    // 只有放入缓存的线程压缩，同时未命中的请求不会重复压缩同一个文件
+    if (file->vary && !file->gzip) CompressLater_(file);
+    return file;
+}
+
+bool FileCache::Normalize_(const std::string& root, std::string_view path, std::string& out, size_t& base) {
+    if (path.empty() || path[0] != '/' || path.find('\0') != std::string_view::npos) return false;
+    out.assign(root);
+    while (!out.empty() && out.back() == '/') out.pop_back();
+    base = out.size();
+
+    size_t pos = 1;
+    while (pos <= path.size()) {
+        size_t end = path.find('/', pos);
+        if (end == std::string_view::npos) end = path.size();
+        std::string_view segment = path.substr(pos, end - pos);
+        pos = end + 1;
+        if (segment.empty() || segment == ".") continue;
+        if (segment == "..") {  // 回到上一级，已在root时忽略
+            if (out.size() > base) out.resize(out.rfind('/'));
+            continue;
+        }
+        out += '/';
+        out.append(segment.data(), segment.size());
+    }
+    if (out.size() == base) out += '/';  // root本身
+    return true;
+}
+
+std::shared_ptr<CachedFile> FileCache::Load_(const std::string& path, bool compress) {
+    auto file = std::make_shared<CachedFile>();
+    file->path = path;
+    // O_NONBLOCK避免打开FIFO时阻塞，对普通文件没有影响
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        file->err = errno;
+        return file;
+    }
+
+    if (fstat(fd, &file->st) < 0) {
+        file->err = errno;
+    } else if (!S_ISREG(file->st.st_mode)) {
+        file->err = EISDIR;  // 目录等不是普通文件
+    } else if (!(file->st.st_mode & S_IROTH)) {
+        file->err = EACCES;  // 其他用户不可读的文件不对外提供
+    } else if (file->st.st_size > 0) {
+        size_t size = file->st.st_size;
+        if (size <= small_file_size_) {
+            char* data = new char[size];
+            size_t read_len = 0;
+            while (read_len < size) {
+                ssize_t len = pread(fd, data + read_len, size - read_len, read_len);
+                if (len < 0 && errno == EINTR) continue;
+                if (len <= 0) break;
+                read_len += len;
+            }
+            if (read_len == size) {
+                file->data = data;
+                file->size = size;
+            } else {
+                delete[] data;
+                file->err = EIO;
+            }
+        } else if (size > sendfile_threshold_) {
+            // 保留fd，由sendfile从页缓存直接发送，多个连接以各自的偏移共用
+            file->fd = fd;
+            file->size = size;
+            fd = -1;
+            if (check_residency_) {  // 只占用虚拟地址空间，不会被读取
+                void* mm_ret = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+                if (mm_ret != MAP_FAILED) file->probe = (char*)mm_ret;
+            }
+        } else {
+            // MAP_PRIVATE 建立一个写时拷贝的私有映射
+            void* mm_ret = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mm_ret == MAP_FAILED) {
+                file->err = errno;
+            } else {
+                file->data = (char*)mm_ret;
+                file->size = size;
+                file->mapped = true;
+            }
+        }
+    }
+    if (fd >= 0) close(fd);
+
+    if (!file->err) {  // 校验器与文件一起缓存，文件变化时条目失效，不会返回过期的值
+        char buf[64];
+        uint64_t mtime_ns = (uint64_t)file->st.st_mtim.tv_sec * 1000000000 + file->st.st_mtim.tv_nsec;
+        snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"", (unsigned long)file->st.st_ino,
+                 (unsigned long)file->st.st_size, (unsigned long)mtime_ns);
+        file->etag = buf;
+        file->last_modified.resize(HttpParser::kHttpDateLen + 1);
+        file->last_modified.resize(HttpParser::FormatHttpDate(file->st.st_mtime, &file->last_modified[0]));
+    }
+
+    // 压缩版本不大于原文件，连同它超过分片上限的文件放不进缓存，也不压缩；
+    // 较大的文件不在这里压缩(会阻塞事件循环)，放入缓存后交给压缩线程池，没有线程池时不压缩
+    if (compress && !file->err && gzip_ && file->size >= kMinCompressSize && file->size <= max_compress_size_ &&
+        Cost_(*file) + file->size <= max_bytes_ / kShards && Compressible(path)) {
+        if (file->size <= inline_compress_size_) {
+            file->gzip = Compress_(*file);
+            file->vary = file->gzip != nullptr;
+        } else {
+            file->vary = Instance().compress_pool_.load() != nullptr;
+        }
+    }
+    if (!file->err) HttpResponse::BuildFileHeader(path, std::string_view(), file->vary, *file);
+    LOG_DEBUG("file cache load %s, err:%d, size:%zu", path.c_str(), file->err, file->size);
+    return file;
+}
+
+bool FileCache::Compressible(std::string_view path) {
+    size_t dot = path.find_last_of("./");
+    return dot != std::string_view::npos && path[dot] == '.' && COMPRESS_SUFFIX.count(path.substr(dot)) == 1;
+}
+
+std::shared_ptr<CachedFile> FileCache::Compress_(const CachedFile& file) {
+    const char* data = file.data ? file.data : file.probe;
+    void* mm_ret = MAP_FAILED;
+    if (!data) {  // 由sendfile发送的文件临时映射一次用于压缩
+        mm_ret = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+        if (mm_ret == MAP_FAILED) return nullptr;
+        data = (const char*)mm_ret;
+    }
+    z_stream stream = {};
+    // windowBits加16输出gzip格式；只压缩一次，使用最高压缩级别
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        if (mm_ret != MAP_FAILED) munmap(mm_ret, file.size);
+        return nullptr;
+    }
+    size_t bound = deflateBound(&stream, file.size);
+    std::unique_ptr<char[]> out(new char[bound]);
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = file.size;
+    stream.next_out = (Bytef*)out.get();
+    stream.avail_out = bound;
+    int ret = deflate(&stream, Z_FINISH);
+    size_t len = stream.total_out;
+    deflateEnd(&stream);
+    if (mm_ret != MAP_FAILED) munmap(mm_ret, file.size);
+    if (ret != Z_STREAM_END || len >= file.size - file.size / 8) return nullptr;
+
+    auto gzip = std::make_shared<CachedFile>();
+    gzip->path = file.path + ".gz";
+    gzip->st = file.st;
+    gzip->st.st_size = len;
+    gzip->etag = file.etag.substr(0, file.etag.size() - 1) + "-gz\"";
+    gzip->last_modified = file.last_modified;
+    if (len > sendfile_threshold_) {
+        // 与大文件一样由sendfile发送，压缩结果放入memfd
+        int fd = memfd_create("gzip", MFD_CLOEXEC);
+        size_t written = 0;
+        while (fd >= 0 && written < len) {
+            ssize_t n = write(fd, out.get() + written, len - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            written += n;
+        }
+        if (written < len) {
+            if (fd >= 0) close(fd);
+            return nullptr;
+        }
+        gzip->fd = fd;
+    } else {
+        gzip->data = out.release();
+    }
+    gzip->size = len;
+    HttpResponse::BuildFileHeader(file.path, "gzip", true, *gzip);
+    LOG_DEBUG("gzip %s: %zu -> %zu", file.path.c_str(), file.size, len);
+    return gzip;
+}
+
+void FileCache::CompressLater_(const std::shared_ptr<CachedFile>& file) {
+    ThreadPool* pool = compress_pool_.load();
+    if (!pool) return;
+    pool->AddTask([this, file] {
+        std::shared_ptr<const CachedFile> gzip = Compress_(*file);
+        if (!gzip) return;  // 压缩无收益，继续发送原文件(已带Vary)
+        Shard& shard = ShardOf_(file->path);
+        std::lock_guard<std::mutex> locker(shard.mtx);
+        auto it = shard.index.find(file->path);
+        if (it == shard.index.end() || it->second->get() != file.get()) return;  // 压缩期间已失效或被淘汰
+        // 在分片锁内设置，Erase_减去的字节数与这里加上的一致
+        size_t before = Cost_(*file);
+        std::atomic_store(&file->gzip, gzip);
+        shard.bytes += Cost_(*file) - before;
+        while (shard.bytes > max_bytes_ / kShards) {
+            Erase_(shard, std::prev(shard.lru.end()));
+            ++shard.evictions;
+        }
+    });
+}
+
+size_t FileCache::Cost_(const CachedFile& file) {
+    size_t cost = (file.fd >= 0 ? kFdCost : file.size) + file.path.size() + kEntryOverhead;
+    std::shared_ptr<const CachedFile> gzip = file.Gzip();
+    if (gzip) cost += gzip->fd >= 0 ? kFdCost : gzip->size;
+    return cost;
+}
+
+FileCache::Shard& FileCache::ShardOf_(std::string_view path) {
+    return shards_[std::hash<std::string_view>()(path) % kShards];
+}
+
+bool FileCache::Insert_(Shard& shard, const std::shared_ptr<const CachedFile>& file) {
+    size_t limit = max_bytes_ / kShards;
+    size_t cost = Cost_(*file);
+    if (cost > limit) return false;
+    shard.lru.push_front(file);
+    shard.index.emplace(file->path, shard.lru.begin());
+    shard.bytes += cost;
+    while (shard.bytes > limit) {  // 淘汰最久未使用的条目
+        Erase_(shard, std::prev(shard.lru.end()));
+        ++shard.evictions;
+    }
+    return true;
+}
+
+void FileCache::Erase_(Shard& shard, Shard::LruList::iterator it) {
+    // 先删除索引，其键引用条目的path
+    shard.bytes -= Cost_(**it);
+    shard.index.erase((*it)->path);
+    shard.lru.erase(it);
+}
+
+void FileCache::Clear() {
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> locker(shard.mtx);
+        shard.invalidations += shard.lru.size();
+        shard.index.clear();
+        shard.lru.clear();
+        shard.bytes = 0;
+    }
+}
+
+FileCache::Stats FileCache::GetStats() const {
+    Stats stats = {};
+    for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> locker(shard.mtx);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.invalidations += shard.invalidations;
+        stats.entries += shard.lru.size();
+        stats.bytes += shard.bytes;
+    }
+    stats.cold = cold_;
+    stats.prefetched = prefetched_;
+    stats.prefetch_us = prefetch_us_;
+    return stats;
+}
+
+bool FileCache::Resident(const char* addr, size_t len) {
+    if (len == 0) return true;
+    static const uintptr_t kPage = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)addr & ~(kPage - 1);
+    size_t pages = ((uintptr_t)addr + len - begin + kPage - 1) / kPage;
+    thread_local std::vector<unsigned char> vec;
+    vec.resize(pages);
+    // 无法判断时按在内存中处理，走原来的路径
+    if (mincore((void*)begin, pages * kPage, vec.data()) < 0) return true;
+    for (unsigned char v : vec) {
+        if (!(v & 1)) return false;
+    }
+    return true;
+}
+
+void FileCache::Prefetch(const char* addr, size_t len) {
+    static const uintptr_t kPage = sysconf(_SC_PAGESIZE);
+    auto begin = std::chrono::steady_clock::now();
+    uintptr_t start = (uintptr_t)addr & ~(kPage - 1);
+    size_t span = (uintptr_t)addr + len - start;
+    // MADV_POPULATE_READ同步读入并建立页表，文件被截断时返回错误而不是触发SIGBUS；
+    // 内核不支持时退回为只发起预读的MADV_WILLNEED
+    if (madvise((void*)start, span, MADV_POPULATE_READ) < 0 && errno == EINVAL) {
+        madvise((void*)start, span, MADV_WILLNEED);
+    }
+    uint64_t us =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+    cold_++;
+    prefetched_ += len;
+    prefetch_us_ += us;
+    LOG_DEBUG("prefetch %zu bytes in %llu us", len, (unsigned long long)us);
+}
+
+bool FileCache::Watch_(std::string_view root, std::string_view path) {
+    if (inotify_fd_ < 0) return false;
+    // 从所在目录逐级向上直到root：上级目录的改名、删除会使其下所有条目失效，
+    // 不存在的目录由存在的上级目录在其被创建时通知，已监视的目录的上级目录也已监视
+    std::lock_guard<std::mutex> locker(watch_mtx_);
+    bool watched = false;
+    size_t end = path.rfind('/');
+    while (true) {
+        std::string dir(path.substr(0, end));
+        if (dir.empty()) dir = "/";
+        if (watched_.count(dir)) return true;
+        int wd = inotify_add_watch(inotify_fd_, dir.c_str(), kWatchMask);
+        if (wd >= 0) {
+            watch_dirs_[wd] = dir;
+            watched_.insert(std::move(dir));
+            watched = true;
+        } else if (errno != ENOENT && errno != ENOTDIR) {
+            LOG_WARN("inotify_add_watch %s error: %d", dir.c_str(), errno);
+            return false;
+        }
+        if (end <= root.size() || end == 0) return watched;
+        end = path.rfind('/', end - 1);
+    }
+}
+
+void FileCache::Invalidate_(std::string_view path, bool subtree) {
+    if (!subtree) {
+        Shard& shard = ShardOf_(path);
+        std::lock_guard<std::mutex> locker(shard.mtx);
+        auto it = shard.index.find(path);
+        if (it != shard.index.end()) {
+            Erase_(shard, it->second);
+            ++shard.invalidations;
+        }
+        return;
+    }
+    // 目录变化，其下的条目可能分布在所有分片中
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> locker(shard.mtx);
+        for (auto it = shard.lru.begin(); it != shard.lru.end();) {
+            std::string_view key = (*it)->path;
+            auto cur = it++;
+            if (key.compare(0, path.size(), path) == 0 && (key.size() == path.size() || key[path.size()] == '/')) {
+                Erase_(shard, cur);
+                ++shard.invalidations;
+            }
+        }
+    }
+}
+
+void FileCache::WatchLoop_() {
+    alignas(struct inotify_event) char buf[16384];
+    struct pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+        if (len <= 0) continue;
+
+        epoch_.fetch_add(1);  // 先更新批次再使条目失效，见Get
+        for (char* p = buf; p < buf + len;) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {  // 事件丢失，全部失效
+                Clear();
+                continue;
+            }
+            std::string dir;
+            {
+                std::lock_guard<std::mutex> locker(watch_mtx_);
+                auto it = watch_dirs_.find(event->wd);
+                if (it == watch_dirs_.end()) continue;
+                dir = it->second;
+                if (event->mask & IN_IGNORED) {  // 目录已删除，监视被移除
+                    watched_.erase(dir);
+                    watch_dirs_.erase(it);
+                }
+            }
+            if (event->len > 0) {
+                if (dir.back() != '/') dir += '/';
+                dir += event->name;
+                Invalidate_(dir, event->mask & IN_ISDIR);
+            } else {
+                Invalidate_(dir, true);  // 目录自身被删除、移动或改权限
+            }
+        }
+    }
+}
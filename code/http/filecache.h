@@ -0,0 +1,171 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <errno.h>
+#include <fcntl.h>         // open
+#include <poll.h>          // poll
+#include <stdint.h>
+#include <stdio.h>         // snprintf
+#include <sys/eventfd.h>   // eventfd
+#include <sys/inotify.h>   // inotify
+#include <sys/mman.h>      // mmap, munmap, memfd_create
+#include <sys/stat.h>      // fstat
+#include <unistd.h>        // close, pread
+#include <zlib.h>          // deflate
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../log/log.h"
+#include "../pool/threadpool.h"
+#include "httpparser.h"
+
+class StaticBundle;
+
+// 缓存的资源文件，创建后只读，由shared_ptr引用计数，最后一个引用释放时释放内存、munmap或关闭fd
+struct CachedFile {
+    CachedFile() : err(0), data(nullptr), size(0), mapped(false), fd(-1), probe(nullptr), st{}, vary(false) {}
+    ~CachedFile();
+
+    std::string path;  // 规范化后的完整路径
+    int err;           // 0表示可以读取；否则为打开失败的errno，目录等不是普通文件为EISDIR，其他用户不可读为EACCES
+    char* data;        // 文件内容，小文件复制到堆上，中等大小的文件为mmap映射；空文件与大文件为nullptr
+    size_t size;       // 文件大小
+    bool mapped;       // data是否为mmap映射
+    int fd;            // 大文件不读入内存，保持打开，由sendfile按偏移发送；否则为-1
+    char* probe;       // 大文件的只读映射，不用于发送，只用于检查与预读页缓存；否则为nullptr
+    struct stat st;    // 文件信息
+    std::string etag;           // 强ETag，由inode、大小与修改时间生成，gzip版本加"-gz"后缀
+    std::string last_modified;  // Last-Modified，HTTP日期格式
+    // 预先生成的响应头行，响应时直接复制
+    std::string type_header;       // Content-type
+    std::string encoding_header;   // Content-Encoding与Vary，没有压缩版本时为空
+    std::string validator_header;  // ETag、Last-Modified与Cache-Control
+    // data位于其他对象(如打包文件的映射)中时持有该对象，不单独释放data
+    std::shared_ptr<const void> storage;
+    bool vary;  // 有或将要生成gzip版本，响应带Vary: Accept-Encoding
+    // gzip压缩版本，与原文件一样在内存中或由sendfile发送；不可压缩或压缩无收益时为空。
+    // 较大的文件放入缓存后才由磁盘I/O线程压缩，完成前为空(发送原文件)，完成后原子地设置，读取时用Gzip()
+    std::shared_ptr<const CachedFile> gzip;
+
+    std::shared_ptr<const CachedFile> Gzip() const { return std::atomic_load(&gzip); }
+
+private:
+    CachedFile(const CachedFile&) = delete;
+    CachedFile& operator=(const CachedFile&) = delete;
+};
+
+// 进程内共享的静态文件缓存：以规范化后的路径为键，缓存文件内容与打开失败的结果(404/403)，同一文件只打开一次。
+// 小文件复制到堆上，中等大小的文件mmap，大文件只保留打开的fd由sendfile发送，不占用映射与页表。
+// 文本、脚本、字体等可压缩的文件以最高压缩级别生成gzip版本，与原文件一起缓存与失效：
+// 小文件在加载时压缩，较大的文件由放入缓存的线程交给磁盘I/O线程压缩，同一条目只压缩一次，不阻塞事件循环。
+// 缓存按路径散列分为多个分片，各分片有自己的锁、LRU链表与字节数上限；
+// 后台线程通过inotify监视已缓存文件所在的目录及其上级目录，文件被修改、删除、改名或改权限时使对应条目失效
+class FileCache {
+public:
+    struct Stats {
+        uint64_t hits;           // 命中(包括缓存的失败结果)
+        uint64_t misses;         // 未命中，需要打开文件
+        uint64_t evictions;      // 因超过上限被淘汰的条目
+        uint64_t invalidations;  // 因文件变化失效的条目
+        size_t entries;          // 当前条目数
+        size_t bytes;            // 当前占用的字节数
+        uint64_t cold;           // 发送时文件内容不在页缓存中、交给磁盘I/O线程预读的次数
+        uint64_t prefetched;     // 预读的字节数
+        uint64_t prefetch_us;    // 预读的总耗时(微秒)
+    };
+
+    static FileCache& Instance();  // 单例模式
+
+    // 返回root目录下path对应的文件，path为请求路径，规范化后不会超出root。
+    // 不适合缓存的文件(无法监视)也返回结果，只是不放入缓存，引用释放时即释放
+    std::shared_ptr<const CachedFile> Get(const std::string& root, std::string_view path);
+    void Clear();  // 清空缓存，已被引用的文件在引用释放后才解除映射
+    Stats GetStats() const;
+    // 改为从打包文件提供所有静态文件：之后Get只在映射的打包文件中查找，不访问文件系统。
+    // 在开始处理请求前调用，打开失败时返回false，仍从文件系统读取
+    bool UseBundle(const std::string& path);
+    static bool Compressible(std::string_view path);  // 按后缀判断是否值得压缩
+    // [addr, addr + len)所在的页是否都在内存中。对没有写权限的文件，内核只报告已映射到本进程的页，
+    // 未映射过的页按不在内存中处理，预读一次后即可走原来的路径
+    static bool Resident(const char* addr, size_t len);
+    // 把文件映射中的[addr, addr + len)读入页缓存并建立页表，会阻塞，在磁盘I/O线程中调用
+    void Prefetch(const char* addr, size_t len);
+    // 压缩较大文件的线程池，为空时超过inline_compress_size_的文件不压缩；在开始处理请求前设置，停止前清除
+    void SetCompressPool(ThreadPool* pool) { compress_pool_ = pool; }
+
+    static size_t max_bytes_;           // 缓存占用的总字节数上限，平均分给各分片
+    static size_t small_file_size_;     // 不超过该大小的文件复制到堆上，不占用单独的映射
+    static size_t sendfile_threshold_;  // 超过该大小的文件不映射，由sendfile发送
+    static bool gzip_;                  // 是否为可压缩的文件生成gzip版本
+    static size_t max_compress_size_;   // 超过该大小的文件不压缩
+    static size_t inline_compress_size_;  // 不超过该大小的文件在加载时压缩，更大的文件交给压缩线程池
+    static bool check_residency_;       // 发送映射的文件内容前是否检查页缓存，不在时先由磁盘I/O线程预读
+    static size_t prefetch_size_;       // 每次预读的最大字节数
+
+private:
+    FileCache();
+    ~FileCache();
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    struct Shard {
+        typedef std::list<std::shared_ptr<const CachedFile>> LruList;
+        mutable std::mutex mtx;
+        LruList lru;  // 表头为最近使用的条目
+        std::unordered_map<std::string_view, LruList::iterator> index;  // 键指向条目自身的path
+        size_t bytes = 0;
+        uint64_t hits = 0, misses = 0, evictions = 0, invalidations = 0;
+    };
+
+    // 将root与path拼接为规范化的完整路径："."与重复的'/'被去掉，".."不会超出root；base为root部分的长度
+    static bool Normalize_(const std::string& root, std::string_view path, std::string& out, size_t& base);
+    // 打开并载入文件；compress为false时不生成gzip版本，不放入缓存的结果每次请求都会重新载入，不能每次都压缩
+    static std::shared_ptr<CachedFile> Load_(const std::string& path, bool compress);
+    // 生成gzip版本，压缩后不小于原大小的7/8时返回空
+    static std::shared_ptr<CachedFile> Compress_(const CachedFile& file);
+    static size_t Cost_(const CachedFile& file);
+    // 在压缩线程池中为已放入缓存的file生成gzip版本，完成时条目仍在缓存中才设置并计入分片的字节数
+    void CompressLater_(const std::shared_ptr<CachedFile>& file);
+
+    Shard& ShardOf_(std::string_view path);
+    bool Insert_(Shard& shard, const std::shared_ptr<const CachedFile>& file);  // 调用时持有分片锁
+    void Erase_(Shard& shard, Shard::LruList::iterator it);                     // 调用时持有分片锁
+    // 监视path所在目录及其到root的各级上级目录，不存在的目录跳过，失败时返回false
+    bool Watch_(std::string_view root, std::string_view path);
+    void Invalidate_(std::string_view path, bool subtree);  // 使path(subtree时包括其下所有路径)失效
+    void WatchLoop_();
+
+    static const size_t kShards = 16;
+    static const size_t kEntryOverhead = 128;  // 每个条目除文件内容与路径外的估计开销
+    static const size_t kFdCost = 64 * 1024;   // 保持打开的fd按该字节数计入上限，限制缓存占用的fd数量
+    static const size_t kMinCompressSize = 256;  // 小于该大小的文件压缩无收益
+    static const std::unordered_set<std::string_view> COMPRESS_SUFFIX;  // 可压缩文件的后缀
+
+    Shard shards_[kShards];
+
+    int inotify_fd_;
+    int stop_fd_;                     // 通知监视线程退出的eventfd
+    std::atomic<uint64_t> epoch_;     // 每批文件变化事件加1，加载期间有变化的结果不放入缓存
+    std::atomic<uint64_t> cold_;      // 预读次数
+    std::atomic<uint64_t> prefetched_;
+    std::atomic<uint64_t> prefetch_us_;
+    std::atomic<ThreadPool*> compress_pool_;
+    std::mutex watch_mtx_;
+    std::unordered_map<int, std::string> watch_dirs_;  // inotify watch描述符与目录
+    std::unordered_set<std::string> watched_;          // 已监视的目录
+    std::thread watch_thread_;
+
+    std::unique_ptr<StaticBundle> bundle_;  // 打包文件，为空时从文件系统读取
+};
+
+#endif
@@ -0,0 +1,347 @@
+#include "hpack.h"
+
+namespace {
+
+const std::pair<std::string_view, std::string_view> STATIC_TABLE[HpackTable::kStaticCount] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+// Huffman编码(RFC 7541附录B)中每个符号的码长，256为EOS。
+// 该编码是范式Huffman编码：按(码长, 符号)排序后依次分配码字，因此由码长即可还原码表
+const uint8_t HUFFMAN_LEN[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 30, 28, 28, 28,
+    28, 28, 28, 28, 28, 28, 6,  10, 10, 12, 13, 6,  8,  11, 10, 10, 8,  11, 8,  6,  6,  6,  5,  5,  5,  6,
+    6,  6,  6,  6,  6,  6,  7,  8,  15, 6,  12, 10, 13, 6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,
+    7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8,  13, 19, 13, 14, 6,  15, 5,  6,  5,  6,  5,  6,  6,
+    6,  5,  7,  7,  6,  6,  6,  5,  6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7,  15, 11, 14, 13, 28, 20, 22,
+    20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23, 24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23,
+    22, 23, 23, 24, 22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23, 21, 21, 22, 21, 23, 22,
+    23, 23, 20, 22, 22, 22, 23, 22, 22, 23, 26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27, 20, 24, 20, 21, 22, 21, 21, 23, 22, 22,
+    25, 25, 24, 24, 26, 23, 26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26, 30,
+};
+
+const int kEos = 256;
+const int kMaxCodeLen = 30;
+
+// 由码长生成的范式码表
+struct HuffmanCode {
+    uint32_t code[257];               // 每个符号的码字
+    uint32_t first[kMaxCodeLen + 2];  // 每个码长的第一个码字
+    int count[kMaxCodeLen + 2];       // 每个码长的符号数
+    int offset[kMaxCodeLen + 2];      // 每个码长的第一个符号在symbol中的位置
+    uint16_t symbol[257];             // 按(码长, 符号)排序的符号
+
+    HuffmanCode() {
+        for (int len = 0; len <= kMaxCodeLen + 1; ++len) count[len] = 0;
+        for (int sym = 0; sym <= kEos; ++sym) ++count[HUFFMAN_LEN[sym]];
+        uint32_t next = 0;
+        int pos = 0;
+        for (int len = 1; len <= kMaxCodeLen; ++len) {
+            first[len] = next;
+            offset[len] = pos;
+            for (int sym = 0; sym <= kEos; ++sym) {
+                if (HUFFMAN_LEN[sym] != len) continue;
+                code[sym] = next++;
+                symbol[pos++] = sym;
+            }
+            next <<= 1;
+        }
+    }
+};
+
+const HuffmanCode HUFFMAN;
+
+size_t HuffmanLength(std::string_view str) {
+    size_t bits = 0;
+    for (unsigned char ch : str) bits += HUFFMAN_LEN[ch];
+    return (bits + 7) / 8;
+}
+
+void HuffmanEncode(std::string_view str, std::string& out) {
+    uint64_t acc = 0;
+    int bits = 0;
+    for (unsigned char ch : str) {
+        acc = (acc << HUFFMAN_LEN[ch]) | HUFFMAN.code[ch];
+        bits += HUFFMAN_LEN[ch];
+        while (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>(acc >> bits));
+        }
+    }
+    if (bits > 0) {  // 用EOS的高位(全1)填充
+        out.push_back(static_cast<char>((acc << (8 - bits)) | (0xff >> bits)));
+    }
+}
+
+}  // namespace
+
+void HpackTable::Add(std::string_view name, std::string_view value) {
+    size_t size = EntrySize_(name, value);
+    if (size > max_size_) {  // 比整张表还大的条目会清空动态表
+        Evict_(0);
+        return;
+    }
+    Evict_(max_size_ - size);
+    entries_.emplace_front(std::string(name), std::string(value));
+    size_ += size;
+}
+
+void HpackTable::SetMaxSize(size_t max_size) {
+    max_size_ = max_size;
+    Evict_(max_size);
+}
+
+void HpackTable::Evict_(size_t max_size) {
+    while (size_ > max_size && !entries_.empty()) {
+        size_ -= EntrySize_(entries_.back().first, entries_.back().second);
+        entries_.pop_back();
+    }
+}
+
+bool HpackTable::Get(size_t index, std::string_view& name, std::string_view& value) const {
+    if (index == 0) return false;
+    if (index <= kStaticCount) {
+        name = STATIC_TABLE[index - 1].first;
+        value = STATIC_TABLE[index - 1].second;
+        return true;
+    }
+    index -= kStaticCount + 1;
+    if (index >= entries_.size()) return false;
+    name = entries_[index].first;
+    value = entries_[index].second;
+    return true;
+}
+
+size_t HpackTable::Find(std::string_view name, std::string_view value, size_t& name_index) const {
+    name_index = 0;
+    for (size_t i = 0; i < kStaticCount; ++i) {
+        if (STATIC_TABLE[i].first != name) continue;
+        if (STATIC_TABLE[i].second == value) return i + 1;
+        if (!name_index) name_index = i + 1;
+    }
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (entries_[i].first != name) continue;
+        if (entries_[i].second == value) return kStaticCount + 1 + i;
+        if (!name_index) name_index = kStaticCount + 1 + i;
+    }
+    return 0;
+}
+
+bool HpackDecoder::DecodeInteger(const uint8_t*& pos, const uint8_t* end, int prefix, uint64_t& value) {
+    if (pos >= end) return false;
+    uint8_t mask = (1 << prefix) - 1;
+    value = *pos++ & mask;
+    if (value < mask) return true;
+    for (int shift = 0; pos < end; shift += 7) {
+        if (shift > 28) return false;  // 超过32位，不是合法的索引或长度
+        uint8_t byte = *pos++;
+        value += static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool HpackDecoder::DecodeString(const uint8_t*& pos, const uint8_t* end, std::string& str) {
+    if (pos >= end) return false;
+    bool huffman = *pos & 0x80;
+    uint64_t len = 0;
+    if (!DecodeInteger(pos, end, 7, len) || len > static_cast<uint64_t>(end - pos)) return false;
+    const uint8_t* data = pos;
+    pos += len;
+    if (huffman) return HuffmanDecode(data, len, str);
+    str.assign(reinterpret_cast<const char*>(data), len);
+    return true;
+}
+
+bool HpackDecoder::HuffmanDecode(const uint8_t* data, size_t len, std::string& str) {
+    str.clear();
+    uint32_t code = 0;
+    int code_len = 0;
+    for (size_t i = 0; i < len; ++i) {
+        for (int bit = 7; bit >= 0; --bit) {
+            code = (code << 1) | ((data[i] >> bit) & 1);
+            ++code_len;
+            // 范式编码：同一码长的码字连续，减去该码长的第一个码字即为序号
+            if (code - HUFFMAN.first[code_len] < static_cast<uint32_t>(HUFFMAN.count[code_len])) {
+                int sym = HUFFMAN.symbol[HUFFMAN.offset[code_len] + code - HUFFMAN.first[code_len]];
+                if (sym == kEos) return false;  // 不允许出现EOS
+                str.push_back(static_cast<char>(sym));
+                code = 0;
+                code_len = 0;
+            } else if (code_len >= kMaxCodeLen) {
+                return false;
+            }
+        }
+    }
+    // 结尾的填充必须是EOS的高位(全1)且不超过7位
+    return code_len < 8 && code == (1u << code_len) - 1;
+}
+
+bool HpackDecoder::Decode(const uint8_t* data, size_t len, HeaderList& headers, size_t max_list_size,
+                          bool& too_large) {
+    const uint8_t* pos = data;
+    const uint8_t* end = data + len;
+    bool field_seen = false;
+    size_t list_size = 0;
+    too_large = false;
+    // 超过上限后不再保存字段，索引字段只查表不复制
+    auto add = [&](std::string_view name, std::string_view value, std::string* name_str, std::string* value_str) {
+        if (too_large) return;
+        list_size += name.size() + value.size() + kEntryOverhead;
+        if (list_size > max_list_size) {
+            too_large = true;
+            HeaderList().swap(headers);
+        } else if (name_str) {
+            headers.emplace_back(std::move(*name_str), std::move(*value_str));
+        } else {
+            headers.emplace_back(std::string(name), std::string(value));
+        }
+    };
+    while (pos < end) {
+        uint8_t byte = *pos;
+        uint64_t index = 0;
+        std::string_view name, value;
+        if (byte & 0x80) {  // 索引
+            if (!DecodeInteger(pos, end, 7, index) || !table_.Get(index, name, value)) return false;
+            add(name, value, nullptr, nullptr);
+        } else if ((byte & 0xe0) == 0x20) {  // 动态表大小更新，只能出现在头部块开头
+            if (field_seen || !DecodeInteger(pos, end, 5, index) || index > max_table_size_) return false;
+            table_.SetMaxSize(index);
+            continue;
+        } else {  // 字面量：01为加入动态表，0000为不加入，0001为永不加入
+            bool indexing = byte & 0x40;
+            int prefix = indexing ? 6 : 4;
+            if (!DecodeInteger(pos, end, prefix, index)) return false;
+            std::string name_str, value_str;
+            if (index) {
+                if (!table_.Get(index, name, value)) return false;
+                name_str.assign(name.data(), name.size());
+            } else if (!DecodeString(pos, end, name_str)) {
+                return false;
+            }
+            if (!DecodeString(pos, end, value_str)) return false;
+            if (indexing) table_.Add(name_str, value_str);
+            add(name_str, value_str, &name_str, &value_str);
+        }
+        field_seen = true;
+    }
+    return true;
+}
+
+void HpackEncoder::SetMaxTableSize(size_t max_size) {
+    if (max_size > HpackTable::kDefaultSize) max_size = HpackTable::kDefaultSize;  // 编码器最多使用4096字节
+    if (max_size == table_.MaxSize() && pending_size_ < 0) return;
+    table_.SetMaxSize(max_size);
+    pending_size_ = max_size;
+}
+
+void HpackEncoder::Begin(std::string& out) {
+    if (pending_size_ >= 0) {
+        EncodeInteger(pending_size_, 5, 0x20, out);
+        pending_size_ = -1;
+    }
+}
+
+void HpackEncoder::Encode(std::string_view name, std::string_view value, bool indexing, std::string& out) {
+    size_t name_index = 0;
+    size_t index = table_.Find(name, value, name_index);
+    if (index) {
+        EncodeInteger(index, 7, 0x80, out);
+        return;
+    }
+    if (indexing) {
+        EncodeInteger(name_index, 6, 0x40, out);
+    } else {
+        EncodeInteger(name_index, 4, 0x00, out);
+    }
+    if (!name_index) EncodeString(name, out);
+    EncodeString(value, out);
+    if (indexing) table_.Add(name, value);
+}
+
+void HpackEncoder::EncodeInteger(uint64_t value, int prefix, uint8_t flags, std::string& out) {
+    uint8_t mask = (1 << prefix) - 1;
+    if (value < mask) {
+        out.push_back(static_cast<char>(flags | value));
+        return;
+    }
+    out.push_back(static_cast<char>(flags | mask));
+    value -= mask;
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void HpackEncoder::EncodeString(std::string_view str, std::string& out) {
+    size_t huffman_len = HuffmanLength(str);
+    if (huffman_len < str.size()) {
+        EncodeInteger(huffman_len, 7, 0x80, out);
+        HuffmanEncode(str, out);
+    } else {
+        EncodeInteger(str.size(), 7, 0x00, out);
+        out.append(str.data(), str.size());
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// HPACK头部压缩(RFC 7541)，HTTP/2的HEADERS帧使用
+
+// 动态表，新条目插入表头，超过容量时从表尾淘汰
+class HpackTable {
+public:
+    explicit HpackTable(size_t max_size = kDefaultSize) : size_(0), max_size_(max_size) {}
+
+    void Add(std::string_view name, std::string_view value);
+    void SetMaxSize(size_t max_size);
+    size_t MaxSize() const { return max_size_; }
+    size_t Size() const { return size_; }  // 按RFC 7541计算的大小，每个条目多计32字节，接近实际占用的内存
+
+    // 按完整索引(静态表之后接动态表，从1开始)查找，越界返回false
+    bool Get(size_t index, std::string_view& name, std::string_view& value) const;
+    // 查找完全匹配的条目，找不到时name_index为名字匹配的条目(没有为0)，返回完全匹配的索引(没有为0)
+    size_t Find(std::string_view name, std::string_view value, size_t& name_index) const;
+
+    static const size_t kDefaultSize = 4096;  // SETTINGS_HEADER_TABLE_SIZE的默认值
+    static const size_t kStaticCount = 61;    // 静态表条目数
+
+private:
+    void Evict_(size_t max_size);
+    // 每个条目额外计入32字节
+    static size_t EntrySize_(std::string_view name, std::string_view value) {
+        return name.size() + value.size() + 32;
+    }
+
+    std::deque<std::pair<std::string, std::string>> entries_;
+    size_t size_;      // 当前大小
+    size_t max_size_;  // 最大大小
+};
+
+// 解码器，解码对端发送的头部块
+class HpackDecoder {
+public:
+    typedef std::vector<std::pair<std::string, std::string>> HeaderList;
+
+    // 解码一个完整的头部块，出错返回false(连接级COMPRESSION_ERROR)。
+    // 头部列表按RFC 7541的大小(名称+值+32)累计超过max_list_size时，其余字段仍解码以保持动态表一致，
+    // 但不再保存，headers被清空，too_large置为true；避免少量索引引用展开成大量字符串
+    bool Decode(const uint8_t* data, size_t len, HeaderList& headers, size_t max_list_size, bool& too_large);
+    // 本端通过SETTINGS_HEADER_TABLE_SIZE允许的最大动态表大小
+    void SetMaxTableSize(size_t max_size) { max_table_size_ = max_size; }
+    size_t TableSize() const { return table_.Size(); }
+
+    static bool DecodeInteger(const uint8_t*& pos, const uint8_t* end, int prefix, uint64_t& value);
+    static bool DecodeString(const uint8_t*& pos, const uint8_t* end, std::string& str);
+    static bool HuffmanDecode(const uint8_t* data, size_t len, std::string& str);
+
+    HpackDecoder() : max_table_size_(HpackTable::kDefaultSize) {}
+    static const size_t kEntryOverhead = 32;  // 每个字段在大小计算中的额外开销
+
+private:
+    HpackTable table_;
+    size_t max_table_size_;
+};
+
+// 编码器，响应头中重复出现的字段(如content-type)加入动态表，之后的响应只需发送索引
+class HpackEncoder {
+public:
+    // 对端通过SETTINGS_HEADER_TABLE_SIZE允许的最大动态表大小，在下一个头部块开头通知对端
+    void SetMaxTableSize(size_t max_size);
+    // 开始一个新的头部块
+    void Begin(std::string& out);
+    // 编码一个头部字段，indexing为true时加入动态表
+    void Encode(std::string_view name, std::string_view value, bool indexing, std::string& out);
+
+    size_t TableSize() const { return table_.Size(); }
+
+    static void EncodeInteger(uint64_t value, int prefix, uint8_t flags, std::string& out);
+    static void EncodeString(std::string_view str, std::string& out);
+
+    HpackEncoder() : pending_size_(-1) {}
+
+private:
+    HpackTable table_;
+    long pending_size_;  // 待通知对端的动态表大小，-1表示没有
+};
+
+#endif
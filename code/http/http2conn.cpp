@@ -0,0 +1,635 @@
+#include "http2conn.h"
+
+namespace {
+
+// 客户端连接前言
+const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t kPrefaceLen = sizeof(PREFACE) - 1;
+const size_t kFrameHeaderLen = 9;
+const int64_t kMaxWindow = 0x7fffffff;
+const uint32_t kDefaultWindow = 65535;
+
+uint32_t ReadUint32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+void WriteUint32(uint32_t value, char* p) {
+    p[0] = (char)(value >> 24);
+    p[1] = (char)(value >> 16);
+    p[2] = (char)(value >> 8);
+    p[3] = (char)value;
+}
+
+// HTTP2-Settings使用不带填充的base64url编码
+bool Base64UrlDecode(std::string_view in, std::string& out) {
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char ch : in) {
+        int v;
+        if (ch >= 'A' && ch <= 'Z') v = ch - 'A';
+        else if (ch >= 'a' && ch <= 'z') v = ch - 'a' + 26;
+        else if (ch >= '0' && ch <= '9') v = ch - '0' + 52;
+        else if (ch == '-' || ch == '+') v = 62;
+        else if (ch == '_' || ch == '/') v = 63;
+        else if (ch == '=') break;
+        else return false;
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    return true;
+}
+
+bool ContainsToken(std::string_view list, std::string_view token) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+        if (HttpParser::EqualsNoCase(item, token)) return true;
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+// 字符串在堆上分配的字节数，短字符串存放在对象内部
+inline size_t HeapBytes(const std::string& str) {
+    static const size_t kInline = std::string().capacity();
+    return str.capacity() > kInline ? str.capacity() + 1 : 0;
+}
+
+}  // namespace
+
+Http2Conn::Http2Conn(const char* src_dir, const Router* router)
+    : src_dir_(src_dir),
+      router_(router),
+      preface_left_(0),
+      goaway_sent_(false),
+      goaway_received_(false),
+      last_stream_id_(0),
+      conn_send_window_(kDefaultWindow),
+      peer_initial_window_(kDefaultWindow),
+      peer_max_frame_(kMaxFrameSize),
+      continuation_stream_(0),
+      continuation_flags_(0) {}
+
+size_t Http2Conn::MemoryBytes() const {
+    size_t bytes = sizeof(Http2Conn) + HeapBytes(header_block_) + ready_.size() * sizeof(uint32_t) +
+                   decoder_.TableSize() + encoder_.TableSize();
+    for (auto& [id, stream] : streams_) {
+        // 散列表的节点：键值对与下一个节点的指针
+        bytes += sizeof(std::pair<const uint32_t, Stream>) + sizeof(void*) + HeapBytes(stream.body);
+        bytes += stream.headers.capacity() * sizeof(HpackDecoder::HeaderList::value_type);
+        for (auto& [name, value] : stream.headers) bytes += HeapBytes(name) + HeapBytes(value);
+        for (const Piece& piece : stream.pieces) bytes += sizeof(Piece) + HeapBytes(piece.data);
+    }
+    return bytes + streams_.bucket_count() * sizeof(void*);
+}
+
+bool Http2Conn::IsUpgrade(const HttpRequest& request) {
+    // 带请求体的请求不升级，请求体按HTTP/1.1读取后升级会使流1的状态变得复杂
+    std::string_view length = request.Header(HttpRequest::CONTENT_LENGTH);
+    return HttpParser::EqualsNoCase(request.Header("Upgrade"), "h2c") && !request.Header("HTTP2-Settings").empty() &&
+           ContainsToken(request.Header(HttpRequest::CONNECTION), "upgrade") &&
+           request.Header(HttpRequest::TRANSFER_ENCODING).empty() && (length.empty() || length == "0");
+}
+
+void Http2Conn::StartPriorKnowledge(OutQueue& out) {
+    preface_left_ = kPrefaceLen - (sizeof("PRI * HTTP/2.0\r\n\r\n") - 1);
+    SendSettings_(out);
+}
+
+bool Http2Conn::StartUpgrade(HttpRequest& request, OutQueue& out) {
+    std::string settings;
+    if (!Base64UrlDecode(request.Header("HTTP2-Settings"), settings) || settings.size() % 6 != 0 ||
+        ApplySettings_(reinterpret_cast<const uint8_t*>(settings.data()), settings.size()) != NO_ERROR) {
+        LOG_WARN("Invalid HTTP2-Settings, upgrade ignored");
+        return false;
+    }
+    out.Append(std::string("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n"));
+    preface_left_ = kPrefaceLen;  // 升级后客户端发送完整的连接前言
+    SendSettings_(out);
+
+    // 升级前的请求是流1，对端已结束发送(half-closed remote)
+    last_stream_id_ = 1;
+    Stream& stream = NewStream_(1);
+    stream.end_stream = true;
+    stream.head = request.Method() == "HEAD";
+    Respond_(stream, request.Path(), 200, out, &request);
+    return true;
+}
+
+bool Http2Conn::Process(Buffer& in, OutQueue& out) {
+    if (preface_left_ > 0) {
+        size_t n = std::min(in.ReadableBytes(), preface_left_);
+        if (memcmp(in.Peek(), PREFACE + kPrefaceLen - preface_left_, n) != 0) {
+            LOG_WARN("Invalid HTTP/2 connection preface");
+            in.RetrieveAll();
+            return GoAway_(PROTOCOL_ERROR, out);
+        }
+        in.Retrieve(n);
+        preface_left_ -= n;
+    }
+
+    // 依次处理缓冲区中完整的帧
+    while (preface_left_ == 0 && in.ReadableBytes() >= kFrameHeaderLen) {
+        const uint8_t* header = reinterpret_cast<const uint8_t*>(in.Peek());
+        uint32_t len = (uint32_t)header[0] << 16 | (uint32_t)header[1] << 8 | header[2];
+        if (len > kMaxFrameSize) {
+            in.RetrieveAll();
+            return GoAway_(FRAME_SIZE_ERROR, out);
+        }
+        if (in.ReadableBytes() < kFrameHeaderLen + len) break;
+
+        uint32_t stream_id = ReadUint32(header + 5) & 0x7fffffff;
+        bool ok = OnFrame_(header[3], header[4], stream_id, header + kFrameHeaderLen, len, out);
+        in.Retrieve(kFrameHeaderLen + len);
+        if (!ok) {
+            in.RetrieveAll();
+            return false;
+        }
+    }
+    Flush_(out);
+    return true;
+}
+
+bool Http2Conn::OnFrame_(uint8_t type, uint8_t flags, uint32_t stream_id, const uint8_t* payload, uint32_t len,
+                         OutQueue& out) {
+    // 头部块必须由连续的CONTINUATION帧完成，中间不能插入其它帧
+    if (continuation_stream_ != 0 && (type != CONTINUATION || stream_id != continuation_stream_)) {
+        return GoAway_(PROTOCOL_ERROR, out);
+    }
+
+    switch (type) {
+        case DATA:
+            return OnData_(flags, stream_id, payload, len, out);
+        case HEADERS:
+            return OnHeaders_(flags, stream_id, payload, len, out);
+        case CONTINUATION:
+            if (continuation_stream_ == 0) return GoAway_(PROTOCOL_ERROR, out);
+            if (header_block_.size() + len > kMaxHeaderBlock) return GoAway_(PROTOCOL_ERROR, out);
+            header_block_.append(reinterpret_cast<const char*>(payload), len);
+            continuation_flags_ |= flags & FLAG_END_HEADERS;
+            if (flags & FLAG_END_HEADERS) return OnHeaderBlock_(out);
+            return true;
+        case PRIORITY:  // 不按优先级调度，各流轮流发送
+            if (stream_id == 0) return GoAway_(PROTOCOL_ERROR, out);
+            if (len != 5) ResetStream_(stream_id, FRAME_SIZE_ERROR, out);
+            return true;
+        case RST_STREAM:
+            if (stream_id == 0 || stream_id > last_stream_id_) return GoAway_(PROTOCOL_ERROR, out);
+            if (len != 4) return GoAway_(FRAME_SIZE_ERROR, out);
+            CloseStream_(stream_id);
+            return true;
+        case SETTINGS:
+            return OnSettings_(flags, payload, len, out);
+        case PING:
+            if (stream_id != 0) return GoAway_(PROTOCOL_ERROR, out);
+            if (len != 8) return GoAway_(FRAME_SIZE_ERROR, out);
+            if (!(flags & FLAG_ACK)) {
+                WriteFrameHeader_(out, 8, PING, FLAG_ACK, 0);
+                out.Append(reinterpret_cast<const char*>(payload), 8);
+            }
+            return true;
+        case GOAWAY:
+            if (stream_id != 0) return GoAway_(PROTOCOL_ERROR, out);
+            if (len < 8) return GoAway_(FRAME_SIZE_ERROR, out);
+            LOG_DEBUG("GOAWAY received, error code:%u", ReadUint32(payload + 4));
+            goaway_received_ = true;
+            return true;
+        case WINDOW_UPDATE:
+            return OnWindowUpdate_(stream_id, payload, len, out);
+        case PUSH_PROMISE:  // 客户端不能推送
+            return GoAway_(PROTOCOL_ERROR, out);
+        default:  // 忽略未知类型的帧
+            return true;
+    }
+}
+
+bool Http2Conn::OnData_(uint8_t flags, uint32_t stream_id, const uint8_t* payload, uint32_t len, OutQueue& out) {
+    if (stream_id == 0 || stream_id > last_stream_id_) return GoAway_(PROTOCOL_ERROR, out);
+
+    const uint8_t* data = payload;
+    uint32_t data_len = len;
+    if (flags & FLAG_PADDED) {
+        if (len < 1 || payload[0] >= len) return GoAway_(PROTOCOL_ERROR, out);
+        data = payload + 1;
+        data_len = len - 1 - payload[0];
+    }
+    // 请求体立即消费(或丢弃)，整个帧长度(含填充)立刻归还给对端的连接窗口
+    if (len > 0) WriteWindowUpdate_(out, 0, len);
+
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end() || it->second.end_stream) {
+        ResetStream_(stream_id, STREAM_CLOSED, out);
+        return true;
+    }
+    Stream& stream = it->second;
+    if (!stream.too_large && !stream.header_too_large) {
+        if (stream.body.size() + data_len > BodyBuffer::kMemoryLimit) {
+            // 请求体只保存在内存中，超过限制的请求返回413
+            stream.too_large = true;
+            std::string().swap(stream.body);
+        } else {
+            stream.body.append(reinterpret_cast<const char*>(data), data_len);
+        }
+    }
+    if (flags & FLAG_END_STREAM) {
+        stream.end_stream = true;
+        Dispatch_(stream, out);
+    } else if (len > 0) {
+        WriteWindowUpdate_(out, stream_id, len);
+    }
+    return true;
+}
+
+bool Http2Conn::OnHeaders_(uint8_t flags, uint32_t stream_id, const uint8_t* payload, uint32_t len,
+                           OutQueue& out) {
+    if (stream_id == 0 || stream_id % 2 == 0) return GoAway_(PROTOCOL_ERROR, out);
+
+    const uint8_t* block = payload;
+    uint32_t block_len = len;
+    if (flags & FLAG_PADDED) {
+        if (block_len < 1) return GoAway_(PROTOCOL_ERROR, out);
+        uint8_t pad = block[0];
+        block++;
+        block_len--;
+        if (pad > block_len) return GoAway_(PROTOCOL_ERROR, out);
+        block_len -= pad;
+    }
+    if (flags & FLAG_PRIORITY) {  // 跳过流依赖与权重
+        if (block_len < 5) return GoAway_(FRAME_SIZE_ERROR, out);
+        block += 5;
+        block_len -= 5;
+    }
+
+    header_block_.assign(reinterpret_cast<const char*>(block), block_len);
+    continuation_stream_ = stream_id;
+    continuation_flags_ = flags;
+    if (flags & FLAG_END_HEADERS) return OnHeaderBlock_(out);
+    return true;
+}
+
+bool Http2Conn::OnHeaderBlock_(OutQueue& out) {
+    uint32_t stream_id = continuation_stream_;
+    bool end_stream = continuation_flags_ & FLAG_END_STREAM;
+    continuation_stream_ = 0;
+
+    // 被拒绝的流的头部块也要解码，以保持与对端的动态表一致
+    HpackDecoder::HeaderList headers;
+    bool too_large = false;
+    bool ok = decoder_.Decode(reinterpret_cast<const uint8_t*>(header_block_.data()), header_block_.size(), headers,
+                              kMaxHeaderBlock, too_large);
+    header_block_.clear();
+    if (!ok) return GoAway_(COMPRESSION_ERROR, out);
+
+    auto it = streams_.find(stream_id);
+    if (it != streams_.end()) {  // 请求体之后的trailer，内容被忽略
+        Stream& stream = it->second;
+        if (stream.end_stream) return GoAway_(STREAM_CLOSED, out);
+        if (!end_stream) {
+            ResetStream_(stream_id, PROTOCOL_ERROR, out);
+            CloseStream_(stream_id);
+            return true;
+        }
+        stream.end_stream = true;
+        Dispatch_(stream, out);
+        return true;
+    }
+
+    if (stream_id <= last_stream_id_) return GoAway_(STREAM_CLOSED, out);
+    last_stream_id_ = stream_id;
+    if (streams_.size() >= kMaxConcurrentStreams) {
+        ResetStream_(stream_id, REFUSED_STREAM, out);
+        return true;
+    }
+
+    Stream& stream = NewStream_(stream_id);
+    stream.headers = std::move(headers);
+    stream.header_too_large = too_large;  // 之后的请求体被丢弃，结束时返回431
+    stream.end_stream = end_stream;
+    if (end_stream) Dispatch_(stream, out);
+    return true;
+}
+
+bool Http2Conn::OnSettings_(uint8_t flags, const uint8_t* payload, uint32_t len, OutQueue& out) {
+    if (flags & FLAG_ACK) {
+        if (len != 0) return GoAway_(FRAME_SIZE_ERROR, out);
+        return true;
+    }
+    if (len % 6 != 0) return GoAway_(FRAME_SIZE_ERROR, out);
+    uint32_t code = ApplySettings_(payload, len);
+    if (code != NO_ERROR) return GoAway_(code, out);
+    WriteFrameHeader_(out, 0, SETTINGS, FLAG_ACK, 0);
+    return true;
+}
+
+uint32_t Http2Conn::ApplySettings_(const uint8_t* payload, uint32_t len) {
+    for (uint32_t i = 0; i + 6 <= len; i += 6) {
+        uint16_t id = (uint16_t)(payload[i] << 8 | payload[i + 1]);
+        uint32_t value = ReadUint32(payload + i + 2);
+        switch (id) {
+            case SETTINGS_HEADER_TABLE_SIZE:
+                encoder_.SetMaxTableSize(value);
+                break;
+            case SETTINGS_ENABLE_PUSH:
+                if (value > 1) return PROTOCOL_ERROR;
+                break;
+            case SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (value > kMaxWindow) return FLOW_CONTROL_ERROR;
+                // 新的初始窗口对所有流的发送窗口生效
+                int64_t delta = (int64_t)value - peer_initial_window_;
+                peer_initial_window_ = value;
+                for (auto& item : streams_) {
+                    Stream& stream = item.second;
+                    stream.send_window += delta;
+                    if (stream.send_window > kMaxWindow) return FLOW_CONTROL_ERROR;
+                    MarkReady_(stream);
+                }
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (value < kMaxFrameSize || value > 0xffffff) return PROTOCOL_ERROR;
+                peer_max_frame_ = value;
+                break;
+            default:  // MAX_CONCURRENT_STREAMS等只约束对端，忽略未知的参数
+                break;
+        }
+    }
+    return NO_ERROR;
+}
+
+void Http2Conn::SendSettings_(OutQueue& out) {
+    char payload[12];
+    payload[0] = 0;
+    payload[1] = SETTINGS_MAX_CONCURRENT_STREAMS;
+    WriteUint32(kMaxConcurrentStreams, payload + 2);
+    payload[6] = 0;
+    payload[7] = SETTINGS_MAX_HEADER_LIST_SIZE;
+    WriteUint32(kMaxHeaderBlock, payload + 8);
+    WriteFrameHeader_(out, sizeof(payload), SETTINGS, 0, 0);
+    out.Append(payload, sizeof(payload));
+}
+
+bool Http2Conn::OnWindowUpdate_(uint32_t stream_id, const uint8_t* payload, uint32_t len, OutQueue& out) {
+    if (len != 4) return GoAway_(FRAME_SIZE_ERROR, out);
+    uint32_t increment = ReadUint32(payload) & 0x7fffffff;
+
+    if (stream_id == 0) {
+        if (increment == 0) return GoAway_(PROTOCOL_ERROR, out);
+        conn_send_window_ += increment;
+        if (conn_send_window_ > kMaxWindow) return GoAway_(FLOW_CONTROL_ERROR, out);
+        return true;
+    }
+
+    if (stream_id > last_stream_id_) return GoAway_(PROTOCOL_ERROR, out);
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end()) return true;  // 已关闭的流
+    Stream& stream = it->second;
+    if (increment == 0 || stream.send_window + increment > kMaxWindow) {
+        ResetStream_(stream_id, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR, out);
+        CloseStream_(stream_id);
+        return true;
+    }
+    stream.send_window += increment;
+    MarkReady_(stream);
+    return true;
+}
+
+Http2Conn::Stream& Http2Conn::NewStream_(uint32_t stream_id) {
+    Stream& stream = streams_[stream_id];
+    stream.id = stream_id;
+    stream.send_window = peer_initial_window_;
+    stream.end_stream = false;
+    stream.too_large = false;
+    stream.header_too_large = false;
+    stream.responded = false;
+    stream.head = false;
+    stream.ready = false;
+    stream.file.reset();
+    stream.pieces.clear();
+    return stream;
+}
+
+void Http2Conn::Dispatch_(Stream& stream, OutQueue& out) {
+    if (stream.header_too_large) {  // 没有保存任何字段，按GET处理错误页面
+        Respond_(stream, "/", 431, out);
+        return;
+    }
+    // 将请求还原为HTTP/1.1报文交给HttpRequest解析，与HTTP/1.1共用路由与表单处理
+    std::string_view method, path, authority;
+    std::string fields;
+    bool malformed = false;
+    for (auto& [name, value] : stream.headers) {
+        if (value.find_first_of(std::string_view("\r\n\0", 3)) != std::string::npos ||
+            name.find_first_of(std::string_view("\r\n\0: ", 5), 1) != std::string::npos) {
+            malformed = true;
+            break;
+        }
+        if (!name.empty() && name[0] == ':') {
+            if (name == ":method") method = value;
+            else if (name == ":path") path = value;
+            else if (name == ":authority") authority = value;
+            else if (name != ":scheme") malformed = true;
+            continue;
+        }
+        // 请求体长度由DATA帧决定，逐跳的头部在HTTP/2中无意义
+        if (name == "content-length" || name == "connection" || name == "transfer-encoding" ||
+            name == "keep-alive" || name == "upgrade" || (name == "host" && !authority.empty())) {
+            continue;
+        }
+        fields += name + ": " + value + "\r\n";
+    }
+    if (malformed || method.empty() || path.empty() || path[0] != '/' ||
+        method.find(' ') != std::string_view::npos || path.find(' ') != std::string_view::npos) {
+        LOG_WARN("Malformed HTTP/2 request on stream %u", stream.id);
+        ResetStream_(stream.id, PROTOCOL_ERROR, out);
+        CloseStream_(stream.id);
+        return;
+    }
+    stream.head = method == "HEAD";
+    if (stream.too_large) {
+        Respond_(stream, path, 413, out);
+        return;
+    }
+
+    Buffer buff;
+    buff.Append(std::string(method) + " " + std::string(path) + " HTTP/1.1\r\n");
+    if (!authority.empty()) buff.Append("Host: " + std::string(authority) + "\r\n");
+    buff.Append(fields);
+    buff.Append("Content-Length: " + std::to_string(stream.body.size()) + "\r\n\r\n");
+    buff.Append(stream.body);
+    std::string().swap(stream.body);
+    stream.headers.clear();
+
+    request_.Init();
+    HttpRequest::PARSE_RESULT ret = request_.Parse(buff);
+    if (ret == HttpRequest::COMPLETE) {
+        Respond_(stream, request_.Path(), 200, out, &request_);
+    } else {
+        Respond_(stream, request_.Path(), ret == HttpRequest::ERROR ? request_.ErrorCode() : 400, out);
+    }
+}
+
+void Http2Conn::Respond_(Stream& stream, std::string_view path, int code, OutQueue& out, HttpRequest* request) {
+    response_.Init(src_dir_, path, true, code);
+    if (request) {
+        response_.SetAcceptEncoding(request->Header(HttpRequest::ACCEPT_ENCODING));
+        if (request->Method() == "GET" || request->Method() == "HEAD") {
+            response_.SetConditional(request->Header(HttpRequest::IF_NONE_MATCH),
+                                     request->Header(HttpRequest::IF_MODIFIED_SINCE));
+        }
+        if (request->Method() == "GET") {
+            response_.SetRange(request->Header(HttpRequest::RANGE), request->Header(HttpRequest::IF_RANGE));
+        }
+    }
+    if (request && router_) router_->Dispatch(*request, response_);
+    response_.Prepare();
+
+    size_t len = response_.BodyLen();
+    if (response_.HasContent()) {
+        stream.pieces.push_back({response_.Content(), 0, len});
+    } else if (!response_.Ranges().empty()) {
+        for (const HttpResponse::ByteRange& range : response_.Ranges()) {
+            if (!range.head.empty()) stream.pieces.push_back({range.head, 0, range.head.size()});
+            stream.pieces.push_back({std::string(), range.offset, range.len});
+        }
+        const std::string& tail = response_.RangeTail();
+        if (!tail.empty()) stream.pieces.push_back({tail, 0, tail.size()});
+    } else if (len > 0) {
+        stream.pieces.push_back({std::string(), 0, len});
+    }
+
+    // 响应头：状态码与content-type加入动态表，之后的响应只需发送索引
+    std::string block;
+    encoder_.Begin(block);
+    encoder_.Encode(":status", std::to_string(response_.Code()), true, block);
+    if (response_.Code() != 304) {
+        encoder_.Encode("content-type", response_.FileType(), true, block);
+        encoder_.Encode("content-length", std::to_string(len), false, block);
+    }
+    if (!response_.ContentEncoding().empty()) {
+        encoder_.Encode("content-encoding", response_.ContentEncoding(), true, block);
+    }
+    if (response_.Vary()) encoder_.Encode("vary", "accept-encoding", true, block);
+    if (response_.AcceptRanges()) encoder_.Encode("accept-ranges", "bytes", true, block);
+    encoder_.Encode("date", TimeService::Date(), false, block);
+    if (!response_.ETag().empty()) encoder_.Encode("etag", response_.ETag(), false, block);
+    if (!response_.LastModified().empty()) encoder_.Encode("last-modified", response_.LastModified(), false, block);
+    if (!response_.CacheControl().empty()) encoder_.Encode("cache-control", response_.CacheControl(), true, block);
+    if (!response_.ContentRange().empty()) encoder_.Encode("content-range", response_.ContentRange(), false, block);
+
+    bool has_body = len > 0 && !stream.head;
+    uint8_t type = HEADERS;
+    uint8_t flags = has_body ? 0 : FLAG_END_STREAM;
+    size_t pos = 0;
+    do {  // 超过对端最大帧长度的头部块拆分为CONTINUATION帧
+        size_t n = std::min(block.size() - pos, (size_t)peer_max_frame_);
+        bool last = pos + n == block.size();
+        WriteFrameHeader_(out, n, type, flags | (last ? FLAG_END_HEADERS : 0), stream.id);
+        out.Append(block.data() + pos, n);
+        pos += n;
+        type = CONTINUATION;
+        flags = 0;
+    } while (pos < block.size());
+    stream.responded = true;
+
+    if (!has_body) {
+        response_.ReleaseFile();
+        streams_.erase(stream.id);
+        return;
+    }
+    // 流持有资源文件的引用，DATA帧直接引用缓存中的文件内容，大文件的DATA帧负载由sendfile发送
+    if (response_.FileRef()) stream.file = response_.FileRef();
+    response_.ReleaseFile();
+    MarkReady_(stream);
+}
+
+void Http2Conn::MarkReady_(Stream& stream) {
+    if (stream.ready || !stream.responded || stream.send_window <= 0) return;
+    stream.ready = true;
+    ready_.push_back(stream.id);
+}
+
+void Http2Conn::Flush_(OutQueue& out) {
+    // 各流轮流发送一个DATA帧，受连接窗口、流窗口、对端最大帧长度限制，
+    // 单次排队的字节数有上限，剩余部分在输出队列写完后继续。
+    // h2c升级后在收到客户端的连接前言前只发送101与SETTINGS，客户端可能只为升级后的首批数据预留了较小的缓冲区
+    if (preface_left_ > 0) return;
+    size_t budget = kMaxFlushBytes;
+    while (!ready_.empty() && conn_send_window_ > 0 && budget > 0) {
+        uint32_t stream_id = ready_.front();
+        ready_.pop_front();
+        auto it = streams_.find(stream_id);
+        if (it == streams_.end()) continue;  // 已被重置
+        Stream& stream = it->second;
+        stream.ready = false;
+        if (stream.send_window <= 0) continue;  // 等待该流的WINDOW_UPDATE
+
+        // 一个DATA帧只取自当前片段
+        Piece& piece = stream.pieces.front();
+        size_t chunk = std::min({piece.len, (size_t)stream.send_window, (size_t)conn_send_window_,
+                                 (size_t)peer_max_frame_, budget});
+        bool last = stream.pieces.size() == 1 && chunk == piece.len;
+        WriteFrameHeader_(out, chunk, DATA, last ? FLAG_END_STREAM : 0, stream_id);
+        if (piece.data.empty()) {
+            out.AppendFile(stream.file, piece.offset, chunk);
+        } else {
+            out.Append(piece.data.data() + piece.offset, chunk);
+        }
+        piece.offset += chunk;
+        piece.len -= chunk;
+        if (piece.len == 0) stream.pieces.pop_front();
+        stream.send_window -= chunk;
+        conn_send_window_ -= chunk;
+        budget -= chunk;
+
+        if (last) {
+            streams_.erase(it);
+        } else {
+            MarkReady_(stream);
+        }
+    }
+}
+
+void Http2Conn::CloseStream_(uint32_t stream_id) { streams_.erase(stream_id); }
+
+bool Http2Conn::GoAway_(uint32_t code, OutQueue& out) {
+    LOG_WARN("HTTP/2 connection error, code:%u", code);
+    char payload[8];
+    WriteUint32(last_stream_id_, payload);
+    WriteUint32(code, payload + 4);
+    WriteFrameHeader_(out, sizeof(payload), GOAWAY, 0, 0);
+    out.Append(payload, sizeof(payload));
+    goaway_sent_ = true;
+    return false;
+}
+
+void Http2Conn::ResetStream_(uint32_t stream_id, uint32_t code, OutQueue& out) {
+    char payload[4];
+    WriteUint32(code, payload);
+    WriteFrameHeader_(out, sizeof(payload), RST_STREAM, 0, stream_id);
+    out.Append(payload, sizeof(payload));
+}
+
+void Http2Conn::WriteFrameHeader_(OutQueue& out, uint32_t len, uint8_t type, uint8_t flags, uint32_t stream_id) {
+    char header[kFrameHeaderLen];
+    header[0] = (char)(len >> 16);
+    header[1] = (char)(len >> 8);
+    header[2] = (char)len;
+    header[3] = (char)type;
+    header[4] = (char)flags;
+    WriteUint32(stream_id, header + 5);
+    out.Append(header, sizeof(header));
+}
+
+void Http2Conn::WriteWindowUpdate_(OutQueue& out, uint32_t stream_id, uint32_t increment) {
+    char payload[4];
+    WriteUint32(increment, payload);
+    WriteFrameHeader_(out, sizeof(payload), WINDOW_UPDATE, 0, stream_id);
+    out.Append(payload, sizeof(payload));
+}
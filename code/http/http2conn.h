@@ -0,0 +1,168 @@
+#ifndef HTTP2_CONN_H
+#define HTTP2_CONN_H
+
+#include <stdint.h>
+#include <string.h>  // memcmp
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+#include "hpack.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "outqueue.h"
+#include "router.h"
+
+// HTTP/2(RFC 9113)连接，由HttpConn在收到连接前言(prior knowledge)或Upgrade: h2c后创建。
+// 在一个连接上复用多个流：请求头经HPACK解码后与HTTP/1.1一样经Router分发，
+// 响应正文直接引用文件映射按流控窗口切分为DATA帧，只复制9字节的帧头
+class Http2Conn {
+public:
+    Http2Conn(const char* src_dir, const Router* router);
+
+    // prior knowledge：HttpRequest已将"PRI * HTTP/2.0"解析为请求，还需要读取前言剩余的"SM\r\n\r\n"
+    void StartPriorKnowledge(OutQueue& out);
+    // h2c升级：settings为HTTP2-Settings请求头，有效时将101响应加入队列，升级前的请求作为流1处理。
+    // 返回false时不升级，按HTTP/1.1处理该请求
+    bool StartUpgrade(HttpRequest& request, OutQueue& out);
+
+    // 处理读缓冲区中完整的帧并把待发送的数据加入输出队列，返回false表示连接出错，GOAWAY已排队
+    bool Process(Buffer& in, OutQueue& out);
+    // 对端已发送GOAWAY且所有流已结束
+    bool Finished() const { return goaway_received_ && streams_.empty(); }
+    // 还有未结束的流(请求未收完、正文等待流量控制窗口等)
+    bool HasOpenStreams() const { return !streams_.empty(); }
+    // 连接缓存的数据占用的内存：各流的请求头、请求体与待发送的内存片段，未收完的头部块与HPACK动态表
+    size_t MemoryBytes() const;
+
+    // 识别h2c升级请求
+    static bool IsUpgrade(const HttpRequest& request);
+    // 识别prior knowledge的连接前言
+    static bool IsPreface(const HttpRequest& request) {
+        return request.Method() == "PRI" && request.Path() == "*" && request.Version() == "2.0";
+    }
+
+    static const uint32_t kMaxFrameSize = 16384;       // SETTINGS_MAX_FRAME_SIZE，使用默认值
+    static const uint32_t kMaxConcurrentStreams = 100;  // SETTINGS_MAX_CONCURRENT_STREAMS
+    static const size_t kMaxHeaderBlock = 65536;        // 头部块与解码后头部列表的最大长度
+    static const size_t kMaxFlushBytes = 256 * 1024;    // 单次最多加入输出队列的DATA帧字节数
+
+private:
+    // 帧类型
+    enum FRAME_TYPE {
+        DATA = 0x0,
+        HEADERS = 0x1,
+        PRIORITY = 0x2,
+        RST_STREAM = 0x3,
+        SETTINGS = 0x4,
+        PUSH_PROMISE = 0x5,
+        PING = 0x6,
+        GOAWAY = 0x7,
+        WINDOW_UPDATE = 0x8,
+        CONTINUATION = 0x9,
+    };
+    // 帧标志
+    enum FRAME_FLAG {
+        FLAG_END_STREAM = 0x1,
+        FLAG_ACK = 0x1,
+        FLAG_END_HEADERS = 0x4,
+        FLAG_PADDED = 0x8,
+        FLAG_PRIORITY = 0x20,
+    };
+    // 错误码
+    enum ERROR_CODE {
+        NO_ERROR = 0x0,
+        PROTOCOL_ERROR = 0x1,
+        INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3,
+        STREAM_CLOSED = 0x5,
+        FRAME_SIZE_ERROR = 0x6,
+        REFUSED_STREAM = 0x7,
+        COMPRESSION_ERROR = 0x9,
+    };
+    // SETTINGS参数
+    enum SETTING_ID {
+        SETTINGS_HEADER_TABLE_SIZE = 0x1,
+        SETTINGS_ENABLE_PUSH = 0x2,
+        SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+        SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+        SETTINGS_MAX_FRAME_SIZE = 0x5,
+        SETTINGS_MAX_HEADER_LIST_SIZE = 0x6,
+    };
+
+    struct Piece {
+        std::string data;  // 内存中的数据，为空时为资源文件中的片段
+        size_t offset;     // 下一个待发送字节在data或文件中的偏移
+        size_t len;        // 剩余待发送的字节数
+    };
+
+    struct Stream {
+        uint32_t id;
+        int64_t send_window;   // 发送窗口
+        bool end_stream;       // 对端已结束发送
+        bool too_large;        // 请求体超过限制
+        bool header_too_large; // 解码后的头部列表超过SETTINGS_MAX_HEADER_LIST_SIZE
+        bool responded;        // 响应头已发送
+        bool head;             // HEAD请求，不发送正文
+        bool ready;            // 在ready_队列中
+        HpackDecoder::HeaderList headers;
+        std::string body;      // 请求体
+        // 响应正文：依次发送的片段，文件片段引用缓存中的资源文件，内存片段为处理函数的正文或multipart的部分头
+        std::shared_ptr<const CachedFile> file;
+        std::deque<Piece> pieces;
+    };
+
+    bool OnFrame_(uint8_t type, uint8_t flags, uint32_t stream_id, const uint8_t* payload, uint32_t len,
+                  OutQueue& out);
+    bool OnData_(uint8_t flags, uint32_t stream_id, const uint8_t* payload, uint32_t len, OutQueue& out);
+    bool OnHeaders_(uint8_t flags, uint32_t stream_id, const uint8_t* payload, uint32_t len, OutQueue& out);
+    bool OnHeaderBlock_(OutQueue& out);  // 头部块接收完整
+    bool OnSettings_(uint8_t flags, const uint8_t* payload, uint32_t len, OutQueue& out);
+    uint32_t ApplySettings_(const uint8_t* payload, uint32_t len);  // 返回错误码
+    void SendSettings_(OutQueue& out);
+    bool OnWindowUpdate_(uint32_t stream_id, const uint8_t* payload, uint32_t len, OutQueue& out);
+
+    Stream& NewStream_(uint32_t stream_id);
+    void Dispatch_(Stream& stream, OutQueue& out);  // 请求完整，生成响应
+    // 生成响应头并排队，有正文时加入ready_，否则结束该流；request不为空时先经路由分发
+    void Respond_(Stream& stream, std::string_view path, int code, OutQueue& out, HttpRequest* request = nullptr);
+    void Flush_(OutQueue& out);                      // 按流控窗口发送DATA帧
+    void MarkReady_(Stream& stream);
+    void CloseStream_(uint32_t stream_id);  // 删除流，已排队的DATA帧各自持有资源文件的引用
+
+    bool GoAway_(uint32_t code, OutQueue& out);  // 连接错误，返回false
+    void ResetStream_(uint32_t stream_id, uint32_t code, OutQueue& out);
+    void WriteFrameHeader_(OutQueue& out, uint32_t len, uint8_t type, uint8_t flags, uint32_t stream_id);
+    void WriteWindowUpdate_(OutQueue& out, uint32_t stream_id, uint32_t increment);
+
+    const char* src_dir_;
+    const Router* router_;
+    size_t preface_left_;          // 连接前言中尚未收到的字节数
+    bool goaway_sent_;
+    bool goaway_received_;
+    uint32_t last_stream_id_;      // 对端创建的最大流id
+
+    int64_t conn_send_window_;     // 连接级发送窗口
+    uint32_t peer_initial_window_; // 对端的SETTINGS_INITIAL_WINDOW_SIZE
+    uint32_t peer_max_frame_;      // 对端的SETTINGS_MAX_FRAME_SIZE
+
+    uint32_t continuation_stream_;  // 正在接收CONTINUATION的流，0表示没有
+    uint8_t continuation_flags_;    // 头部块所在HEADERS帧的标志
+    std::string header_block_;      // 正在接收的头部块
+
+    std::unordered_map<uint32_t, Stream> streams_;
+    std::deque<uint32_t> ready_;    // 有正文待发送的流，轮流发送
+
+    HpackDecoder decoder_;
+    HpackEncoder encoder_;
+    HttpRequest request_;    // 解析流的请求，与HTTP/1.1共用表单处理
+    HttpResponse response_;  // 生成流的响应
+};
+
+#endif
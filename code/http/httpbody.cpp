@@ -0,0 +1,215 @@
+#include "httpbody.h"
+
+#include <algorithm>
+
+#include "httpparser.h"
+
+BodyBuffer::BodyBuffer() : size_(0), file_fd_(-1), pipe_{-1, -1} {}
+
+BodyBuffer::~BodyBuffer() {
+    Reset();
+    if (pipe_[0] >= 0) {
+        close(pipe_[0]);
+        close(pipe_[1]);
+    }
+}
+
+bool BodyBuffer::OnData(const char* data, size_t len) {
+    if (InMemory() && memory_.size() + len > kMemoryLimit && !Spill_()) return false;
+    size_ += len;
+    if (InMemory()) {
+        memory_.append(data, len);
+        return true;
+    }
+    // 溢出后memory_作为固定大小的写缓冲区，写满后写入文件
+    while (len > 0) {
+        size_t n = std::min(len, kMemoryLimit - memory_.size());
+        memory_.append(data, n);
+        data += n;
+        len -= n;
+        if (memory_.size() == kMemoryLimit && !FlushSpill_()) return false;
+    }
+    return true;
+}
+
+bool BodyBuffer::OnFinish() { return InMemory() || FlushSpill_(); }
+
+ssize_t BodyBuffer::SpliceFrom(int sock_fd, size_t len, int* save_errno) {
+    if ((InMemory() && !Spill_()) || !FlushSpill_()) {
+        *save_errno = EIO;
+        return -1;
+    }
+    if (pipe_[0] < 0 && pipe2(pipe_, O_NONBLOCK | O_CLOEXEC) < 0) {
+        *save_errno = errno;
+        return -1;
+    }
+    ssize_t len_in = splice(sock_fd, nullptr, pipe_[1], nullptr, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (len_in <= 0) {
+        *save_errno = errno;
+        return len_in;
+    }
+    // 管道中的数据必须全部写入文件，否则会混入下一个请求
+    ssize_t left = len_in;
+    while (left > 0) {
+        ssize_t len_out = splice(pipe_[0], nullptr, file_fd_, nullptr, left, SPLICE_F_MOVE);
+        if (len_out <= 0) {
+            LOG_ERROR("Splice body to file error: %d", errno);
+            *save_errno = EIO;
+            return -1;
+        }
+        left -= len_out;
+    }
+    size_ += len_in;
+    return len_in;
+}
+
+void BodyBuffer::Reset() {
+    if (file_fd_ >= 0) {
+        close(file_fd_);
+        file_fd_ = -1;
+    }
+    if (memory_.capacity() > kMemoryLimit) {
+        std::string().swap(memory_);
+    } else {
+        memory_.clear();
+    }
+    size_ = 0;
+}
+
+bool BodyBuffer::Spill_() {
+    file_fd_ = OpenTempFile_();
+    if (file_fd_ < 0) {
+        LOG_ERROR("Create body spill file error: %d", errno);
+        return false;
+    }
+    memory_.reserve(kMemoryLimit);
+    return FlushSpill_();
+}
+
+bool BodyBuffer::FlushSpill_() {
+    const char* data = memory_.data();
+    size_t left = memory_.size();
+    while (left > 0) {
+        ssize_t len = write(file_fd_, data, left);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Write body spill file error: %d", errno);
+            return false;
+        }
+        data += len;
+        left -= len;
+    }
+    memory_.clear();
+    return true;
+}
+
+int BodyBuffer::OpenTempFile_() {
+    // O_TMPFILE创建的文件没有名字，关闭后自动删除；文件系统不支持时退回mkstemp+unlink
+    int fd = open(P_tmpdir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) return fd;
+    char path[] = P_tmpdir "/webserver-body-XXXXXX";
+    fd = mkstemp(path);
+    if (fd >= 0) unlink(path);
+    return fd;
+}
+
+void BodyDecoder::Init(FRAMING framing, size_t length, size_t limit) {
+    framing_ = framing;
+    limit_ = limit;
+    received_ = 0;
+    error_code_ = 0;
+    remaining_ = framing == LENGTH ? length : 0;
+    if (framing == CHUNKED) {
+        state_ = CHUNK_SIZE;
+    } else {
+        state_ = remaining_ > 0 ? DATA : DONE;
+    }
+}
+
+bool BodyDecoder::Consume(Buffer& buff, BodySink& sink) {
+    while (state_ != DONE && state_ != FAILED && buff.ReadableBytes() > 0) {
+        const char* begin = buff.Peek();
+        const char* end = buff.BeginWriteConst();
+        if (state_ == DATA || state_ == CHUNK_DATA) {
+            size_t len = std::min(remaining_, static_cast<size_t>(end - begin));
+            if (!sink.OnData(begin, len)) return Fail_(sink.ErrorCode());
+            buff.Retrieve(len);
+            Advance(len);
+            continue;
+        }
+
+        // 以下状态按行处理，行不完整时留在缓冲区中
+        const char* line_end = HttpParser::FindCrlf(begin, end);
+        if (line_end == end) {
+            if (static_cast<size_t>(end - begin) > kMaxLineSize) return Fail_(400);
+            break;
+        }
+        std::string_view line(begin, line_end - begin);
+        buff.Retrieve(line_end + 2 - begin);
+        switch (state_) {
+            case CHUNK_SIZE: {
+                size_t size = 0;
+                if (!ParseChunkSize_(line, size)) return Fail_(400);
+                if (size == 0) {
+                    state_ = TRAILER;
+                } else if (size > limit_ - received_) {
+                    return Fail_(413);
+                } else {
+                    remaining_ = size;
+                    state_ = CHUNK_DATA;
+                }
+                break;
+            }
+            case CHUNK_CRLF:
+                if (!line.empty()) return Fail_(400);
+                state_ = CHUNK_SIZE;
+                break;
+            case TRAILER:  // trailer中的字段被忽略
+                if (line.empty()) state_ = DONE;
+                break;
+            default:
+                break;
+        }
+    }
+    return state_ != FAILED;
+}
+
+void BodyDecoder::Advance(size_t len) {
+    assert(len <= remaining_);
+    remaining_ -= len;
+    received_ += len;
+    if (remaining_ == 0) {
+        state_ = state_ == DATA ? DONE : CHUNK_CRLF;
+    }
+}
+
+bool BodyDecoder::Fail_(int code) {
+    LOG_WARN("Bad request body, code:%d", code);
+    state_ = FAILED;
+    error_code_ = code;
+    return false;
+}
+
+bool BodyDecoder::ParseChunkSize_(std::string_view line, size_t& size) {
+    // chunk-size [; chunk-ext]，扩展被忽略
+    size = 0;
+    size_t i = 0;
+    for (; i < line.size(); ++i) {
+        char ch = line[i];
+        int digit;
+        if (ch >= '0' && ch <= '9') {
+            digit = ch - '0';
+        } else if (ch >= 'a' && ch <= 'f') {
+            digit = ch - 'a' + 10;
+        } else if (ch >= 'A' && ch <= 'F') {
+            digit = ch - 'A' + 10;
+        } else {
+            break;
+        }
+        if (size > (SIZE_MAX >> 4)) return false;  // 溢出
+        size = (size << 4) | digit;
+    }
+    if (i == 0) return false;
+    while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) ++i;
+    return i == line.size() || line[i] == ';';
+}
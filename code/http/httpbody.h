@@ -0,0 +1,111 @@
+#ifndef HTTP_BODY_H
+#define HTTP_BODY_H
+
+#include <errno.h>
+#include <fcntl.h>   // open, splice
+#include <stdint.h>  // SIZE_MAX
+#include <stdlib.h>  // mkstemp
+#include <unistd.h>  // close, pipe2
+
+#include <string>
+#include <string_view>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+
+// 请求体的接收者，处理函数可以实现该接口逐段消费请求体
+class BodySink {
+public:
+    virtual ~BodySink() = default;
+    // 收到一段解码后的请求体数据，返回false表示无法继续接收
+    virtual bool OnData(const char* data, size_t len) = 0;
+    // 请求体接收完毕
+    virtual bool OnFinish() { return true; }
+    // OnData或OnFinish返回false时对应的响应状态码
+    virtual int ErrorCode() const { return 500; }
+};
+
+// 默认的请求体接收者：不超过kMemoryLimit时保存在内存中，超过后经固定大小的缓冲区溢出到临时文件，
+// 每个连接占用的内存与上传大小无关
+class BodyBuffer : public BodySink {
+public:
+    BodyBuffer();
+    ~BodyBuffer();
+
+    bool OnData(const char* data, size_t len) override;
+    bool OnFinish() override;
+
+    // 直接从socket经管道splice到临时文件，最多len字节，返回值与read相同
+    ssize_t SpliceFrom(int sock_fd, size_t len, int* save_errno);
+
+    void Reset();                                           // 丢弃已接收的请求体
+    size_t Size() const { return size_; }                   // 请求体长度
+    bool InMemory() const { return file_fd_ < 0; }          // 请求体是否全部在内存中
+    std::string& Memory() { return memory_; }               // 内存中的请求体
+    int FileFd() const { return file_fd_; }                 // 溢出的临时文件，已unlink，关闭后自动删除
+
+    static const size_t kMemoryLimit = 64 * 1024;  // 内存中保存请求体的上限，同时是溢出缓冲区的大小
+
+private:
+    BodyBuffer(const BodyBuffer&) = delete;
+    BodyBuffer& operator=(const BodyBuffer&) = delete;
+
+    bool Spill_();          // 创建临时文件，并把内存中的数据写入文件
+    bool FlushSpill_();     // 将溢出缓冲区写入临时文件
+    static int OpenTempFile_();
+
+    std::string memory_;  // 内存中的请求体，溢出后作为写文件的缓冲区
+    size_t size_;         // 已接收的字节数
+    int file_fd_;         // 临时文件
+    int pipe_[2];         // splice使用的管道，首次使用时创建，连接复用期间一直保留
+};
+
+// 请求体解码器，按Content-Length或chunked分帧，从读缓冲区头部消费数据并交给BodySink
+class BodyDecoder {
+public:
+    enum FRAMING {
+        NONE,     // 没有请求体
+        LENGTH,   // Content-Length
+        CHUNKED,  // Transfer-Encoding: chunked
+    };
+
+    BodyDecoder() { Init(NONE, 0, 0); }
+
+    void Init(FRAMING framing, size_t length, size_t limit);
+    // 消费buff中的请求体数据，数据不完整时保留在buff中等待下次继续，出错返回false
+    bool Consume(Buffer& buff, BodySink& sink);
+    // 请求体数据已由外部直接写入接收者(如splice)
+    void Advance(size_t len);
+
+    bool Done() const { return state_ == DONE; }
+    bool Failed() const { return state_ == FAILED; }
+    FRAMING Framing() const { return framing_; }
+    size_t Remaining() const { return remaining_; }  // 当前数据段剩余的字节数
+    size_t Received() const { return received_; }    // 已接收的请求体字节数
+    int ErrorCode() const { return error_code_; }    // 出错时对应的响应状态码
+
+    static const size_t kMaxLineSize = 4096;  // chunk大小行及trailer行的最大长度
+
+private:
+    enum STATE {
+        DATA,        // Content-Length的数据
+        CHUNK_SIZE,  // chunk大小行
+        CHUNK_DATA,  // chunk数据
+        CHUNK_CRLF,  // chunk数据之后的\r\n
+        TRAILER,     // 结尾的trailer，直到空行
+        DONE,
+        FAILED,
+    };
+
+    bool Fail_(int code);
+    static bool ParseChunkSize_(std::string_view line, size_t& size);
+
+    FRAMING framing_;
+    STATE state_;
+    size_t remaining_;  // 当前数据段剩余的字节数
+    size_t received_;   // 已接收的字节数
+    size_t limit_;      // 请求体的最大长度
+    int error_code_;
+};
+
+#endif
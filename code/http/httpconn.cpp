@@ -1,10 +1,38 @@
 #include "httpconn.h"
 
 const char* HttpConn::src_dir_;
+const Router* HttpConn::router_;
 std::atomic<int> HttpConn::user_count_;
+std::atomic<size_t> HttpConn::mem_bytes_;
 bool HttpConn::is_ET_;
+size_t HttpConn::max_conn_bytes_ = 1024 * 1024;
+size_t HttpConn::max_total_bytes_ = 1024 * 1024 * 1024;
+int HttpConn::idle_timeout_ms_ = 60000;
+int HttpConn::header_timeout_ms_ = 20000;
+int HttpConn::body_timeout_ms_ = 20000;
+int HttpConn::write_timeout_ms_ = 20000;
+size_t HttpConn::min_rate_ = 500;
+std::atomic<uint64_t> HttpConn::timeouts_[PHASE_COUNT];
 
-HttpConn::HttpConn() : fd_(-1), is_close_(true) { addr_ = {0}; }
+namespace {
+// 线程的缓存销毁后置为true，之后归还的对象直接释放
+thread_local bool exchanges_destroyed = false;
+}  // namespace
+
+HttpConn::HttpConn()
+    : fd_(-1),
+      is_close_(true),
+      keep_alive_(false),
+      read_paused_(false),
+      accounted_(0),
+      phase_(IDLE),
+      phase_start_(0),
+      phase_base_(0),
+      last_progress_(0),
+      read_total_(0),
+      write_total_(0) {
+    addr_ = {0};
+}
 
 HttpConn::~HttpConn() { Close(); }
 
@@ -13,58 +41,184 @@ void HttpConn::Init(int fd, const sockaddr_in& addr) {
     user_count_++;
     addr_ = addr;
     fd_ = fd;
-    write_buff_.RetrieveAll();
+    out_.Clear();
+    h2_.reset();
     read_buff_.RetrieveAll();
     is_close_ = false;
+    keep_alive_ = false;
+    read_paused_ = false;
+    read_total_ = write_total_ = 0;
+    // 新连接从接收请求头开始计时，不能无限期地不发送请求
+    phase_ = HEADER;
+    phase_start_ = last_progress_ = TimeService::NowMs();
+    phase_base_ = 0;
+    Account_();
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)user_count_);
 }
 
 ssize_t HttpConn::Read(int* save_error) {
+    if (!ex_ && !h2_) ex_ = AcquireExchange_();  // 空闲的连接收到数据时才取出请求对象
     ssize_t len = -1;
+    uint64_t total = read_total_;
+    read_paused_ = false;
     do {
-        len = read_buff_.ReadFd(fd_, save_error);
+        if (read_buff_.ReadableBytes() >= max_conn_bytes_) {
+            // 达到预算，剩余数据留在套接字中，由TCP流量控制让对端放慢，处理完已读的请求后再读
+            read_paused_ = true;
+            break;
+        }
+        if (ex_ && read_buff_.ReadableBytes() == 0 && ex_->request.CanSpliceBody()) {
+            // 大请求体直接从socket经管道splice到临时文件，不经过读缓冲区
+            len = ex_->request.SpliceBody(fd_, save_error);
+        } else {
+            len = read_buff_.ReadFd(fd_, save_error);
+            // 请求体边读边交给接收者，读缓冲区不随上传大小增长
+            if (len > 0 && ex_) ex_->request.FeedBody(read_buff_);
+        }
         if (len <= 0) break;
+        read_total_ += len;
     } while (is_ET_);
+    if (read_total_ != total) last_progress_ = TimeService::NowMs();
+    Account_();
+    UpdatePhase_();
     return len;
 }
 
+void HttpConn::Feed(const char* data, size_t len) {
+    if (!ex_ && !h2_) ex_ = AcquireExchange_();
+    read_buff_.Append(data, len);
+    if (ex_) ex_->request.FeedBody(read_buff_);
+    read_total_ += len;
+    last_progress_ = TimeService::NowMs();
+    Account_();
+    UpdatePhase_();
+}
+
 ssize_t HttpConn::Write(int* save_error) {
     ssize_t len = -1;
+    uint64_t total = write_total_;
     do {
-        len = writev(fd_, iov_, iov_cnt_);
-        if (len <= 0) {
-            *save_error = errno;
-            break;
-        }
-
-        if (iov_[0].iov_len + iov_[1].iov_len == 0) {
-            break;                                                // 写完了
-        } else if (static_cast<size_t>(len) > iov_[0].iov_len) {  // iov_[0]写完了，但iov_[1]没写完
-            iov_[1].iov_base = (uint8_t*)iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if (iov_[0].iov_len) {
-                write_buff_.RetrieveAll();
-                iov_[0].iov_len = 0;
-            }
-        } else {  // iov_[0]没写完
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len;
-            iov_[0].iov_len -= len;
-            write_buff_.Retrieve(len);
-        }
-    } while (is_ET_ || ToWriteBytes() > 10240);
+        len = out_.WriteTo(fd_, save_error);
+        if (len <= 0) break;
+        write_total_ += len;
+    } while (!out_.Empty() && (is_ET_ || out_.Bytes() > 10240));
+    if (write_total_ != total) last_progress_ = TimeService::NowMs();
+    Account_();
+    UpdatePhase_();
     return len;
 }
 
 void HttpConn::Close() {
-    response_.UnmapFile();
+    if (ex_) ReleaseExchange_(std::move(ex_));
+    out_.Release();
+    read_buff_.Release();  // 空闲的连接对象不占用缓冲区，内存块还给块池
+    h2_.reset();
+    read_paused_ = false;
     if (is_close_ == false) {
         is_close_ = true;
         user_count_--;
-        close(fd_);
+        Account_();  // 已关闭的连接计为0，必须在关闭fd之前完成
         LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)user_count_);
+        // 最后关闭fd：关闭后该fd可能立即被其它事件循环accept并复用同一个连接对象，之后不能再访问成员
+        close(fd_);
     }
 }
 
+bool HttpConn::Idle() const {
+    return read_buff_.ReadableBytes() == 0 && out_.Empty() && (!ex_ || ex_->request.Idle()) &&
+           (!h2_ || !h2_->HasOpenStreams());
+}
+
+void HttpConn::Shrink() {
+    assert(Idle());
+    // HTTP/2连接的请求对象只在升级时使用，之后也可以归还
+    if (ex_) ReleaseExchange_(std::move(ex_));
+    read_buff_.Release();
+    out_.Release();
+    Account_();
+}
+
+size_t HttpConn::MemoryBytes() const {
+    size_t bytes = sizeof(HttpConn) + read_buff_.Capacity() + out_.Capacity();
+    if (ex_) bytes += sizeof(Exchange);
+    if (h2_) bytes += h2_->MemoryBytes();
+    return bytes;
+}
+
+uint64_t HttpConn::Deadline() const {
+    int timeout = idle_timeout_ms_;
+    if (phase_ == HEADER) {
+        timeout = header_timeout_ms_;
+    } else if (phase_ == BODY) {
+        timeout = body_timeout_ms_;
+    } else if (phase_ == WRITE) {
+        timeout = write_timeout_ms_;
+    }
+    uint64_t deadline = phase_start_ + timeout;
+    if (phase_ != IDLE) {
+        if (min_rate_ > 0) {
+            uint64_t progress = (phase_ == WRITE ? write_total_ : read_total_) - phase_base_;
+            deadline += progress * 1000 / min_rate_;
+        }
+        // 发送时的进展包括写入内核套接字缓冲区的数据，对端停止接收后只能由停顿的时间发现
+        deadline = std::min(deadline, std::max(last_progress_, phase_start_) + timeout);
+    }
+    return deadline;
+}
+
+const char* HttpConn::PhaseName(PHASE phase) {
+    static const char* const names[PHASE_COUNT] = {"idle", "header", "body", "write"};
+    return names[phase];
+}
+
+void HttpConn::UpdatePhase_() {
+    PHASE phase;
+    if (!out_.Empty()) {
+        phase = WRITE;
+    } else if (ex_ && !h2_ && !ex_->request.Idle()) {
+        phase = ex_->request.State() == HttpRequest::BODY ? BODY : HEADER;
+    } else {
+        phase = read_buff_.ReadableBytes() > 0 ? HEADER : IDLE;  // 只收到下一个请求的一部分
+    }
+    if (phase == phase_) return;
+    phase_ = phase;
+    phase_start_ = TimeService::NowMs();
+    phase_base_ = phase == WRITE ? write_total_ : read_total_;
+}
+
+void HttpConn::Account_() {
+    size_t bytes = is_close_ ? 0 : MemoryBytes();
+    if (bytes != accounted_) {
+        mem_bytes_ += bytes - accounted_;  // 无符号数回绕，减少时同样正确
+        accounted_ = bytes;
+    }
+}
+
+std::vector<std::unique_ptr<HttpConn::Exchange>>* HttpConn::ExchangeCache_() {
+    if (exchanges_destroyed) return nullptr;
+    static thread_local struct Cache {
+        std::vector<std::unique_ptr<Exchange>> free;
+        ~Cache() { exchanges_destroyed = true; }
+    } cache;
+    return &cache.free;
+}
+
+std::unique_ptr<HttpConn::Exchange> HttpConn::AcquireExchange_() {
+    auto* cache = ExchangeCache_();
+    if (!cache || cache->empty()) return std::unique_ptr<Exchange>(new Exchange());
+    std::unique_ptr<Exchange> ex = std::move(cache->back());
+    cache->pop_back();
+    return ex;
+}
+
+void HttpConn::ReleaseExchange_(std::unique_ptr<Exchange> ex) {
+    // 归还前清空，缓存中的对象不持有文件引用与请求体的临时文件
+    ex->request.Init();
+    ex->response.ReleaseFile();
+    auto* cache = ExchangeCache_();
+    if (cache && cache->size() < kMaxCachedExchanges) cache->push_back(std::move(ex));
+}
+
 int HttpConn::GetFd() const { return fd_; }
 
 int HttpConn::GetPort() const { return addr_.sin_port; }
@@ -74,29 +228,88 @@ const char* HttpConn::GetIP() const { return inet_ntoa(addr_.sin_addr); }
 sockaddr_in HttpConn::GetAddr() const { return addr_; }
 
 bool HttpConn::Process() {
-    
-    request_.Init();
-    if (read_buff_.ReadableBytes() <= 0)
-        return false;
-    else if (request_.Parse(read_buff_)) {  // 解析成功
-        LOG_DEBUG("%s", request_.Path().c_str());
-        response_.Init(src_dir_, request_.Path(), request_.IsKeepAlive(), 200);
-    } else {    // 解析失败
-        response_.Init(src_dir_, request_.Path(), false, 400);
+    // 依次处理读缓冲区中所有完整的请求(pipelining)，响应按请求顺序排队，由Write合并发送
+    if (h2_) return ProcessH2_();
+    if (!ex_) ex_ = AcquireExchange_();
+    HttpRequest& request = ex_->request;
+    HttpResponse& response = ex_->response;
+
+    int count = 0;
+    // 读缓冲区为空时也需要解析：请求体可能已在Read中被全部消费
+    while (count < kMaxPipeline) {
+        HttpRequest::PARSE_RESULT ret = request.Parse(read_buff_);
+        if (ret == HttpRequest::NEED_MORE) {  // 请求不完整，继续读取
+            break;
+        } else if (ret == HttpRequest::COMPLETE) {  // 解析成功
+            LOG_DEBUG("%.*s", (int)request.Path().size(), request.Path().data());
+            if (Http2Conn::IsPreface(request)) {  // prior knowledge
+                h2_.reset(new Http2Conn(src_dir_, router_));
+                h2_->StartPriorKnowledge(out_);
+                return ProcessH2_();
+            }
+            if (Http2Conn::IsUpgrade(request)) {  // h2c升级，HTTP2-Settings无效时按HTTP/1.1响应
+                h2_.reset(new Http2Conn(src_dir_, router_));
+                if (h2_->StartUpgrade(request, out_)) return ProcessH2_();
+                h2_.reset();
+            }
+            keep_alive_ = request.IsKeepAlive();
+            response.Init(src_dir_, request.Path(), keep_alive_, 200);
+            response.SetAcceptEncoding(request.Header(HttpRequest::ACCEPT_ENCODING));
+            response.SetHeadOnly(request.Method() == "HEAD");
+            if (request.Method() == "GET" || request.Method() == "HEAD") {
+                response.SetConditional(request.Header(HttpRequest::IF_NONE_MATCH),
+                                         request.Header(HttpRequest::IF_MODIFIED_SINCE));
+            }
+            if (request.Method() == "GET") {
+                response.SetRange(request.Header(HttpRequest::RANGE), request.Header(HttpRequest::IF_RANGE));
+            }
+            if (router_) router_->Dispatch(request, response);
+        } else {  // 解析失败
+            keep_alive_ = false;
+            response.Init(src_dir_, request.Path(), false, request.ErrorCode());
+        }
+
+        QueueResponse_();
+        ++count;
+        // 该响应发送完后连接将关闭，不再处理之后的请求；
+        // 输出队列超过预算时也先停下，发送完后再处理剩余的流水线请求
+        if (!keep_alive_ || out_.Capacity() > max_conn_bytes_) break;
     }
+    LOG_DEBUG("%d responses queued, %zu bytes to write", count, out_.Bytes());
+    Account_();
+    UpdatePhase_();
+    return count > 0;
+}
+
+bool HttpConn::ProcessH2_() {
+    // 处理读缓冲区中完整的帧，连接出错时GOAWAY发送完后关闭连接
+    bool ok = h2_->Process(read_buff_, out_);
+    keep_alive_ = ok && !h2_->Finished();
+    Account_();
+    UpdatePhase_();
+    return !out_.Empty() || !keep_alive_;
+}
 
-    response_.MakeResponse(write_buff_);
+void HttpConn::QueueResponse_() {
+    HttpResponse& response = ex_->response;
     // 响应头
-    iov_[0].iov_base = const_cast<char*>(write_buff_.Peek());
-    iov_[0].iov_len = write_buff_.ReadableBytes();
-    iov_cnt_ = 1;
-
-    // 文件,所请求的资源文件
-    if (response_.FileLen() > 0 && response_.File()) {
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();
-        iov_cnt_ = 2;
+    Buffer& buff = out_.Buff();
+    size_t header_begin = buff.ReadableBytes();
+    response.MakeResponse(buff);
+    out_.Commit(buff.ReadableBytes() - header_begin);
+
+    // 文件,所请求的资源文件，输出队列引用缓存中的文件内容(或由sendfile发送)并持有引用直到发送完；
+    // 206响应只引用请求的范围，多个范围时各部分头复制到队列中；HEAD响应只有响应头
+    if (response.HeadOnly()) {
+        // 不发送正文，流水线上之后的响应紧接着响应头
+    } else if (!response.Ranges().empty()) {
+        for (const HttpResponse::ByteRange& range : response.Ranges()) {
+            if (!range.head.empty()) out_.Append(range.head);
+            out_.AppendFile(response.FileRef(), range.offset, range.len);
+        }
+        if (!response.RangeTail().empty()) out_.Append(response.RangeTail());
+    } else if (response.FileRef() && response.BodyLen() > 0) {  // 304响应不发送文件
+        out_.AppendFile(response.FileRef(), 0, response.FileLen());
     }
-    LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen(), iov_cnt_, ToWriteBytes());
-    return true;
+    response.ReleaseFile();
 }
@@ -7,20 +7,41 @@
 #include <sys/types.h>
 #include <sys/uio.h>  // readv/writev
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "../buffer/buffer.h"
 #include "../log/log.h"
 #include "../pool/sqlconnRAII.h"
+#include "../timer/timeservice.h"
+#include "http2conn.h"
 #include "httprequest.h"
 #include "httpresponse.h"
+#include "outqueue.h"
+#include "router.h"
 
+// HTTP连接。连接空闲(没有未处理完的请求与待发送的数据)时，读缓冲区、输出队列与请求/响应对象都还给线程的缓存，
+// 空闲连接只占用连接对象本身，收到数据时再取出；连接占用的内存计入全局统计，超过上限时由事件循环关闭最久未活动的空闲连接。
+// 连接按所处的阶段(等待请求、接收请求头、接收请求体、发送响应)分别计时，事件循环的定时器按当前阶段的期限关闭连接
 class HttpConn {
 public:
+    enum PHASE {
+        IDLE,    // 等待下一个请求
+        HEADER,  // 接收请求行与请求头，HTTP/2连接收到不完整的帧时也在此阶段
+        BODY,    // 接收请求体
+        WRITE,   // 发送响应
+        PHASE_COUNT,
+    };
+
     HttpConn();
     ~HttpConn();
     void Init(int sock_fd, const sockaddr_in& addr);
 
-    ssize_t Read(int* save_error);      // 读取数据
-    ssize_t Write(int* save_error);     // 写入数据
+    ssize_t Read(int* save_error);      // 读取数据，读缓冲区达到max_conn_bytes_时暂停读取，数据留在套接字中
+    void Feed(const char* data, size_t len);  // 追加内核已接收的数据(io_uring完成模式)，与Read一样计入请求体与阶段
+    ssize_t Write(int* save_error);     // 写入数据，待发送的文件内容不在页缓存中时save_error为EINPROGRESS
+    const OutQueue::ColdRange& Cold() const { return out_.Cold(); }  // 需要先读入页缓存的文件区间
 
     void Close();
     int GetFd() const;
@@ -28,26 +49,82 @@ public:
     const char* GetIP() const;
     sockaddr_in GetAddr() const;
 
-    bool Process();                // 处理请求
-    int ToWriteBytes() { return iov_[0].iov_len + iov_[1].iov_len; }        // 待写入的字节数
-    bool IsKeepAlive() const { return request_.IsKeepAlive(); }        // 是否保持连接
+    bool Process();                                       // 处理读缓冲区中所有完整的请求
+    size_t ToWriteBytes() const { return out_.Bytes(); }  // 待写入的字节数
+    bool IsKeepAlive() const { return keep_alive_; }      // 最后一个响应是否保持连接
+    bool ReadPaused() const { return read_paused_; }      // 上次读取是否因内存预算暂停
+
+    PHASE Phase() const { return phase_; }
+    // 当前阶段的期限(TimeService::NowMs()的毫秒数)：阶段开始的时间加上该阶段的超时；
+    // 除等待请求外，阶段内每收到或发出min_rate_字节再延长1秒，且两次收发数据的间隔不能超过该阶段的超时，
+    // 即平均速率不低于min_rate_且没有停顿的连接不会超时
+    uint64_t Deadline() const;
+    static const char* PhaseName(PHASE phase);
+    static void CountTimeout(PHASE phase) { ++timeouts_[phase]; }
+    static uint64_t Timeouts(PHASE phase) { return timeouts_[phase]; }  // 该阶段超时关闭的连接数
+
+    bool Idle() const;           // 没有未解析完的请求、待发送的数据与未结束的HTTP/2流
+    void Shrink();               // 空闲时释放缓冲区与请求/响应对象
+    size_t MemoryBytes() const;  // 连接占用的内存，不含引用的文件内容与内核的套接字缓冲区
+    // 所有连接占用的内存是否超过max_total_bytes_
+    static bool OverMemory() { return max_total_bytes_ > 0 && mem_bytes_ > max_total_bytes_; }
 
     static bool is_ET_;                   // 是否是ET模式
     static const char* src_dir_;          // 资源目录
+    static const Router* router_;         // 路由表，没有匹配的路由时按静态文件处理
     static std::atomic<int> user_count_;  // 统计用户数量
+    static std::atomic<size_t> mem_bytes_;  // 所有连接占用的内存
+
+    static size_t max_conn_bytes_;   // 单个连接的内存预算，读缓冲区或输出队列超过时暂停读取或处理流水线请求
+    static size_t max_total_bytes_;  // 所有连接的内存上限，0为不限制
+
+    static int idle_timeout_ms_;    // 等待下一个请求的时间，由WebServer的timeout_ms设置
+    static int header_timeout_ms_;  // 接收完请求头的时间
+    static int body_timeout_ms_;    // 接收完请求体的时间
+    static int write_timeout_ms_;   // 发送完响应的时间
+    static size_t min_rate_;        // 接收与发送的最低速率(字节/秒)，0为不按速率延长期限
+
+    static const int kMaxPipeline = 32;  // 单次Process最多处理的流水线请求数
 
 private:
+    // 请求与响应对象，只在有请求时持有
+    struct Exchange {
+        HttpRequest request;
+        HttpResponse response;
+    };
+
+    void QueueResponse_();  // 生成响应并加入输出队列
+    bool ProcessH2_();      // 连接已切换到HTTP/2
+    void Account_();        // 把内存的变化计入mem_bytes_
+    void UpdatePhase_();    // 按请求与输出队列的状态确定阶段，阶段变化时重新计时
+
+    // 每个线程缓存的请求/响应对象，复用时保留其中字符串与数组的容量
+    static std::vector<std::unique_ptr<Exchange>>* ExchangeCache_();  // 线程退出后返回nullptr
+    static std::unique_ptr<Exchange> AcquireExchange_();
+    static void ReleaseExchange_(std::unique_ptr<Exchange> ex);
+    static const size_t kMaxCachedExchanges = 64;
+
     int fd_;                   // socket文件描述符
     struct sockaddr_in addr_;  // 对方的socket地址
     bool is_close_;            // 是否关闭连接
-    int iov_cnt_;              // writev的io向量数量
-    struct iovec iov_[2];      // 用于writev的io向量
+    bool keep_alive_;          // 最后一个已排队的响应是否保持连接
+    bool read_paused_;         // 读缓冲区达到预算时暂停读取
+    size_t accounted_;         // 已计入mem_bytes_的字节数
+
+    PHASE phase_;
+    uint64_t phase_start_;  // 阶段开始的时间
+    uint64_t phase_base_;   // 阶段开始时已读取或已发送的字节数
+    uint64_t last_progress_;  // 最近一次读取或发送数据的时间
+    uint64_t read_total_;   // 累计读取的字节数
+    uint64_t write_total_;  // 累计发送的字节数
+    static std::atomic<uint64_t> timeouts_[PHASE_COUNT];
+
+    Buffer read_buff_;  // 读缓冲区
+    OutQueue out_;      // 输出队列，响应头与文件映射按响应顺序排队
 
-    Buffer read_buff_;   // 读缓冲区
-    Buffer write_buff_;  // 写缓冲区
+    std::unique_ptr<Exchange> ex_;  // 请求与响应报文，HTTP/1.1连接收到数据时取出，空闲时归还
 
-    HttpRequest request_;    // 请求报文
-    HttpResponse response_;  // 响应报文
+    std::unique_ptr<Http2Conn> h2_;  // 通过prior knowledge或h2c升级切换到HTTP/2后创建
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include "httpform.h"
+
+#include "simdscan.h"
+
+namespace {
+
+inline int HexValue(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    return -1;
+}
+
+inline std::string_view Trim(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) str.remove_prefix(1);
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) str.remove_suffix(1);
+    return str;
+}
+
+}  // namespace
+
+size_t FormDecoder::Decode(char* data, size_t len) {
+    char* out = data;
+    const char* in = data;
+    const char* end = data + len;
+    while (in < end) {
+        // 两个特殊字符之间的普通字符整段移动，没有特殊字符时不写内存
+        const char* special = SimdScan::FindEither(in, end, '%', '+');
+        size_t n = special - in;
+        if (out != in) memmove(out, in, n);
+        out += n;
+        in = special;
+        if (in == end) break;
+
+        if (*in == '+') {
+            *out++ = ' ';
+            ++in;
+            continue;
+        }
+        int hi = end - in >= 3 ? HexValue(in[1]) : -1;
+        int lo = hi >= 0 ? HexValue(in[2]) : -1;
+        if (lo >= 0) {
+            *out++ = (char)(hi << 4 | lo);
+            in += 3;
+        } else {
+            *out++ = *in++;  // 不合法的%XX按原样保留
+        }
+    }
+    return out - data;
+}
+
+void FormDecoder::ParseUrlencoded(char* data, size_t len, FormFields& fields) {
+    char* end = data + len;
+    char* pos = data;
+    while (pos < end) {
+        char* amp = const_cast<char*>(HttpParser::FindChar(pos, end, '&'));
+        char* eq = const_cast<char*>(HttpParser::FindChar(pos, amp, '='));
+        if (amp != pos) {  // 跳过空的字段("a=1&&b=2")
+            size_t key_len = Decode(pos, eq - pos);
+            size_t value_len = eq < amp ? Decode(eq + 1, amp - eq - 1) : 0;
+            fields.emplace_back(std::string_view(pos, key_len),
+                                std::string_view(eq < amp ? eq + 1 : amp, value_len));
+            LOG_DEBUG("%.*s = %.*s", (int)key_len, pos, (int)value_len, eq < amp ? eq + 1 : amp);
+        }
+        pos = amp + 1;
+    }
+}
+
+const char* FormDecoder::Impl() { return SimdScan::Name(SimdScan::Best()); }
+
+std::string_view MultipartParser::Boundary(std::string_view content_type) {
+    size_t semi = content_type.find(';');
+    if (!HttpParser::EqualsNoCase(Trim(content_type.substr(0, semi)), "multipart/form-data")) return {};
+    if (semi == std::string_view::npos) return {};
+    std::string_view boundary = Param_(content_type.substr(semi + 1), "boundary");
+    if (boundary.empty() || boundary.size() > kMaxBoundary) return {};
+    return boundary;
+}
+
+std::string_view MultipartParser::Param_(std::string_view header, std::string_view key) {
+    // 按';'拆分"form-data; k1=v1; k2="v2""，值可以带引号，没有值的参数被跳过
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t eq = header.find_first_of("=;", pos);
+        if (eq == std::string_view::npos) return {};
+        if (header[eq] == ';') {
+            pos = eq + 1;
+            continue;
+        }
+        std::string_view name = Trim(header.substr(pos, eq - pos));
+        size_t begin = eq + 1;
+        while (begin < header.size() && header[begin] == ' ') ++begin;
+
+        std::string_view value;
+        size_t next;
+        if (begin < header.size() && header[begin] == '"') {
+            size_t quote = header.find('"', begin + 1);
+            if (quote == std::string_view::npos) return {};
+            value = header.substr(begin + 1, quote - begin - 1);
+            next = header.find(';', quote + 1);
+        } else {
+            next = header.find(';', begin);
+            value = Trim(header.substr(begin, next - begin));
+        }
+        if (HttpParser::EqualsNoCase(name, key)) return value;
+        if (next == std::string_view::npos) return {};
+        pos = next + 1;
+    }
+    return {};
+}
+
+bool MultipartParser::Init(std::string_view content_type, PartHandler* handler) {
+    std::string_view boundary = Boundary(content_type);
+    if (boundary.empty() || !handler) {
+        state_ = DONE;
+        return false;
+    }
+    handler_ = handler;
+    delim_ = "\r\n--";
+    delim_.append(boundary.data(), boundary.size());
+    // 请求体以"--boundary"开头，前面没有"\r\n"，预先放入尾部使第一个分隔符与其它分隔符一样匹配
+    tail_ = "\r\n";
+    head_.clear();
+    in_part_ = false;
+    state_ = PREAMBLE;
+    return true;
+}
+
+bool MultipartParser::OnData(const char* data, size_t len) {
+    while (len > 0) {
+        switch (state_) {
+            case PREAMBLE:
+            case DATA:
+                if (!Body_(data, len)) return Fail_();
+                break;
+            case DELIMITER: {
+                // 分隔符之后是"\r\n"(下一个部分)或"--"(结束)
+                size_t n = std::min(len, 2 - head_.size());
+                head_.append(data, n);
+                data += n;
+                len -= n;
+                if (head_.size() < 2) break;
+                if (head_ == "--") {
+                    state_ = EPILOGUE;
+                    head_.clear();
+                } else if (head_ == "\r\n") {
+                    state_ = HEADER;  // 保留"\r\n"，没有头部的部分也以"\r\n\r\n"结束
+                } else {
+                    return Fail_();
+                }
+                break;
+            }
+            case HEADER:
+                if (!Header_(data, len)) return Fail_();
+                break;
+            case EPILOGUE:  // 结束分隔符之后的数据被忽略
+                len = 0;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool MultipartParser::OnFinish() {
+    if (state_ != EPILOGUE) {
+        LOG_WARN("Multipart body ended without closing boundary");
+        return Fail_();
+    }
+    state_ = DONE;
+    return true;
+}
+
+bool MultipartParser::Fail_() {
+    state_ = FAILED;
+    return false;
+}
+
+size_t MultipartParser::Find_(const char* data, size_t len, bool& full) const {
+    const char* end = data + len;
+    const char* p = data;
+    while ((p = HttpParser::FindChar(p, end, '\r')) < end) {
+        size_t rest = end - p;
+        if (rest >= delim_.size()) {
+            if (memcmp(p, delim_.data(), delim_.size()) == 0) {
+                full = true;
+                return p - data;
+            }
+        } else if (memcmp(p, delim_.data(), rest) == 0) {
+            full = false;
+            return p - data;
+        }
+        ++p;
+    }
+    full = false;
+    return len;
+}
+
+bool MultipartParser::Body_(const char*& data, size_t& len) {
+    if (!tail_.empty()) {
+        // 分隔符可能跨越两段数据：把保留的尾部与新数据的开头拼接后查找从尾部开始的分隔符
+        size_t take = std::min(len, delim_.size());
+        std::string joined = tail_;
+        joined.append(data, take);
+        bool full;
+        size_t pos = Find_(joined.data(), joined.size(), full);
+        if (pos < tail_.size()) {
+            if (!Emit_(joined.data(), pos)) return false;
+            if (!full) {  // 仍然不完整，数据都已拼接到尾部中
+                tail_ = joined.substr(pos);
+                data += take;
+                len -= take;
+                return true;
+            }
+            size_t used = pos + delim_.size() - tail_.size();
+            tail_.clear();
+            data += used;
+            len -= used;
+            if (in_part_ && !handler_->OnPartEnd()) return false;
+            in_part_ = false;
+            state_ = DELIMITER;
+            return true;
+        }
+        // 尾部不是分隔符的开始
+        if (!Emit_(tail_.data(), tail_.size())) return false;
+        tail_.clear();
+    }
+
+    bool full;
+    size_t pos = Find_(data, len, full);
+    if (!Emit_(data, pos)) return false;
+    if (pos == len) {
+        len = 0;
+    } else if (!full) {
+        tail_.assign(data + pos, len - pos);
+        len = 0;
+    } else {
+        data += pos + delim_.size();
+        len -= pos + delim_.size();
+        if (in_part_ && !handler_->OnPartEnd()) return false;
+        in_part_ = false;
+        state_ = DELIMITER;
+    }
+    return true;
+}
+
+bool MultipartParser::Emit_(const char* data, size_t len) {
+    if (state_ != DATA || len == 0) return true;  // 第一个分隔符之前的数据被忽略
+    return handler_->OnPartData(data, len);
+}
+
+bool MultipartParser::Header_(const char*& data, size_t& len) {
+    // 部分头部以空行结束，长度有限，累积后一次解析
+    size_t old_size = head_.size();
+    size_t n = std::min(len, kMaxPartHeader + 4 - old_size);
+    head_.append(data, n);
+    size_t end = head_.find("\r\n\r\n", old_size >= 3 ? old_size - 3 : 0);
+    if (end == std::string::npos) {
+        if (head_.size() >= kMaxPartHeader + 4) {
+            LOG_WARN("Multipart part header too large");
+            return false;
+        }
+        data += n;
+        len -= n;
+        return true;
+    }
+    size_t used = end + 4 - old_size;
+    data += used;
+    len -= used;
+
+    Part part;
+    std::string_view headers = std::string_view(head_).substr(2, end);  // 去掉开头的"\r\n"
+    while (!headers.empty()) {
+        size_t crlf = headers.find("\r\n");
+        std::string_view line = headers.substr(0, crlf);
+        headers.remove_prefix(crlf + 2);
+        std::string_view name, value;
+        if (!HttpParser::ParseHeader(line, name, value)) return false;
+        if (HttpParser::EqualsNoCase(name, "Content-Disposition")) {
+            part.name = Param_(value, "name");
+            part.filename = Param_(value, "filename");
+        } else if (HttpParser::EqualsNoCase(name, "Content-Type")) {
+            part.content_type = value;
+        }
+    }
+    if (!handler_->OnPartBegin(part)) return false;
+    head_.clear();
+    in_part_ = true;
+    state_ = DATA;
+    return true;
+}
+
+void FormCollector::Reset() {
+    data_.clear();
+    fields_.clear();
+    files_.clear();
+    current_ = nullptr;
+}
+
+bool FormCollector::OnPartBegin(const MultipartParser::Part& part) {
+    if (!part.filename.empty()) {
+        if (files_.size() >= kMaxFiles) {
+            LOG_WARN("Too many files in form");
+            return false;
+        }
+        files_.emplace_back(new File());
+        current_ = files_.back().get();
+        current_->name.assign(part.name.data(), part.name.size());
+        current_->filename.assign(part.filename.data(), part.filename.size());
+        current_->content_type.assign(part.content_type.data(), part.content_type.size());
+        return true;
+    }
+    current_ = nullptr;
+    if (data_.size() + part.name.size() > kMaxFieldBytes) return false;
+    fields_.push_back({data_.size(), part.name.size(), data_.size() + part.name.size(), 0});
+    data_.append(part.name.data(), part.name.size());
+    return true;
+}
+
+bool FormCollector::OnPartData(const char* data, size_t len) {
+    if (current_) return current_->data.OnData(data, len);  // 文件部分不在内存中累积
+    if (data_.size() + len > kMaxFieldBytes) {
+        LOG_WARN("Form fields too large");
+        return false;
+    }
+    data_.append(data, len);
+    fields_.back().value_len += len;
+    return true;
+}
+
+bool FormCollector::OnPartEnd() {
+    bool ok = current_ ? current_->data.OnFinish() : true;
+    current_ = nullptr;
+    return ok;
+}
+
+void FormCollector::AppendFields(FormFields& fields) const {
+    for (const Field& field : fields_) {
+        fields.emplace_back(std::string_view(data_.data() + field.name_off, field.name_len),
+                            std::string_view(data_.data() + field.value_off, field.value_len));
+    }
+}
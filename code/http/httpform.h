@@ -0,0 +1,134 @@
+#ifndef HTTP_FORM_H
+#define HTTP_FORM_H
+
+#include <stddef.h>
+#include <string.h>  // memcmp, memmove
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../log/log.h"
+#include "httpbody.h"
+#include "httpparser.h"
+
+// 表单字段的索引，name与value指向解码后的请求体(或FormCollector的存储)，不复制
+typedef std::vector<std::pair<std::string_view, std::string_view>> FormFields;
+
+// application/x-www-form-urlencoded解码
+// 用SimdScan::FindEither查找'%'与'+'，两个特殊字符之间的数据整段移动
+class FormDecoder {
+public:
+    // 原地解码%XX与'+'，返回解码后的长度，解码后的数据不会比原数据长；不合法的%XX按原样保留
+    static size_t Decode(char* data, size_t len);
+    // 原地解码整个表单，按出现顺序把字段追加到fields中
+    static void ParseUrlencoded(char* data, size_t len, FormFields& fields);
+
+    static const char* Impl();  // 当前使用的查找实现："avx2"、"sse4.2"或"scalar"
+};
+
+// multipart/form-data的流式解析器，作为BodySink逐段接收请求体，
+// 各部分的数据直接交给PartHandler，不在解析器中缓存(只保留可能是分隔符前缀的几十个字节)
+class MultipartParser : public BodySink {
+public:
+    // 部分的头部信息，只在OnPartBegin期间有效
+    struct Part {
+        std::string_view name;          // Content-Disposition的name
+        std::string_view filename;      // Content-Disposition的filename，为空表示普通字段
+        std::string_view content_type;  // 部分的Content-Type
+    };
+    // 部分数据的接收者，任一函数返回false时请求以400结束
+    class PartHandler {
+    public:
+        virtual ~PartHandler() = default;
+        virtual bool OnPartBegin(const Part& part) = 0;
+        virtual bool OnPartData(const char* data, size_t len) = 0;
+        virtual bool OnPartEnd() = 0;
+    };
+
+    MultipartParser() : handler_(nullptr), state_(DONE), in_part_(false) {}
+
+    // 从Content-Type中取得boundary并开始解析，不是合法的multipart/form-data时返回false
+    bool Init(std::string_view content_type, PartHandler* handler);
+    void SetHandler(PartHandler* handler) { handler_ = handler; }
+    PartHandler* Handler() const { return handler_; }
+    void Reset() { state_ = DONE; }
+
+    bool OnData(const char* data, size_t len) override;
+    bool OnFinish() override;  // 收到结束分隔符时返回true
+    int ErrorCode() const override { return 400; }
+
+    // 返回Content-Type中的boundary，不是multipart/form-data时返回空
+    static std::string_view Boundary(std::string_view content_type);
+
+    static const size_t kMaxBoundary = 70;       // RFC 2046规定的boundary最大长度
+    static const size_t kMaxPartHeader = 8192;   // 部分头部的最大长度
+
+private:
+    enum STATE {
+        PREAMBLE,   // 第一个分隔符之前，数据被忽略
+        DATA,       // 部分的数据
+        DELIMITER,  // 分隔符之后的"\r\n"或结束标记"--"
+        HEADER,     // 部分的头部
+        EPILOGUE,   // 结束分隔符之后，数据被忽略
+        DONE,
+        FAILED,
+    };
+
+    // 在[data, data + len)中查找分隔符，返回分隔符的位置，full表示是否完整，
+    // 不完整时返回末尾可能是分隔符前缀的位置，找不到返回len
+    size_t Find_(const char* data, size_t len, bool& full) const;
+    bool Body_(const char*& data, size_t& len);    // PREAMBLE与DATA状态
+    bool Emit_(const char* data, size_t len);      // 将部分的数据交给处理者
+    bool Header_(const char*& data, size_t& len);  // HEADER状态
+    bool Fail_();
+
+    static std::string_view Param_(std::string_view header, std::string_view key);
+
+    PartHandler* handler_;
+    STATE state_;
+    bool in_part_;       // 是否已调用OnPartBegin
+    std::string delim_;  // "\r\n--" + boundary
+    std::string tail_;   // 上一段数据末尾可能是分隔符前缀的字节
+    std::string head_;   // 正在接收的部分头部或分隔符之后的两个字节
+};
+
+// 默认的部分接收者：普通字段保存在内存中，文件部分写入各自的BodyBuffer，超过64KB时溢出到临时文件
+class FormCollector : public MultipartParser::PartHandler {
+public:
+    struct File {
+        std::string name;
+        std::string filename;
+        std::string content_type;
+        BodyBuffer data;
+    };
+
+    FormCollector() : current_(nullptr) {}
+
+    bool OnPartBegin(const MultipartParser::Part& part) override;
+    bool OnPartData(const char* data, size_t len) override;
+    bool OnPartEnd() override;
+
+    void Reset();
+    // 把收到的普通字段追加到fields中，string_view指向本对象的存储，Reset前有效
+    void AppendFields(FormFields& fields) const;
+    const std::vector<std::unique_ptr<File>>& Files() const { return files_; }
+
+    static const size_t kMaxFieldBytes = BodyBuffer::kMemoryLimit;  // 普通字段的总长度上限
+    static const size_t kMaxFiles = 16;                             // 文件部分的数量上限
+
+private:
+    struct Field {
+        size_t name_off, name_len;
+        size_t value_off, value_len;
+    };
+
+    std::string data_;            // 普通字段的名字与值依次存放
+    std::vector<Field> fields_;
+    std::vector<std::unique_ptr<File>> files_;
+    File* current_;               // 正在接收的文件，普通字段时为nullptr
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "httpparser.h"
+
+#include <stdint.h>  // SIZE_MAX
+#include <string.h>  // memcpy
+
+#include <algorithm>
+
+#include "simdscan.h"
+
+namespace {
+
+inline std::string_view TrimSpace(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) str.remove_prefix(1);
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) str.remove_suffix(1);
+    return str;
+}
+
+}  // namespace
+
+const char* HttpParser::FindChar(const char* begin, const char* end, char ch) {
+    return SimdScan::FindChar(begin, end, ch);
+}
+
+const char* HttpParser::FindCrlf(const char* begin, const char* end) {
+    const char* p = begin;
+    while (p < end) {
+        p = SimdScan::FindChar(p, end, '\r');
+        if (p + 1 >= end) return end;  // 没有'\r'或'\r'是最后一个字节
+        if (p[1] == '\n') return p;
+        ++p;
+    }
+    return end;
+}
+
+bool HttpParser::ParseRequestLine(std::string_view line, std::string_view& method, std::string_view& path,
+                                  std::string_view& version) {
+    const char* begin = line.data();
+    const char* end = begin + line.size();
+    const char* sp1 = FindChar(begin, end, ' ');
+    if (sp1 == begin || sp1 == end) return false;
+    const char* sp2 = FindChar(sp1 + 1, end, ' ');
+    if (sp2 == sp1 + 1 || sp2 == end) return false;
+
+    std::string_view proto(sp2 + 1, end - sp2 - 1);
+    if (proto.size() <= 5 || proto.compare(0, 5, "HTTP/") != 0) return false;
+    proto.remove_prefix(5);
+    if (proto.find(' ') != std::string_view::npos) return false;
+
+    method = std::string_view(begin, sp1 - begin);
+    path = std::string_view(sp1 + 1, sp2 - sp1 - 1);
+    version = proto;
+    return true;
+}
+
+bool HttpParser::ParseHeader(std::string_view line, std::string_view& name, std::string_view& value) {
+    const char* begin = line.data();
+    const char* end = begin + line.size();
+    const char* colon = FindChar(begin, end, ':');
+    if (colon == begin || colon == end) return false;
+    name = std::string_view(begin, colon - begin);
+    value = TrimSpace(std::string_view(colon + 1, end - colon - 1));
+    return true;
+}
+
+int HttpParser::Quality(std::string_view list, std::string_view coding) {
+    int any = 0;
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+        // "coding;q=0.5"，没有q参数时权重为1
+        size_t semi = item.find(';');
+        std::string_view name = TrimSpace(item.substr(0, semi));
+        int q = 1000;
+        while (semi != std::string_view::npos) {
+            item.remove_prefix(semi + 1);
+            semi = item.find(';');
+            std::string_view param = TrimSpace(item.substr(0, semi));
+            if (param.size() < 2 || (param[0] != 'q' && param[0] != 'Q') || param[1] != '=') continue;
+            // qvalue = ("0" ["." 0*3DIGIT]) / ("1" ["." 0*3("0")])
+            q = 0;
+            param.remove_prefix(2);
+            if (param.empty() || (param[0] != '0' && param[0] != '1')) break;
+            int scale = 1000;
+            q = (param[0] - '0') * scale;
+            for (size_t i = 2; i < param.size() && i < 5 && param[1] == '.'; ++i) {
+                if (param[i] < '0' || param[i] > '9') break;
+                scale /= 10;
+                q += (param[i] - '0') * scale;
+            }
+            if (q > 1000) q = 1000;
+        }
+
+        if (EqualsNoCase(name, coding)) return q;
+        if (name == "*") any = q;
+    }
+    return any;
+}
+
+bool HttpParser::ParseRange(std::string_view value, size_t size, std::vector<std::pair<size_t, size_t>>& ranges) {
+    ranges.clear();
+    size_t eq = value.find('=');
+    if (eq == std::string_view::npos || !EqualsNoCase(TrimSpace(value.substr(0, eq)), "bytes")) return false;
+    value.remove_prefix(eq + 1);
+
+    // 读取十进制数，溢出时返回false
+    auto parse_num = [](std::string_view str, size_t& num) {
+        if (str.empty()) return false;
+        num = 0;
+        for (char ch : str) {
+            if (ch < '0' || ch > '9' || num > (SIZE_MAX - 9) / 10) return false;
+            num = num * 10 + (ch - '0');
+        }
+        return true;
+    };
+
+    size_t count = 0;
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view spec = TrimSpace(value.substr(0, comma));
+        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+        if (spec.empty()) continue;  // 允许空元素
+        if (++count > kMaxRanges) return false;
+
+        size_t dash = spec.find('-');
+        if (dash == std::string_view::npos) return false;
+        size_t first, last;
+        if (dash == 0) {  // "-n"：最后n个字节
+            if (!parse_num(spec.substr(1), last)) return false;
+            if (last > 0 && size > 0) ranges.emplace_back(last < size ? size - last : 0, size);
+            continue;
+        }
+        if (!parse_num(spec.substr(0, dash), first)) return false;
+        if (dash + 1 == spec.size()) {  // "first-"：到结尾
+            last = SIZE_MAX - 1;
+        } else if (!parse_num(spec.substr(dash + 1), last) || last < first) {
+            return false;
+        }
+        if (first < size) ranges.emplace_back(first, std::min(last, size - 1) + 1);
+    }
+    if (count == 0) return false;
+
+    std::sort(ranges.begin(), ranges.end());
+    size_t n = 0;
+    for (size_t i = 1; i < ranges.size(); ++i) {
+        if (ranges[i].first <= ranges[n].second) {
+            ranges[n].second = std::max(ranges[n].second, ranges[i].second);
+        } else {
+            ranges[++n] = ranges[i];
+        }
+    }
+    if (!ranges.empty()) ranges.resize(n + 1);
+    return true;
+}
+
+bool HttpParser::MatchEtag(std::string_view list, std::string_view etag, bool weak) {
+    if (weak && etag.compare(0, 2, "W/") == 0) etag.remove_prefix(2);
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view tag = TrimSpace(list.substr(0, comma));
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+        if (tag == "*") return true;
+        if (weak && tag.compare(0, 2, "W/") == 0) tag.remove_prefix(2);
+        if (tag == etag) return true;
+    }
+    return false;
+}
+
+bool HttpParser::ParseHttpDate(std::string_view value, time_t& t) {
+    if (value.size() != kHttpDateLen) return false;
+    char buf[kHttpDateLen + 1];
+    memcpy(buf, value.data(), kHttpDateLen);
+    buf[kHttpDateLen] = '\0';
+    struct tm tm = {};
+    const char* end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == nullptr || *end != '\0') return false;
+    t = timegm(&tm);
+    return t != -1;
+}
+
+size_t HttpParser::FormatHttpDate(time_t t, char* buf) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return strftime(buf, kHttpDateLen + 1, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+const char* HttpParser::Impl() { return SimdScan::Name(SimdScan::Best()); }
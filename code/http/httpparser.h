@@ -0,0 +1,52 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+#include <strings.h>  // strncasecmp
+#include <time.h>     // time_t
+
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// HTTP/1.1报文的零拷贝扫描工具，直接在读缓冲区上查找分隔符，返回指向缓冲区的string_view
+// 查找函数使用SimdScan在启动时根据CPU特性选择的AVX2、SSE4.2或标量实现
+class HttpParser {
+public:
+    // 在[begin, end)中查找"\r\n"，返回'\r'的位置，找不到返回end
+    static const char* FindCrlf(const char* begin, const char* end);
+    // 在[begin, end)中查找字符ch，找不到返回end
+    static const char* FindChar(const char* begin, const char* end, char ch);
+
+    // 解析请求行"METHOD PATH HTTP/VERSION"，成功返回true
+    static bool ParseRequestLine(std::string_view line, std::string_view& method, std::string_view& path,
+                                 std::string_view& version);
+    // 解析请求头"Name: value"，去掉value两端的空白，成功返回true
+    static bool ParseHeader(std::string_view line, std::string_view& name, std::string_view& value);
+
+    // 忽略大小写比较
+    static bool EqualsNoCase(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+    }
+
+    // 返回Accept-Encoding等带q值的列表中coding的权重(0~1000)，未列出时使用"*"的权重，都没有时返回0
+    static int Quality(std::string_view list, std::string_view coding);
+
+    // 解析Range请求头"bytes=0-99,200-,-50"，size为资源大小。语法错误或范围过多时返回false(应忽略Range)；
+    // 否则ranges为可满足的范围[begin, end)，按起点排序并合并重叠或相邻的范围，为空时应返回416
+    static bool ParseRange(std::string_view value, size_t size, std::vector<std::pair<size_t, size_t>>& ranges);
+    // If-None-Match等实体标签列表中是否有与etag匹配的标签，"*"匹配任何标签；weak为true时忽略"W/"前缀(弱比较)
+    static bool MatchEtag(std::string_view list, std::string_view etag, bool weak);
+    // 解析IMF-fixdate格式的HTTP日期"Sun, 06 Nov 1994 08:49:37 GMT"，成功返回true
+    static bool ParseHttpDate(std::string_view value, time_t& t);
+    // 按IMF-fixdate格式写入buf(至少kHttpDateLen + 1字节)，返回写入的长度
+    static size_t FormatHttpDate(time_t t, char* buf);
+
+    static const size_t kHttpDateLen = 29;
+    static const size_t kMaxRanges = 16;  // Range请求头中最多的范围数量，过多的小范围放大请求开销
+
+    // 当前使用的查找实现："avx2"、"sse4.2"或"scalar"
+    static const char* Impl();
+};
+
+#endif
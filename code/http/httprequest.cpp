@@ -1,97 +1,212 @@
 #include "httprequest.h"
 using namespace std;
 
-const unordered_set<string> HttpRequest::DEFAULT_HTML{
-    "/index", "/register", "/login", "/welcome", "/video", "/picture",
+const std::string_view HttpRequest::HEADER_NAME[HEADER_COUNT] = {
+    "Accept-Encoding",
+    "Connection",
+    "Content-Length",
+    "Content-Type",
+    "Host",
+    "If-Modified-Since",
+    "If-None-Match",
+    "If-Range",
+    "Range",
+    "Transfer-Encoding",
 };
 
-const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG{
-    {"/register.html", 0},
-    {"/login.html", 1},
-};
+size_t HttpRequest::max_body_size_ = 16 * 1024 * 1024;
 
 void HttpRequest::Init() {
-    method_ = path_ = version_ = body_ = "";
+    method_ = path_ = version_ = std::string_view();
+    head_buf_.clear();
+    keep_alive_ = false;
+    error_code_ = 0;
     state_ = REQUEST_LINE;
+    base_ = nullptr;
+    parsed_ = scanned_ = 0;
+    body_decoder_.Init(BodyDecoder::NONE, 0, 0);
+    body_buf_.Reset();
+    sink_ = &body_buf_;
+    for (auto& value : known_header_) value = std::string_view();
     header_.clear();
-    post_.clear();
+    form_.clear();
+    form_parts_.Reset();
+    multipart_.Reset();
+    params_.clear();
 }
 
-bool HttpRequest::Parse(Buffer& buff) {
-    const char CRLF[] = "\r\n";
-    if (buff.ReadableBytes() <= 0) {  // 没有数据
-        return false;
-    }
-    while (buff.ReadableBytes() && state_ != FINISH) {  // 有数据 且 解析没有结束
-        // 从缓冲区中找到\r\n
-        const char* line_end = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
-        std::string line(buff.Peek(), line_end);
+HttpRequest::PARSE_RESULT HttpRequest::Parse(Buffer& buff) {
+    if (state_ == FINISH) Init();  // 上一个请求已处理完，开始解析新的请求
+
+    // 请求完整前不从缓冲区取走数据，读入新数据时缓冲区可能扩容或整理，需要修正已解析的string_view
+    const char* begin = buff.Peek();
+    const char* end = buff.BeginWriteConst();
+    if (base_ && base_ != begin) Rebase_(begin);
+    base_ = begin;
+
+    while (state_ != FINISH) {
+        if (state_ == BODY) {  // 请求头已从缓冲区取走，请求体从缓冲区头部边读边消费
+            FeedBody(buff);
+            if (body_decoder_.Failed()) return Error_(buff, body_decoder_.ErrorCode());
+            if (!body_decoder_.Done()) return NEED_MORE;
+            if (!sink_->OnFinish()) return Error_(buff, sink_->ErrorCode());
+            ParseBody_();
+            break;
+        }
+
+        const char* cur = begin + parsed_;
+        // 从上次扫描结束的位置继续查找\r\n，已扫描过的字节不再重复扫描
+        const char* line_end = HttpParser::FindCrlf(begin + std::max(parsed_, scanned_), end);
+        if (line_end == end) {
+            size_t len = end - begin;
+            if (len > kMaxHeaderSize) {
+                LOG_WARN("Request header too large");
+                return Error_(buff);
+            }
+            // 最后一个字节可能是'\r'，下次从它开始扫描
+            scanned_ = len > parsed_ ? len - 1 : parsed_;
+            return NEED_MORE;
+        }
+        std::string_view line(cur, line_end - cur);
+        parsed_ = line_end + 2 - begin;
         switch (state_) {
-            case REQUEST_LINE:  // 解析请求行
-                if (!ParseRequestLine_(line)) return false;
-                ParsePath_();
-                break;
-            case HEADERS:  // 解析请求头
-                ParseHeader_(line);
-                // 若只剩下两个字节，即\r\n，说明请求头解析完毕 且 没有请求体，状态转移为FINISH
-                if (buff.ReadableBytes() <= 2) {
-                    state_ = FINISH;
+            case REQUEST_LINE:      // 解析请求行
+                if (line.empty()) {  // 忽略请求之间多余的空行
+                    break;
                 }
+                if (!ParseRequestLine_(line)) return Error_(buff);
                 break;
-            case BODY:  // 解析请求体
-                ParseBody_(line);
+            case HEADERS:  // 解析请求头，遇到空行后根据请求体的分帧方式转移到BODY或FINISH
+                if (!ParseHeader_(line)) return Error_(buff, error_code_ ? error_code_ : 400);
+                if (state_ == BODY) {
+                    DetachHeader_(buff);
+                    begin = end = nullptr;  // 之后不再引用缓冲区中的请求头
+                }
                 break;
             default:
                 break;
         }
-        if (line_end == buff.BeginWrite()) {
-            if (method_ == "POST" && state_ == FINISH) {
-                buff.RetrieveUntil(line_end);
-            }
-            break;
+    }
+    buff.Retrieve(parsed_);  // 请求完整，取走该请求的全部数据，string_view在下一次读取数据前仍然有效
+    base_ = nullptr;
+
+    // 在解析结束时确定，之后缓冲区被覆盖也不受影响
+    keep_alive_ =
+        HttpParser::EqualsNoCase(known_header_[CONNECTION], "keep-alive") && version_ == std::string_view("1.1");
+    LOG_DEBUG("[%.*s], [%.*s], [%.*s]", (int)method_.size(), method_.data(), (int)path_.size(), path_.data(),
+              (int)version_.size(), version_.data());
+    return COMPLETE;
+}
+
+HttpRequest::PARSE_RESULT HttpRequest::Error_(Buffer& buff, int code) {
+    LOG_ERROR("Bad request, code:%d", code);
+    buff.RetrieveAll();  // 连接将被关闭，丢弃剩余数据
+    base_ = nullptr;
+    keep_alive_ = false;
+    error_code_ = code;
+    state_ = FINISH;
+    return ERROR;
+}
+
+void HttpRequest::DetachHeader_(Buffer& buff) {
+    // 请求头最多kMaxHeaderSize字节，复制一次后即可从缓冲区取走，
+    // 请求体不必与请求头一起留在缓冲区中等待完整
+    const char* begin = buff.Peek();
+    head_buf_.assign(begin, parsed_);
+    base_ = begin;
+    Rebase_(head_buf_.data());
+    buff.Retrieve(parsed_);
+    base_ = nullptr;
+    parsed_ = scanned_ = 0;
+    // multipart/form-data的请求体边接收边解析，文件部分不经过body_buf_
+    if (multipart_.Init(known_header_[CONTENT_TYPE], &form_parts_)) sink_ = &multipart_;
+    if (headers_cb_) headers_cb_(*this);
+}
+
+void HttpRequest::FeedBody(Buffer& buff) {
+    if (state_ != BODY || body_decoder_.Done() || body_decoder_.Failed()) return;
+    body_decoder_.Consume(buff, *sink_);
+}
+
+bool HttpRequest::CanSpliceBody() const {
+    return state_ == BODY && sink_ == &body_buf_ && body_decoder_.Framing() == BodyDecoder::LENGTH &&
+           body_decoder_.Received() + body_decoder_.Remaining() > BodyBuffer::kMemoryLimit &&
+           body_decoder_.Remaining() > 0;
+}
+
+ssize_t HttpRequest::SpliceBody(int fd, int* save_errno) {
+    assert(CanSpliceBody());
+    ssize_t len = body_buf_.SpliceFrom(fd, body_decoder_.Remaining(), save_errno);
+    if (len > 0) body_decoder_.Advance(len);
+    return len;
+}
+
+void HttpRequest::Rebase_(const char* new_base) {
+    uintptr_t old_begin = reinterpret_cast<uintptr_t>(base_);
+    uintptr_t old_end = old_begin + parsed_;
+    auto rebase = [&](std::string_view& view) {
+        uintptr_t pos = reinterpret_cast<uintptr_t>(view.data());
+        if (pos >= old_begin && pos < old_end) {
+            view = std::string_view(new_base + (pos - old_begin), view.size());
         }
-        buff.RetrieveUntil(line_end + 2);
+    };
+    rebase(method_);
+    rebase(path_);
+    rebase(version_);
+    for (auto& value : known_header_) rebase(value);
+    for (auto& item : header_) {
+        rebase(item.first);
+        rebase(item.second);
     }
-    LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
-    return true;
 }
 
-std::string HttpRequest::Path() const { return path_; }
+std::string_view HttpRequest::Path() const { return path_; }
 
-std::string& HttpRequest::Path() { return path_; }
+std::string_view HttpRequest::Method() const { return method_; }
 
-std::string HttpRequest::Method() const { return method_; }
+std::string_view HttpRequest::Version() const { return version_; }
 
-std::string HttpRequest::Version() const { return version_; }
+std::string_view HttpRequest::Header(HEADER key) const {
+    assert(key < HEADER_COUNT);
+    return known_header_[key];
+}
 
-std::string HttpRequest::GetPost(const std::string& key) const {
-    assert(key.size());
-    if (post_.count(key) == 1) return post_.find(key)->second;
-    return "";
+std::string_view HttpRequest::Header(std::string_view name) const {
+    for (int i = 0; i < HEADER_COUNT; ++i) {
+        if (HttpParser::EqualsNoCase(name, HEADER_NAME[i])) return known_header_[i];
+    }
+    for (auto& item : header_) {
+        if (HttpParser::EqualsNoCase(name, item.first)) return item.second;
+    }
+    return std::string_view();
 }
 
+std::string HttpRequest::GetPost(const std::string& key) const { return std::string(Form(key)); }
+
 std::string HttpRequest::GetPost(const char* key) const {
     assert(key != nullptr);
-    if (post_.count(key) == 1) {
-        return post_.find(key)->second;
+    return std::string(Form(key));
+}
+
+std::string_view HttpRequest::Form(std::string_view key) const {
+    for (auto& item : form_) {
+        if (item.first == key) return item.second;
     }
-    return "";
+    return std::string_view();
 }
 
-bool HttpRequest::IsKeepAlive() const {
-    if (header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
+std::string_view HttpRequest::Param(std::string_view name) const {
+    for (auto& item : params_) {
+        if (item.first == name) return item.second;
     }
-    return false;
+    return std::string_view();
 }
+
+bool HttpRequest::IsKeepAlive() const { return keep_alive_; }
+
 // 解析请求行
-bool HttpRequest::ParseRequestLine_(const std::string& line) {
-    regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");  // 正则表达式
-    smatch sub_match;
-    if (regex_match(line, sub_match, patten)) {
-        method_ = sub_match[1];
-        path_ = sub_match[2];
-        version_ = sub_match[3];
+bool HttpRequest::ParseRequestLine_(std::string_view line) {
+    if (HttpParser::ParseRequestLine(line, method_, path_, version_)) {
         state_ = HEADERS;  // 状态转移到请求头
         return true;
     }
@@ -99,160 +214,91 @@ bool HttpRequest::ParseRequestLine_(const std::string& line) {
     return false;
 }
 
-void HttpRequest::ParseHeader_(const std::string& line) {
-    regex patten("^([^:]*): ?(.*)$");
-    smatch sub_match;
-    if (regex_match(line, sub_match, patten)) {
-        header_[sub_match[1]] = sub_match[2];
-    } else {  // 匹配不到了，说明是空行，请求头解析结束
-        state_ = BODY;
+bool HttpRequest::ParseHeader_(std::string_view line) {
+    std::string_view name, value;
+    if (line.empty()) {  // 空行，请求头解析结束
+        return StartBody_();
     }
-}
-
-void HttpRequest::ParseBody_(const std::string& line) {
-    body_ = line;
-    ParsePost_();
-    state_ = FINISH;
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
-}
-
-// 解析路径，将路径转换为具体文件路径
-void HttpRequest::ParsePath_() {
-    if (path_ == "/") {
-        path_ = "/index.html";
-    } else {
-        for (auto& item : DEFAULT_HTML) {
-            if (item == path_) {
-                path_ += ".html";
-                break;
-            }
-        }
+    if (!HttpParser::ParseHeader(line, name, value)) {
+        LOG_WARN("Invalid header line");
+        return false;
     }
-}
-// 解析POST请求，即解析请求体
-void HttpRequest::ParsePost_() {
-    // 这里的POST请求只处理了application/x-www-form-urlencoded格式的请求，对于本项目来说只有登录和注册需要提交表单数据
-    if (method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {
-        ParseFromUrlencoded_();
-        if (DEFAULT_HTML_TAG.count(path_)) {
-            int tag = DEFAULT_HTML_TAG.find(path_)->second;
-            LOG_DEBUG("Tag:%d", tag);
-            if (0 == tag || 1 == tag) {  // 0表示注册，1表示登录
-                bool is_login = (tag == 1);
-                // 验证用户名和密码
-                if (UserVerify(post_["username"], post_["password"], is_login)) {
-                    path_ = "/welcome.html";
-                } else {
-                    path_ = "/error.html";
-                }
+    for (int i = 0; i < HEADER_COUNT; ++i) {
+        if (HttpParser::EqualsNoCase(name, HEADER_NAME[i])) {
+            // 重复且取值不同的Content-Length无法确定请求体的边界(RFC 9112 6.3)，直接拒绝
+            if (i == CONTENT_LENGTH && !known_header_[i].empty() && known_header_[i] != value) {
+                LOG_WARN("Conflicting Content-Length");
+                return false;
             }
+            known_header_[i] = value;
+            return true;
         }
     }
+    header_.emplace_back(name, value);
+    return true;
 }
-// 解码，分离出键值对
-void HttpRequest::ParseFromUrlencoded_() {
-    if (body_.empty()) return;
 
-    string key, value;
-    int num = 0, n = body_.size();
-    int i = 0, j = 0;
-
-    for (; i < n; ++i) {
-        char ch = body_[i];
-        switch (ch) {
-            case '=':  // 遇到=，说明key解析完毕
-                key = body_.substr(j, i - j);
-                j = i + 1;
-                break;
-            case '+':  // 遇到+，说明空格
-                body_[i] = ' ';
-                break;
-            case '%':  // 遇到%，说明是十六进制数
-                num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]);
-                body_[i + 2] = num % 10 + '0';
-                body_[i + 1] = num / 10 + '0';
-                i += 2;
-                break;
-            case '&':  // 遇到&，说明value解析完毕
-                value = body_.substr(j, i - j);
-                j = i + 1;
-                post_[key] = value;
-                LOG_DEBUG("%s = %s", key.c_str(), value.c_str());
-                break;
-            default:
-                break;
-        }
-    }
-    assert(j <= i);
-    if (post_.count(key) == 0 && j < i) {
-        value = body_.substr(j, i - j);
-        post_[key] = value;
+bool HttpRequest::ParseContentLength_(std::string_view value, size_t& length) {
+    length = 0;
+    for (char ch : value) {
+        if (ch < '0' || ch > '9') return false;
+        if (length > (SIZE_MAX - 9) / 10) return false;  // 溢出
+        length = length * 10 + (ch - '0');
     }
+    return true;
 }
 
-bool HttpRequest::UserVerify(const std::string& name, const std::string& pwd, bool is_login) {
-    if (name.empty() || pwd.empty()) return false;
-    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
-
-    MYSQL* sql;
-
-    SqlConnRAII sql_raii(&sql, SqlConnPool::Instance());
-    assert(sql);
-
-    bool not_used = false;      // 用户名未被使用过
-  
-    char order[256]{0};
-    MYSQL_RES* res = nullptr;
-
-    if (!is_login) not_used = true;
-    // 查询用户及密码SQL语句
-    snprintf(order, 256, "select username,password from user where username='%s' limit 1", name.c_str());
-    LOG_DEBUG("%s", order);
+bool HttpRequest::StartBody_() {
+    std::string_view encoding = known_header_[TRANSFER_ENCODING];
+    std::string_view length = known_header_[CONTENT_LENGTH];
+    if (!encoding.empty()) {
+        // 只支持chunked；同时带有Content-Length的请求可能被用于请求走私，直接拒绝
+        if (!HttpParser::EqualsNoCase(encoding, "chunked") || !length.empty()) {
+            LOG_WARN("Unsupported Transfer-Encoding");
+            return false;
+        }
+        body_decoder_.Init(BodyDecoder::CHUNKED, 0, max_body_size_);
+        state_ = BODY;
+        return true;
+    }
 
-    // 查询失败
-    if (mysql_query(sql, order)) {
-        mysql_free_result(res);
+    size_t content_length = 0;
+    if (!ParseContentLength_(length, content_length)) {
+        LOG_WARN("Invalid Content-Length");
         return false;
     }
-    res = mysql_store_result(sql);    // 获取结果集
-
-    while (MYSQL_ROW row = mysql_fetch_row(res)) {
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        string password(row[1]);
-        if (is_login) {     // 登录
-            if (pwd == password)
-                not_used = true;
-            else {
-                not_used = false;
-                LOG_DEBUG("pwd error!");
-            }
-        } else {        // 注册
-            not_used = false;
-            LOG_DEBUG("user used!");
-        }
+    if (content_length > max_body_size_) {
+        LOG_WARN("Request body too large: %zu", content_length);
+        error_code_ = 413;
+        return false;
     }
-    mysql_free_result(res);
+    body_decoder_.Init(BodyDecoder::LENGTH, content_length, max_body_size_);
+    state_ = content_length > 0 ? BODY : FINISH;
+    return true;
+}
 
-    if (!is_login && not_used) {        // 注册 且 用户名未被注册
-        LOG_DEBUG("regirster!");
-        bzero(order, 256);
-        // 将用户及密码插入数据库
-        snprintf(order, 256, "insert into user(username,password) values('%s','%s')", name.c_str(), pwd.c_str());
-        LOG_DEBUG("%s", order);
-        if (mysql_query(sql, order)) {
-            LOG_DEBUG("Insert error!");
-            not_used = false;
-        }
-        not_used = true;
+void HttpRequest::ParseBody_() {
+    if (sink_ == &body_buf_) {
+        ParsePost_();
+        LOG_DEBUG("Body len:%zu, in memory:%d", body_buf_.Size(), body_buf_.InMemory());
+    } else if (sink_ == &multipart_ && multipart_.Handler() == &form_parts_) {
+        form_parts_.AppendFields(form_);
+        LOG_DEBUG("Multipart fields:%zu, files:%zu", form_.size(), form_parts_.Files().size());
     }
-
-    LOG_DEBUG("UserVerify success!");
-
-    return not_used;
+    // 请求体由其它接收者消费时，这里不再处理
+    state_ = FINISH;
 }
 
-int HttpRequest::ConverHex(char ch) {
-    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
-    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
-    return ch;
+// 解析POST请求，即解析请求体
+void HttpRequest::ParsePost_() {
+    // 只解析application/x-www-form-urlencoded格式的表单，表单参数由登录注册等处理函数通过GetPost/Form读取
+    // 表单只在内存中原地解码，字段指向body_buf_，溢出到文件的请求体不是表单
+    std::string_view type = known_header_[CONTENT_TYPE];
+    type = type.substr(0, type.find(';'));
+    while (!type.empty() && (type.back() == ' ' || type.back() == '\t')) type.remove_suffix(1);
+    if (method_ == "POST" && HttpParser::EqualsNoCase(type, "application/x-www-form-urlencoded") &&
+        body_buf_.InMemory()) {
+        std::string& body = body_buf_.Memory();
+        FormDecoder::ParseUrlencoded(body.data(), body.size(), form_);
+    }
 }
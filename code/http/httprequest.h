@@ -2,17 +2,21 @@
 #define HTTP_REQUEST_H
 
 #include <errno.h>
-#include <mysql/mysql.h>  //mysql
 
-#include <regex>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <string_view>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
-#include "../pool/sqlconnRAII.h"
-#include "../pool/sqlconnpool.h"
+#include "httpbody.h"
+#include "httpform.h"
+#include "httpparser.h"
 
 class HttpRequest {
 public:
@@ -23,6 +27,12 @@ public:
         BODY,          // 请求体
         FINISH,        // 解析完成
     };
+    // Parse的返回值
+    enum PARSE_RESULT {
+        NEED_MORE,  // 请求不完整，等待更多数据后继续解析
+        COMPLETE,   // 得到了完整的请求
+        ERROR,      // 请求有语法错误
+    };
     // 解析结果
     enum HTTP_CODE {
         NO_REQUEST = 0,      // 请求不完整，需要继续读取
@@ -35,40 +45,103 @@ public:
         CLOSED_CONNECTION,   // 客户端已经关闭连接
     };
 
-    HttpRequest() { Init(); }
+    // 常用请求头，解析时直接存入固定的槽位
+    enum HEADER {
+        ACCEPT_ENCODING = 0,
+        CONNECTION,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        HOST,
+        IF_MODIFIED_SINCE,
+        IF_NONE_MATCH,
+        IF_RANGE,
+        RANGE,
+        TRANSFER_ENCODING,
+        HEADER_COUNT,
+    };
+
+    HttpRequest() : sink_(&body_buf_) { Init(); }
     ~HttpRequest() = default;
 
     void Init();
-    bool Parse(Buffer& buff);
+    // 解析缓冲区中的请求，可跨多次读取恢复：解析状态与扫描位置会被保留，已扫描的字节不会重复扫描。
+    // 请求完整时从缓冲区取走该请求的数据并返回COMPLETE
+    PARSE_RESULT Parse(Buffer& buff);
+    // 请求头解析完成后，读取到的请求体数据可以立即交给接收者，读缓冲区不随请求体大小增长
+    void FeedBody(Buffer& buff);
+    // 请求体较大且由默认接收者保存时，直接从socket经splice写入临时文件
+    bool CanSpliceBody() const;
+    ssize_t SpliceBody(int fd, int* save_errno);
+
+    // 请求头解析完成且有请求体时调用，可在其中通过SetBodySink让处理函数逐段消费请求体
+    void SetHeadersCallback(std::function<void(HttpRequest&)> callback) { headers_cb_ = std::move(callback); }
+    void SetBodySink(BodySink* sink) { sink_ = sink ? sink : &body_buf_; }
 
-    std::string Path() const;
-    std::string& Path();
-    std::string Method() const;
-    std::string Version() const;
+    // 以下string_view指向读缓冲区(或请求内部)，在下一次读取数据前有效
+    std::string_view Path() const;
+    std::string_view Method() const;
+    std::string_view Version() const;
+    std::string_view Header(HEADER key) const;
+    std::string_view Header(std::string_view name) const;
+    // 表单字段：urlencoded请求体原地解码后建立索引，multipart/form-data的普通字段由FormCollector保存
     std::string GetPost(const std::string& key) const;
     std::string GetPost(const char* key) const;
+    std::string_view Form(std::string_view key) const;  // 不复制，请求处理完前有效
+    const FormFields& Forms() const { return form_; }
+    // multipart/form-data中的文件部分，超过64KB的文件在临时文件中
+    const std::vector<std::unique_ptr<FormCollector::File>>& Files() const { return form_parts_.Files(); }
+    // multipart/form-data的请求体默认由FormCollector接收，可在请求头回调中换成自己的处理者逐段消费各部分
+    void SetPartHandler(MultipartParser::PartHandler* handler) { multipart_.SetHandler(handler); }
+    // 路由匹配得到的路径参数，由Router在分发前设置
+    void SetParam(std::string_view name, std::string_view value) { params_.emplace_back(name, value); }
+    std::string_view Param(std::string_view name) const;
+    // 由默认接收者保存的请求体，不超过BodyBuffer::kMemoryLimit时在内存中，否则在临时文件中
+    BodyBuffer& Body() { return body_buf_; }
 
     bool IsKeepAlive() const;
+    // 上一个请求已处理完且没有开始解析下一个请求，请求对象可以还给缓存
+    bool Idle() const { return state_ == FINISH || (state_ == REQUEST_LINE && parsed_ == 0 && scanned_ == 0); }
+    int ErrorCode() const { return error_code_; }  // 解析出错时对应的响应状态码
+    PARSE_STATE State() const { return state_; }
+
+    static size_t max_body_size_;  // 请求体的最大长度，超过时返回413
 
 private:
-    bool ParseRequestLine_(const std::string& line);  // 解析请求行
-    void ParseHeader_(const std::string& line);       // 解析请求头
-    void ParseBody_(const std::string& line);         // 解析请求体
+    bool ParseRequestLine_(std::string_view line);  // 解析请求行
+    bool ParseHeader_(std::string_view line);       // 解析请求头
+    bool StartBody_();                              // 请求头结束，确定请求体的分帧方式
+    void DetachHeader_(Buffer& buff);               // 将请求行与请求头复制到head_buf_，之后的请求体可以边读边消费
+    void ParseBody_();                              // 解析请求体
+    PARSE_RESULT Error_(Buffer& buff, int code = 400);  // 解析出错
+    void Rebase_(const char* new_base);             // 缓冲区数据被移动后，修正指向缓冲区的string_view
+
+    static bool ParseContentLength_(std::string_view value, size_t& length);
 
-    void ParsePath_();            // 解析路径
     void ParsePost_();            // 解析post请求
-    void ParseFromUrlencoded_();  // 解析url编码
 
-    static bool UserVerify(const std::string& name, const std::string& pwd, bool is_login);
+    PARSE_STATE state_;                                // 解析状态
+    const char* base_;                                 // 上次解析时请求在缓冲区中的起始位置
+    size_t parsed_;                                    // 已解析的字节数(相对于请求起始位置)
+    size_t scanned_;                                   // 已扫描的字节数，不完整的行不重复扫描
+    std::string_view method_, path_, version_;         // 请求方法，请求路径，http版本
+    std::string head_buf_;                             // 有请求体时，请求行与请求头的副本
+    bool keep_alive_;                                  // 是否保持连接
+    int error_code_;                                   // 解析出错时对应的响应状态码
+    std::string_view known_header_[HEADER_COUNT];      // 常用请求头
+    std::vector<std::pair<std::string_view, std::string_view>> header_;  // 其它请求头
+    FormFields form_;                                  // 表单字段
+    std::vector<std::pair<std::string_view, std::string_view>> params_;  // 路径参数
+
+    BodyDecoder body_decoder_;                         // 请求体解码器
+    BodyBuffer body_buf_;                              // 默认的请求体接收者
+    BodySink* sink_;                                   // 当前请求的请求体接收者
+    MultipartParser multipart_;                        // multipart/form-data请求体的解析器
+    FormCollector form_parts_;                         // 默认的multipart部分接收者
+    std::function<void(HttpRequest&)> headers_cb_;     // 请求头解析完成的回调
 
-    PARSE_STATE state_;                                    // 解析状态
-    std::string method_, path_, version_, body_;           // 请求方法，请求路径，http版本，请求体
-    std::unordered_map<std::string, std::string> header_;  // 请求头
-    std::unordered_map<std::string, std::string> post_;    // post请求参数
+    static const std::string_view HEADER_NAME[HEADER_COUNT];  // 常用请求头的名称
+    static const size_t kMaxHeaderSize = 65536;               // 请求行与请求头的最大长度
 
-    static const std::unordered_set<std::string> DEFAULT_HTML;           //  默认的html文件
-    static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;  // 默认的html文件对应的tag
-    static int ConverHex(char ch);                                       // 将十六进制转换为十进制
 };
 
 #endif
\ No newline at end of file
@@ -6,69 +6,316 @@ const std::unordered_map<std::string, std::string> HttpResponse::SUFFIX_TYPE = {
     {".word", "application/nsword"}, {".png", "image/png"},         {".gif", "image/gif"},
     {".jpg", "image/jpeg"},          {".jpeg", "image/jpeg"},       {".au", "audio/basic"},
     {".mpeg", "video/mpeg"},         {".mpg", "video/mpeg"},        {".avi", "video/x-msvideo"},
-    {".gz", "application/x-gzip"},   {".tar", "application/x-tar"}, {".css", "text/css "},
-    {".js", "text/javascript "},
+    {".gz", "application/x-gzip"},   {".tar", "application/x-tar"}, {".css", "text/css"},
+    {".js", "text/javascript"},
+};
+
+// 按后缀的缓存策略：页面每次向服务器验证(带ETag，未变化时为304)，样式与脚本缓存一天，图片与媒体缓存一周
+const std::unordered_map<std::string, std::string> HttpResponse::SUFFIX_CACHE_CONTROL = {
+    {".html", "no-cache"},
+    {".xhtml", "no-cache"},
+    {".css", "public, max-age=86400"},
+    {".js", "public, max-age=86400"},
+    {".png", "public, max-age=604800"},
+    {".gif", "public, max-age=604800"},
+    {".jpg", "public, max-age=604800"},
+    {".jpeg", "public, max-age=604800"},
+    {".ico", "public, max-age=604800"},
+    {".mp4", "public, max-age=604800"},
+    {".mpeg", "public, max-age=604800"},
+    {".mpg", "public, max-age=604800"},
+    {".avi", "public, max-age=604800"},
 };
 
 const std::unordered_map<int, std::string> HttpResponse::CODE_STATUS = {
     {200, "OK"},
+    {206, "Partial Content"},
+    {304, "Not Modified"},
     {400, "Bad Request"},
     {403, "Forbidden"},
     {404, "Not Found"},
+    {413, "Payload Too Large"},
+    {416, "Range Not Satisfiable"},
+    {431, "Request Header Fields Too Large"},
+    {500, "Internal Server Error"},
 };
 
+const std::string_view HttpResponse::KEEP_ALIVE_HEADER = "Connection: keep-alive\r\nkeep-alive: max=6,timeout=120\r\n";
+const std::string_view HttpResponse::CLOSE_HEADER = "Connection: close\r\n";
+const std::string_view HttpResponse::ACCEPT_RANGES_HEADER = "Accept-Ranges: bytes\r\n";
+
 const std::unordered_map<int, std::string> HttpResponse::CODE_PATH = {
     {400, "/400.html"},
     {403, "/403.html"},
     {404, "/404.html"},
 };
 
-HttpResponse::HttpResponse() : code_(-1), is_keep_alive_(false), mm_file_(nullptr) { mm_file_stat_ = {0}; }
+HttpResponse::HttpResponse()
+    : code_(-1),
+      is_keep_alive_(false),
+      gzip_q_(0),
+      deflate_q_(0),
+      vary_(false),
+      range_len_(0),
+      head_only_(false),
+      has_content_(false),
+      compressing_(false) {}
 
-HttpResponse::~HttpResponse() { UnmapFile(); }
+HttpResponse::~HttpResponse() { ReleaseFile(); }
 
-void HttpResponse::Init(const std::string& src_dir, std::string& path, bool is_keep_alive, int code) {
+void HttpResponse::Init(std::string_view src_dir, std::string_view path, bool is_keep_alive, int code) {
     assert(src_dir.size());
-    if (mm_file_) {
-        UnmapFile();
-    }
+    ReleaseFile();
 
     code_ = code;
     is_keep_alive_ = is_keep_alive;
-    path_ = path;
+    path_.assign(path.data(), path.size());
     src_dir_ = src_dir;
-    mm_file_ = nullptr;
-    mm_file_stat_ = {0};
+    error_msg_.clear();
+    gzip_q_ = 0;
+    deflate_q_ = 0;
+    encoding_ = std::string_view();
+    vary_ = false;
+    range_.clear();
+    if_range_.clear();
+    ranges_.clear();
+    range_tail_.clear();
+    boundary_.clear();
+    range_type_.clear();
+    content_range_.clear();
+    range_len_ = 0;
+    if_none_match_.clear();
+    if_modified_since_.clear();
+    etag_ = last_modified_ = cache_control_ = std::string_view();
+    head_only_ = false;
+    has_content_ = false;
+    compressing_ = false;
+    content_.clear();
+    content_type_.clear();
 }
 
-void HttpResponse::MakeResponse(Buffer& buff) {
-    // 判断请求的资源文件
-    if (stat((src_dir_ + path_).c_str(), &mm_file_stat_) < 0 || S_ISDIR(mm_file_stat_.st_mode)) {
-        code_ = 404;  // 资源文件不存在
-    } else if (!(mm_file_stat_.st_mode & S_IROTH)) {
-        code_ = 403;  // 没有读取权限
-    } else if (code_ == -1) {
-        code_ = 200;  // 请求成功
+void HttpResponse::SetAcceptEncoding(std::string_view accept_encoding) {
+    gzip_q_ = HttpParser::Quality(accept_encoding, "gzip");
+    deflate_q_ = HttpParser::Quality(accept_encoding, "deflate");
+}
+
+void HttpResponse::SetRange(std::string_view range, std::string_view if_range) {
+    range_.assign(range.data(), range.size());
+    if_range_.assign(if_range.data(), if_range.size());
+}
+
+void HttpResponse::SetConditional(std::string_view if_none_match, std::string_view if_modified_since) {
+    if_none_match_.assign(if_none_match.data(), if_none_match.size());
+    if_modified_since_.assign(if_modified_since.data(), if_modified_since.size());
+}
+
+void HttpResponse::SetContent(std::string content, std::string type) {
+    has_content_ = true;
+    content_ = std::move(content);
+    content_type_ = std::move(type);
+}
+
+void HttpResponse::AppendContent(std::string_view data) {
+    if (!has_content_) return;  // 压缩出错，已改为500错误页面
+    if (compressing_) {
+        if (!Compressor::Local().Update(data.data(), data.size(), CompressBuffer_())) CompressError_();
+        return;
     }
+    content_.append(data.data(), data.size());
+    Compressor::ENCODING encoding;
+    if (!CompressEncoding_(content_.size(), encoding)) return;
+    Buffer& out = CompressBuffer_();
+    out.RetrieveAll();
+    Compressor& compressor = Compressor::Local();
+    if (compressor.Begin(encoding, Compressor::level_) && compressor.Update(content_.data(), content_.size(), out)) {
+        compressing_ = true;
+        encoding_ = Compressor::Name(encoding);
+        content_.clear();
+    }
+}
+
+void HttpResponse::CompressError_() {
+    // 已送入压缩器的正文无法还原，改为返回500错误页面
+    compressing_ = false;
+    has_content_ = false;
+    encoding_ = std::string_view();
+    vary_ = false;
+    content_.clear();
+    code_ = 500;
+}
 
-    ErrorHtml_();  // 如果错误，生成错误页面
+void HttpResponse::MakeResponse(Buffer& buff) {
+    Prepare();
     AddStateLine_(buff);
     AddHeader_(buff);
     AddContent_(buff);
 }
 
-void HttpResponse::UnmapFile() {
-    if (mm_file_) {
-        munmap(mm_file_, mm_file_stat_.st_size);
-        mm_file_ = nullptr;
+void HttpResponse::Prepare() {
+    if (has_content_) {  // 处理函数生成的正文
+        if (code_ == -1) code_ = 200;
+        if (StatusLine_(code_).empty()) code_ = 500;
+        CompressContent_();
+        if (has_content_) return;  // 分段压缩出错时改为下面的错误页面
+    }
+
+    // 判断请求的资源文件，已确定错误码(如请求格式错误)时直接返回对应的错误页面
+    // 文件内容与打开失败的结果都由进程内的文件缓存共享，命中时不访问文件系统
+    if (code_ < 400) {
+        file_ = FileCache::Instance().Get(src_dir_, path_);
+        if (file_->err == EACCES) {
+            code_ = 403;  // 没有读取权限
+        } else if (file_->err) {
+            code_ = 404;  // 资源文件不存在
+        } else if (code_ == -1) {
+            code_ = 200;  // 请求成功
+        }
+    }
+
+    if (code_ == 200) {
+        // 有Range时发送未压缩的文件，范围按原文件计算
+        SelectEncoding_(!range_.empty());
+        etag_ = file_->etag;
+        last_modified_ = file_->last_modified;
+        cache_control_ = SuffixCacheControl_(path_);
+        if (NotModified_()) {
+            code_ = 304;  // 客户端缓存仍然有效，只发送响应头
+        } else {
+            ApplyRange_();
+        }
     }
+
+    if (StatusLine_(code_).empty()) code_ = 400;
+    ErrorHtml_();  // 如果错误，改为对应的错误页面
+    if (code_ >= 400 && file_) SelectEncoding_(false);
+    if (!file_ && !error_msg_.empty()) {
+        SetContent(ErrorBody(), "text/html");
+        CompressContent_();
+    }
+}
+
+bool HttpResponse::CompressEncoding_(size_t len, Compressor::ENCODING& encoding) {
+    if (!Compressor::enable_ || len < Compressor::min_size_) return false;
+    if (!Compressor::Compressible(content_type_)) return false;
+    vary_ = true;
+    if (gzip_q_ == 0 && deflate_q_ == 0) return false;
+    // 两者都接受时优先gzip，除非deflate的q值更高
+    encoding = gzip_q_ >= deflate_q_ ? Compressor::GZIP : Compressor::DEFLATE;
+    return true;
 }
 
-char* HttpResponse::File() { return mm_file_; }
+Buffer& HttpResponse::CompressBuffer_() {
+    // 压缩到线程内复用的缓冲区，避免每个响应重新分配；处理函数与Prepare在同一线程中依次执行
+    thread_local Buffer out;
+    return out;
+}
 
-size_t HttpResponse::FileLen() const { return mm_file_stat_.st_size; }
+void HttpResponse::CompressContent_() {
+    Buffer& out = CompressBuffer_();
+    Compressor& compressor = Compressor::Local();
+    if (compressing_) {  // 分段送入的正文已压缩，输出剩余的数据(不再与原文比较大小)
+        compressing_ = false;
+        if (!compressor.Finish(out)) {
+            CompressError_();
+            return;
+        }
+        content_.assign(out.Peek(), out.ReadableBytes());
+        out.RetrieveAll();
+        return;
+    }
 
-void HttpResponse::ErrorContent(Buffer& buff, std::string message) {
+    Compressor::ENCODING encoding;
+    if (!CompressEncoding_(content_.size(), encoding)) return;
+    out.RetrieveAll();
+    if (!compressor.Begin(encoding, Compressor::level_) ||
+        !compressor.Update(content_.data(), content_.size(), out) || !compressor.Finish(out)) {
+        return;
+    }
+    if (out.ReadableBytes() >= content_.size()) return;  // 压缩无收益时发送原文
+    content_.assign(out.Peek(), out.ReadableBytes());
+    encoding_ = Compressor::Name(encoding);
+}
+
+void HttpResponse::SelectEncoding_(bool identity) {
+    if (!file_->vary) return;
+    vary_ = true;  // 有压缩版本的文件，按客户端的Accept-Encoding选择；压缩版本还在生成时发送原文件
+    if (gzip_q_ > 0 && !identity) {
+        std::shared_ptr<const CachedFile> gzip = file_->Gzip();
+        if (!gzip) return;
+        file_ = std::move(gzip);
+        encoding_ = "gzip";
+    }
+}
+
+bool HttpResponse::NotModified_() const {
+    // If-None-Match优先，存在时忽略If-Modified-Since；ETag按弱比较
+    if (!if_none_match_.empty()) return HttpParser::MatchEtag(if_none_match_, etag_, true);
+    time_t since;
+    return !if_modified_since_.empty() && HttpParser::ParseHttpDate(if_modified_since_, since) &&
+           file_->st.st_mtime <= since;
+}
+
+void HttpResponse::ApplyRange_() {
+    if (range_.empty()) return;
+    if (!if_range_.empty()) {
+        // If-Range为实体标签时按强比较，为日期时与修改时间相同才有效；不匹配说明文件已变化，发送整个文件
+        time_t mtime;
+        if (if_range_[0] == '"' || if_range_.compare(0, 2, "W/") == 0) {
+            if (!HttpParser::MatchEtag(if_range_, etag_, false) || if_range_ == "*") return;
+        } else if (!HttpParser::ParseHttpDate(if_range_, mtime) || mtime != file_->st.st_mtime) {
+            return;
+        }
+    }
+    thread_local std::vector<std::pair<size_t, size_t>> ranges;
+    if (!HttpParser::ParseRange(range_, file_->size, ranges)) return;  // 语法错误时忽略Range
+
+    std::string size = std::to_string(file_->size);
+    if (ranges.empty()) {  // 没有可满足的范围
+        code_ = 416;
+        content_range_ = "bytes */" + size;
+        return;
+    }
+    code_ = 206;
+    auto content_range = [&size](const std::pair<size_t, size_t>& range) {
+        return "bytes " + std::to_string(range.first) + "-" + std::to_string(range.second - 1) + "/" + size;
+    };
+    if (ranges.size() == 1) {
+        content_range_ = content_range(ranges[0]);
+        range_len_ = ranges[0].second - ranges[0].first;
+        ranges_.push_back({ranges[0].first, range_len_, std::string()});
+        return;
+    }
+
+    // 多个范围：multipart/byteranges，各部分带自己的Content-Type与Content-Range
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    char boundary[17];
+    snprintf(boundary, sizeof(boundary), "%016llx", (unsigned long long)rng());
+    std::string_view type = GetFileType_();
+    boundary_ = boundary;
+    range_type_ = "multipart/byteranges; boundary=" + boundary_;
+    for (const auto& range : ranges) {
+        std::string head = ranges_.empty() ? "--" : "\r\n--";
+        head += boundary_ + "\r\nContent-Type: ";
+        head += type;
+        head += "\r\nContent-Range: " + content_range(range) + "\r\n\r\n";
+        range_len_ += head.size() + range.second - range.first;
+        ranges_.push_back({range.first, range.second - range.first, std::move(head)});
+    }
+    range_tail_ = "\r\n--" + boundary_ + "--\r\n";
+    range_len_ += range_tail_.size();
+}
+
+void HttpResponse::ReleaseFile() { file_.reset(); }
+
+size_t HttpResponse::FileLen() const { return file_ ? file_->size : 0; }
+
+size_t HttpResponse::BodyLen() const {
+    if (has_content_) return content_.size();
+    if (code_ == 304) return 0;
+    return ranges_.empty() ? FileLen() : range_len_;
+}
+
+std::string HttpResponse::ErrorBody() const {
     std::string body, status;
     body += "<html><title>Error</title>";
     body += "<body bgcolor=\"ffffff\"";
@@ -80,71 +327,129 @@ void HttpResponse::ErrorContent(Buffer& buff, std::string message) {
     }
 
     body += std::to_string(code_) + " : " + status + "\n";
-    body += "<p>" + message + "</p>";
+    body += "<p>" + error_msg_ + "</p>";
     body += "<hr><em>TinyWebServer</em></body></html>";
+    return body;
+}
 
-    buff.Append("Content-length: " + std::to_string(body.size()) + "\r\n\r\n");
-    buff.Append(body);
+const std::string& HttpResponse::StatusLine_(int code) {
+    // 以状态码为下标的状态行"HTTP/1.1 200 OK\r\n"，由CODE_STATUS生成一次；未知状态码为空
+    static const std::vector<std::string> lines = [] {
+        std::vector<std::string> lines(kMaxCode);
+        for (const auto& [code, status] : CODE_STATUS) {
+            lines[code] = "HTTP/1.1 " + std::to_string(code) + " " + status + "\r\n";
+        }
+        return lines;
+    }();
+    static const std::string empty;
+    return code >= 0 && code < kMaxCode ? lines[code] : empty;
 }
 
-void HttpResponse::AddStateLine_(Buffer& buff) {
-    std::string status;
-    if (CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    } else {
-        code_ = 400;
-        status = CODE_STATUS.find(code_)->second;
+void HttpResponse::BuildFileHeader(std::string_view path, std::string_view encoding, bool vary, CachedFile& file) {
+    file.type_header = "Content-type: ";
+    file.type_header += SuffixType_(path);
+    file.type_header += "\r\n";
+
+    file.encoding_header.clear();
+    if (!encoding.empty()) {
+        file.encoding_header = "Content-Encoding: ";
+        file.encoding_header += encoding;
+        file.encoding_header += "\r\n";
+    }
+    if (vary) file.encoding_header += "Vary: Accept-Encoding\r\n";
+
+    file.validator_header = "ETag: " + file.etag + "\r\nLast-Modified: " + file.last_modified + "\r\n";
+    std::string_view cache_control = SuffixCacheControl_(path);
+    if (!cache_control.empty()) {
+        file.validator_header += "Cache-Control: ";
+        file.validator_header += cache_control;
+        file.validator_header += "\r\n";
     }
-    buff.Append("HTTP/1.1 " + std::to_string(code_) + " " + status + "\r\n");
 }
 
+void HttpResponse::AddStateLine_(Buffer& buff) { Append_(buff, StatusLine_(code_)); }
+
 void HttpResponse::AddHeader_(Buffer& buff) {
-    buff.Append("Connection: ");
-    if (is_keep_alive_) {
-        buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6,timeout=120\r\n");
+    Append_(buff, TimeService::DateHeader());  // 每秒只格式化一次
+    Append_(buff, is_keep_alive_ ? KEEP_ALIVE_HEADER : CLOSE_HEADER);
+    if (file_) {  // 资源文件不随请求变化的响应头在载入缓存时已生成
+        if (code_ != 304) {
+            if (range_type_.empty()) {
+                Append_(buff, file_->type_header);
+            } else {
+                Append_(buff, "Content-type: ");
+                Append_(buff, range_type_);
+                Append_(buff, "\r\n");
+            }
+        }
+        Append_(buff, file_->encoding_header);
+        if (code_ == 200 || code_ == 206 || code_ == 304) Append_(buff, file_->validator_header);
+        if (AcceptRanges()) Append_(buff, ACCEPT_RANGES_HEADER);
     } else {
-        buff.Append("close\r\n");
+        Append_(buff, "Content-type: ");
+        Append_(buff, content_type_);
+        Append_(buff, "\r\n");
+        if (!encoding_.empty()) {
+            Append_(buff, "Content-Encoding: ");
+            Append_(buff, encoding_);
+            Append_(buff, "\r\n");
+        }
+        if (vary_) Append_(buff, "Vary: Accept-Encoding\r\n");
+    }
+    if (!content_range_.empty()) {
+        Append_(buff, "Content-Range: ");
+        Append_(buff, content_range_);
+        Append_(buff, "\r\n");
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
 }
 
 void HttpResponse::AddContent_(Buffer& buff) {
-    int src_fd = open((src_dir_ + path_).c_str(), O_RDONLY);  // 打开文件
-    if (src_fd < 0) {
-        ErrorContent(buff, "File NotFound!");
+    if (code_ == 304) {  // 304响应没有正文
+        Append_(buff, "\r\n");
         return;
     }
+    char line[48] = "Content-length: ";
+    char* end = std::to_chars(line + 16, line + sizeof(line) - 4, BodyLen()).ptr;
+    memcpy(end, "\r\n\r\n", 4);
+    buff.Append(line, end + 4 - line);
+    if (has_content_ && !head_only_) Append_(buff, content_);
+}
 
-    // 将文件映射到内存提高文件的访问速度
-    // MAP_PRIVATE 建立一个写时拷贝的私有映射
-    LOG_DEBUG("file path %s", (src_dir_ + path_).c_str());
-    int* mm_ret = (int*)mmap(0, mm_file_stat_.st_size, PROT_READ, MAP_PRIVATE, src_fd, 0);
-    if (*mm_ret == -1) {
-        ErrorContent(buff, "File NotFound!");
+void HttpResponse::ErrorHtml_() {
+    if (code_ < 400) return;
+    file_.reset();
+    etag_ = last_modified_ = cache_control_ = std::string_view();  // 错误页面不带校验器，不缓存
+    auto it = CODE_PATH.find(code_);
+    if (it == CODE_PATH.end()) {  // 没有对应错误页面的状态码
+        error_msg_ = CODE_STATUS.find(code_)->second;
         return;
     }
-    // 将文件映射到内存
-    mm_file_ = (char*)mm_ret;
-    close(src_fd);
-    buff.Append("Content-length: " + std::to_string(mm_file_stat_.st_size) + "\r\n\r\n");
+    path_ = it->second;
+    file_ = FileCache::Instance().Get(src_dir_, path_);
+    if (file_->err) {
+        file_.reset();
+        error_msg_ = "File NotFound!";
+    }
 }
 
-void HttpResponse::ErrorHtml_() {
-    if (CODE_PATH.count(code_) == 1) {
-        path_ = CODE_PATH.find(code_)->second;
-        stat((src_dir_ + path_).c_str(), &mm_file_stat_);
-    }
+std::string_view HttpResponse::GetFileType_() const {
+    if (has_content_) return content_type_;
+    if (!range_type_.empty()) return range_type_;
+    return SuffixType_(path_);
 }
 
-std::string HttpResponse::GetFileType_() {
-    std::string::size_type idx = path_.find_last_of('.');
-    if (idx == std::string::npos) {  // 没有后缀
+std::string_view HttpResponse::SuffixType_(std::string_view path) {
+    std::string_view::size_type idx = path.find_last_of("./");
+    if (idx == std::string_view::npos || path[idx] != '.') {  // 没有后缀
         return "text/plain";
     }
-    std::string suffix = path_.substr(idx);       // 获取后缀
-    if (SUFFIX_TYPE.count(suffix) == 1) {         // 判断后缀是否存在
-        return SUFFIX_TYPE.find(suffix)->second;  // 存在返回对应的类型
-    }
-    return "text/plain";
+    auto it = SUFFIX_TYPE.find(std::string(path.substr(idx)));
+    return it == SUFFIX_TYPE.end() ? "text/plain" : std::string_view(it->second);
+}
+
+std::string_view HttpResponse::SuffixCacheControl_(std::string_view path) {
+    std::string_view::size_type idx = path.find_last_of("./");
+    if (idx == std::string_view::npos || path[idx] != '.') return std::string_view();
+    auto it = SUFFIX_CACHE_CONTROL.find(std::string(path.substr(idx)));
+    return it == SUFFIX_CACHE_CONTROL.end() ? std::string_view() : std::string_view(it->second);
 }
@@ -1,28 +1,88 @@
 #ifndef HTTP_RESPONSE_H
 #define HTTP_RESPONSE_H
 
-#include <fcntl.h>     // open
-#include <sys/mman.h>  // mmap, munmap
-#include <sys/stat.h>  // stat
-#include <unistd.h>    // close
+#include <stdio.h>   // snprintf
+#include <string.h>  // memcpy
+#include <time.h>    // time
 
+#include <charconv>  // to_chars
+#include <memory>
+#include <random>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "../timer/timeservice.h"
+#include "compressor.h"
+#include "filecache.h"
+#include "httpparser.h"
 
 class HttpResponse {
 public:
     HttpResponse();
     ~HttpResponse();
 
-    void Init(const std::string& src_dir, std::string& path, bool is_keep_alive = false, int code = -1);
+    void Init(std::string_view src_dir, std::string_view path, bool is_keep_alive = false, int code = -1);
     void MakeResponse(Buffer& buff);                       // 根据请求报文生成响应报文
-    void UnmapFile();                                      // 解除文件映射
-    char* File();                                          // 返回文件映射内存起始地址
+    // 确定状态码并从文件缓存取得资源文件，MakeResponse会调用；HTTP/2等自行组织响应头时单独调用
+    void Prepare();
+    void ReleaseFile();                                    // 释放对资源文件的引用
     size_t FileLen() const;                                // 返回文件大小
-    void ErrorContent(Buffer& buff, std::string message);  // 返回错误信息
+    size_t BodyLen() const;                                // 返回正文长度(Content-Length)
+    // 资源文件，没有时为空；输出队列持有它直到文件内容发送完，大文件只有fd，由sendfile发送
+    const std::shared_ptr<const CachedFile>& FileRef() const { return file_; }
     int Code() const { return code_; }                     // 返回状态码
+    std::string_view FileType() const { return GetFileType_(); }  // 返回正文的类型
+    std::string ErrorBody() const;                         // 没有映射文件时的错误页面
+
+    // 请求的Accept-Encoding，Init之后、Prepare之前设置，可压缩的资源文件按其选择gzip版本，
+    // 内存中的正文按其在Prepare时用当前线程的压缩器压缩
+    void SetAcceptEncoding(std::string_view accept_encoding);
+    std::string_view ContentEncoding() const { return encoding_; }  // 正文的编码，未压缩时为空
+    bool Vary() const { return vary_; }  // 正文随Accept-Encoding变化，需要Vary响应头
+
+    // 资源文件的一个字节范围，multipart/byteranges中每个部分之前有分隔行与部分头
+    struct ByteRange {
+        size_t offset;     // 在文件中的偏移
+        size_t len;        // 长度
+        std::string head;  // 该部分之前的分隔行与部分头，只有一个范围时为空
+    };
+    // GET请求的Range与If-Range，Init之后、Prepare之前设置，If-Range与文件的Last-Modified相同时才按范围响应
+    void SetRange(std::string_view range, std::string_view if_range);
+    // Prepare之后，206响应只发送资源文件的这些范围，多个范围时依次发送各部分头与范围，最后是RangeTail
+    const std::vector<ByteRange>& Ranges() const { return ranges_; }
+    const std::string& RangeTail() const { return range_tail_; }
+    const std::string& ContentRange() const { return content_range_; }  // Content-Range响应头，没有时为空
+    bool AcceptRanges() const { return file_ && (code_ == 200 || code_ == 206); }  // 资源文件支持范围请求
+
+    // GET与HEAD请求的If-None-Match与If-Modified-Since，Init之后、Prepare之前设置，资源文件未变化时返回304
+    void SetConditional(std::string_view if_none_match, std::string_view if_modified_since);
+    // HEAD请求只发送响应头，Content-Length仍为GET时的正文长度，Init之后设置
+    void SetHeadOnly(bool head_only) { head_only_ = head_only; }
+    bool HeadOnly() const { return head_only_; }
+    // 资源文件(200、206、304)的校验器与缓存策略，没有时为空；Prepare之后到ReleaseFile之前有效
+    std::string_view ETag() const { return etag_; }
+    std::string_view LastModified() const { return last_modified_; }
+    std::string_view CacheControl() const { return cache_control_; }
+
+    // 生成资源文件中不随请求变化的响应头，载入文件缓存时调用；path为原文件路径，encoding为该版本的编码
+    static std::string_view MimeType(std::string_view path) { return SuffixType_(path); }  // 按后缀的文件类型
+    static void BuildFileHeader(std::string_view path, std::string_view encoding, bool vary, CachedFile& file);
+
+    // 以下供路由处理函数在Prepare之前调用
+    void SetPath(std::string_view path) { path_.assign(path.data(), path.size()); }  // 改为返回资源目录下的该文件
+    void SetCode(int code) { code_ = code; }                                         // 设置状态码
+    void SetContent(std::string content, std::string type);  // 使用内存中的正文，不再查找文件
+    // 分段生成正文：BeginContent之后每段由AppendContent送入。可压缩时攒够Compressor::min_size_即开始压缩，
+    // 之后各段直接送入压缩器，未压缩的正文不会整个保存在内存中
+    void BeginContent(std::string type) { SetContent(std::string(), std::move(type)); }
+    void AppendContent(std::string_view data);
+
+    // Prepare之后，没有资源文件时正文在内存中(处理函数生成的正文或错误页面)
+    bool HasContent() const { return has_content_; }
+    const std::string& Content() const { return content_; }
 
 private:
     void AddStateLine_(Buffer& buff);  // 添加状态行
@@ -30,7 +90,19 @@ private:
     void AddContent_(Buffer& buff);    // 添加响应正文
 
     void ErrorHtml_();
-    std::string GetFileType_();
+    void CompressContent_();                 // 压缩内存中的正文，压缩后更小时替换；分段压缩的正文在这里结束
+    bool CompressEncoding_(size_t len, Compressor::ENCODING& encoding);  // 长度为len的正文是否压缩及使用的编码
+    static Buffer& CompressBuffer_();        // 线程内复用的压缩输出
+    void CompressError_();                   // 分段压缩出错
+    void SelectEncoding_(bool identity);     // 选择资源文件的压缩版本，identity时只设置Vary
+    bool NotModified_() const;               // 按条件请求头判断客户端缓存的资源文件是否仍然有效
+    void ApplyRange_();                      // 按Range请求头改为206或416响应
+    std::string_view GetFileType_() const;
+
+    static std::string_view SuffixType_(std::string_view path);          // 按后缀查找文件类型
+    static std::string_view SuffixCacheControl_(std::string_view path);  // 按后缀查找缓存策略
+    static const std::string& StatusLine_(int code);                     // 预先生成的状态行，未知状态码为空
+    static void Append_(Buffer& buff, std::string_view str) { buff.Append(str.data(), str.size()); }
 
     int code_;            // 状态码
     bool is_keep_alive_;  // 是否保持连接
@@ -38,12 +110,43 @@ private:
     std::string path_;     // 资源文件路径
     std::string src_dir_;  // 资源文件根目录
 
-    char* mm_file_;             // 文件映射内存起始地址
-    struct stat mm_file_stat_;  // 文件信息
+    std::shared_ptr<const CachedFile> file_;  // 资源文件，由文件缓存共享
+    std::string error_msg_;                   // 没有错误页面文件时错误页面中的信息
+
+    int gzip_q_;                 // 客户端对gzip的q值(0~1000)，0表示不接受
+    int deflate_q_;              // 客户端对deflate的q值
+    std::string_view encoding_;  // 正文的Content-Encoding
+    bool vary_;                  // 是否有压缩版本
+
+    std::string range_;               // 请求的Range
+    std::string if_range_;            // 请求的If-Range
+    std::vector<ByteRange> ranges_;   // 206响应发送的范围
+    std::string range_tail_;          // multipart/byteranges的结束分隔行
+    std::string boundary_;            // multipart/byteranges的分隔符
+    std::string range_type_;          // 多个范围时正文的类型multipart/byteranges
+    std::string content_range_;       // Content-Range响应头
+    size_t range_len_;                // 206响应的正文长度
+
+    std::string if_none_match_;       // 请求的If-None-Match
+    std::string if_modified_since_;   // 请求的If-Modified-Since
+    std::string_view etag_;           // 资源文件的ETag，指向缓存条目
+    std::string_view last_modified_;  // 资源文件的Last-Modified，指向缓存条目
+    std::string_view cache_control_;  // 按后缀的Cache-Control
+
+    bool head_only_;            // 只发送响应头(HEAD请求)
+    bool has_content_;          // 正文是否在内存中
+    bool compressing_;          // 分段送入的正文正在压缩，输出在CompressBuffer_()中
+    std::string content_;       // 内存中的正文
+    std::string content_type_;  // 内存中正文的类型
 
-    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;  // 文件后缀与文件类型
-    static const std::unordered_map<int, std::string> CODE_STATUS;          // 状态码与状态信息
-    static const std::unordered_map<int, std::string> CODE_PATH;            // 状态码与错误页面路径
+    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;           // 文件后缀与文件类型
+    static const std::unordered_map<std::string, std::string> SUFFIX_CACHE_CONTROL;  // 文件后缀与缓存策略
+    static const std::unordered_map<int, std::string> CODE_STATUS;                   // 状态码与状态信息
+    static const std::unordered_map<int, std::string> CODE_PATH;                     // 状态码与错误页面路径
+    static const std::string_view KEEP_ALIVE_HEADER;     // 预先生成的连接管理响应头
+    static const std::string_view CLOSE_HEADER;
+    static const std::string_view ACCEPT_RANGES_HEADER;
+    static const int kMaxCode = 600;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "outqueue.h"
+
+void OutQueue::Append(const char* data, size_t len) {
+    Buff().Append(data, len);
+    Commit(len);
+}
+
+Buffer& OutQueue::Buff() {
+    // 已排队的数据较多时换用新块，之前的块不再随扩容复制，发送完即可释放
+    if (blocks_.empty() || blocks_.back().ReadableBytes() >= kBlockSize) {
+        blocks_.emplace_back(static_cast<int>(kBlockSize));
+        new_block_ = true;
+    }
+    return blocks_.back();
+}
+
+void OutQueue::Commit(size_t len) {
+    if (len == 0) return;
+    if (!new_block_ && !segs_.empty() && segs_.back().type == Segment::COPY) {
+        segs_.back().len += len;  // 与上一段在同一块中相邻，合并为一段
+    } else {
+        segs_.push_back({Segment::COPY, len, nullptr, nullptr, -1, 0, false});
+    }
+    new_block_ = false;
+    bytes_ += len;
+}
+
+void OutQueue::AppendRef(const char* data, size_t len, std::shared_ptr<const void> owner) {
+    if (len == 0) return;
+    segs_.push_back({Segment::REF, len, data, std::move(owner), -1, 0, false});
+    bytes_ += len;
+}
+
+void OutQueue::AppendFile(const std::shared_ptr<const CachedFile>& file, size_t offset, size_t len) {
+    if (len == 0) return;
+    if (file->data) {
+        AppendRef(file->data + offset, len, file);
+        // 堆上的小文件总在内存中，mmap的文件与打包文件的内容可能已被换出页缓存
+        segs_.back().check = FileCache::check_residency_ && (file->mapped || file->storage);
+        return;
+    }
+    assert(file->fd >= 0);
+    const char* probe = file->probe ? file->probe + offset : nullptr;
+    segs_.push_back({Segment::FILE, len, probe, file, file->fd, (off_t)offset, probe != nullptr});
+    bytes_ += len;
+    ++file_segs_;
+}
+
+ssize_t OutQueue::WriteTo(int fd, int* save_errno) {
+    ssize_t len = 0;
+    if (!SegsEmpty_() && segs_[seg_head_].type == Segment::FILE) {
+        // sendfile更新的是局部的偏移，文件的读写位置不变，多个连接可以共用同一个fd
+        Segment& seg = segs_[seg_head_];
+        size_t count = seg.len;
+        if (seg.check) {
+            count = std::min(count, kResidentWindow);
+            if (!Resident_(seg, count)) return Cold_(seg, save_errno);
+        }
+        off_t offset = seg.offset;
+        len = sendfile(fd, seg.fd, &offset, count);
+        if (len == 0) {  // 文件被截断，已发出的Content-Length无法满足
+            LOG_WARN("sendfile hit EOF, %zu bytes left", seg.len);
+            *save_errno = EIO;
+            return -1;
+        }
+    } else {
+        // 按队列顺序组装iovec链，COPY段依次位于blocks_的各块中，遇到FILE段为止
+        struct iovec iov[kMaxIov];
+        int cnt = 0;
+        auto block = blocks_.begin();
+        const char* copy = blocks_.empty() ? nullptr : block->Peek();
+        for (auto it = segs_.begin() + seg_head_; it != segs_.end() && it->type != Segment::FILE && cnt < kMaxIov; ++it, ++cnt) {
+            size_t n = it->len;
+            if (it->check) {
+                n = std::min(n, kResidentWindow);
+                if (!Resident_(*it, n)) {
+                    if (cnt > 0) break;  // 先发送之前已在内存中的数据
+                    return Cold_(*it, save_errno);
+                }
+            }
+            if (it->type == Segment::COPY) {
+                while (copy == block->BeginWriteConst()) copy = (++block)->Peek();  // 当前块的数据已排完
+                iov[cnt].iov_base = const_cast<char*>(copy);
+                copy += it->len;
+            } else {
+                iov[cnt].iov_base = const_cast<char*>(it->data);
+            }
+            iov[cnt].iov_len = n;
+            if (n < it->len) {  // 只发送检查过的部分
+                ++cnt;
+                break;
+            }
+        }
+        // 之后还有文件要发送时，暂不发出不满一帧的响应头
+        if (file_segs_ > 0 && !corked_) Cork_(fd, true);
+        len = writev(fd, iov, cnt);
+    }
+
+    if (len < 0) {
+        *save_errno = errno;
+    } else {
+        Consume_(len);
+    }
+    // 文件都已发出，取消TCP_CORK使剩余的不满一帧的数据立即发送
+    if (corked_ && file_segs_ == 0) Cork_(fd, false);
+    return len;
+}
+
+bool OutQueue::Resident_(const Segment& seg, size_t len) const {
+    // 同一位置预读后仍不在内存中时(文件被截断、内存紧张)不再等待，以免反复预读
+    return seg.data == cold_.data || FileCache::Resident(seg.data, len);
+}
+
+ssize_t OutQueue::Cold_(const Segment& seg, int* save_errno) {
+    cold_ = {seg.owner, seg.data, std::min(seg.len, FileCache::prefetch_size_)};
+    *save_errno = EINPROGRESS;
+    return -1;
+}
+
+void OutQueue::Cork_(int fd, bool on) {
+    int val = on ? 1 : 0;
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &val, sizeof(val));  // 非TCP套接字时失败，不影响发送
+    corked_ = on;
+}
+
+void OutQueue::Consume_(size_t len) {
+    while (!SegsEmpty_()) {
+        Segment& seg = segs_[seg_head_];
+        size_t n = std::min(len, seg.len);
+        if (seg.type == Segment::COPY) {
+            while (blocks_.front().ReadableBytes() == 0) blocks_.erase(blocks_.begin());
+            blocks_.front().Retrieve(n);
+            if (blocks_.front().ReadableBytes() == 0 && blocks_.size() > 1) blocks_.erase(blocks_.begin());
+        } else if (seg.type == Segment::REF) {
+            seg.data += n;
+        } else {
+            seg.offset += n;
+            if (seg.data) seg.data += n;
+        }
+        seg.len -= n;
+        bytes_ -= n;
+        len -= n;
+        if (seg.len > 0) break;
+        if (seg.type == Segment::FILE) --file_segs_;
+        PopSeg_();  // REF、FILE段在此释放对文件的引用
+    }
+    assert(len == 0);
+}
+
+void OutQueue::PopSeg_() {
+    segs_[seg_head_++].owner.reset();
+    if (seg_head_ == segs_.size()) {
+        segs_.clear();
+        seg_head_ = 0;
+    } else if (seg_head_ >= 64 && seg_head_ * 2 >= segs_.size()) {
+        // 一直没有发送空时，丢弃前面已发送的段，避免数组只增不减
+        segs_.erase(segs_.begin(), segs_.begin() + seg_head_);
+        seg_head_ = 0;
+    }
+}
+
+size_t OutQueue::Capacity() const {
+    size_t bytes = segs_.capacity() * sizeof(Segment) + blocks_.capacity() * sizeof(Buffer);
+    for (const Buffer& block : blocks_) bytes += block.Capacity();
+    return bytes;
+}
+
+void OutQueue::Release() {
+    Clear();
+    std::vector<Segment>().swap(segs_);
+    std::vector<Buffer>().swap(blocks_);
+}
+
+void OutQueue::Clear() {
+    // 连接关闭或复用于新的连接时调用，新的套接字没有设置TCP_CORK
+    segs_.clear();
+    seg_head_ = 0;
+    cold_ = {nullptr, nullptr, 0};
+    file_segs_ = 0;
+    corked_ = false;
+    bytes_ = 0;
+    new_block_ = false;
+    blocks_.clear();  // 内存块还给当前线程的块池
+}
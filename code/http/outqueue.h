@@ -0,0 +1,98 @@
+#ifndef OUT_QUEUE_H
+#define OUT_QUEUE_H
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>   // TCP_CORK
+#include <sys/sendfile.h>  // sendfile
+#include <sys/socket.h>    // setsockopt
+#include <sys/uio.h>       // writev
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "../buffer/buffer.h"
+#include "filecache.h"
+
+// 连接的输出队列：按发送顺序保存数据段，写时组装成iovec链，一次writev发出
+// 复制的小块数据(响应头、帧头等)依次存放在由块池分配的缓冲区链中，文件内容直接引用文件缓存中的内存；
+// 大文件以fd与偏移表示，轮到时由sendfile从页缓存发送，队列中有这样的段时用TCP_CORK使响应头与文件开头合并成满帧。
+// 映射的文件内容在发送前检查是否在页缓存中，不在时不发送，记录待预读的区间，由调用者交给磁盘I/O线程读入后再写
+class OutQueue {
+public:
+    // 待预读的文件映射区间
+    struct ColdRange {
+        std::shared_ptr<const void> owner;  // 预读完成前持有文件
+        const char* data;
+        size_t len;
+    };
+
+    OutQueue() : cold_{nullptr, nullptr, 0}, seg_head_(0), bytes_(0), file_segs_(0), corked_(false), new_block_(false) {}
+    ~OutQueue() { Clear(); }
+
+    // 追加一段需要复制的数据
+    void Append(const char* data, size_t len);
+    void Append(const std::string& str) { Append(str.data(), str.size()); }
+    // 直接向缓冲区链的尾块写入，写完后调用Commit提交写入的字节数
+    Buffer& Buff();
+    void Commit(size_t len);
+    // 追加一段不复制的数据[data, data + len)，该段发送完前持有owner，保证数据有效
+    void AppendRef(const char* data, size_t len, std::shared_ptr<const void> owner);
+    // 追加缓存文件的[offset, offset + len)：文件在内存中时引用内存，否则由sendfile发送
+    void AppendFile(const std::shared_ptr<const CachedFile>& file, size_t offset, size_t len);
+
+    // 队首为文件段时调用一次sendfile，否则对文件段之前的数据调用一次writev，返回值与其相同；
+    // 文件在发送期间被截断时返回-1，save_errno为EIO；
+    // 队首的文件内容不在页缓存中时不发送，返回-1，save_errno为EINPROGRESS，待预读的区间由Cold()给出
+    ssize_t WriteTo(int fd, int* save_errno);
+    const ColdRange& Cold() const { return cold_; }
+
+    size_t Bytes() const { return bytes_; }  // 待写入的字节数
+    bool Empty() const { return bytes_ == 0; }
+    size_t Capacity() const;  // 队列占用的内存(缓冲区链与段数组)，不含引用的文件内容
+    void Clear();
+    void Release();  // 清空队列并释放段数组，连接空闲时调用
+
+    static const int kMaxIov = 64;  // 单次writev最多的io向量数量
+    static const size_t kBlockSize = 16 * 1024;  // 尾块中待发送的数据达到该大小后换用新块
+    static const size_t kResidentWindow = 1024 * 1024;  // 需要检查的段单次最多发送的字节数，发送前检查这部分是否在内存中
+
+private:
+    OutQueue(const OutQueue&) = delete;
+    OutQueue& operator=(const OutQueue&) = delete;
+
+    struct Segment {
+        enum TYPE {
+            COPY,  // 位于blocks_中的数据，同一块中连续的段合并为一个，一个段不跨块
+            REF,   // 引用的数据(文件内容)
+            FILE,  // 由sendfile发送的文件
+        };
+        TYPE type;
+        size_t len;                         // 剩余待发送的字节数
+        const char* data;                   // REF：下一个待发送的字节；FILE：下一个待发送字节在probe映射中的位置
+        std::shared_ptr<const void> owner;  // REF、FILE：数据的持有者
+        int fd;                             // FILE：文件描述符
+        off_t offset;                       // FILE：下一个待发送字节在文件中的偏移
+        bool check;                         // data位于文件映射中，发送前检查是否在页缓存中
+    };
+
+    bool SegsEmpty_() const { return seg_head_ == segs_.size(); }
+    void PopSeg_();             // 丢弃队首的段
+    void Consume_(size_t len);  // 丢弃已发送的len字节
+    void Cork_(int fd, bool on);
+    bool Resident_(const Segment& seg, size_t len) const;  // 段开头的len字节是否在内存中
+    ssize_t Cold_(const Segment& seg, int* save_errno);     // 记录待预读的区间，返回-1
+
+    ColdRange cold_;              // 最近一次待预读的区间
+    std::vector<Buffer> blocks_;  // 复制的数据，按发送顺序的缓冲区链，已发送完的块还给块池；通常只有一两块
+    // 数据段，[seg_head_, size)为待发送的段；队列发送空时清空并复用容量，不像deque那样随入队出队反复分配节点
+    std::vector<Segment> segs_;
+    size_t seg_head_;             // 队首段的下标
+    size_t bytes_;                // 待写入的字节数
+    size_t file_segs_;            // 队列中FILE段的数量
+    bool corked_;                 // 是否设置了TCP_CORK
+    bool new_block_;              // 尾块是新换的块，下一个COPY段不与之前的段合并
+};
+
+#endif
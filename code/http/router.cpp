@@ -0,0 +1,178 @@
+#include "router.h"
+
+bool Router::Add(std::string_view method, std::string_view pattern, Handler handler) {
+    std::string_view segments[kMaxSegments];
+    int count = Split_(pattern, segments);
+    if (count < 0 || !handler) {
+        LOG_ERROR("Invalid route pattern: %.*s", (int)pattern.size(), pattern.data());
+        return false;
+    }
+
+    int node = 0;
+    for (int i = 0; i < count; ++i) {
+        std::string_view segment = segments[i];
+        if (segment == "*") {
+            if (i != count - 1) {
+                LOG_ERROR("'*' must be the last segment: %.*s", (int)pattern.size(), pattern.data());
+                return false;
+            }
+            AddRoute_(nodes_[node].prefix, method, std::move(handler));
+            compiled_ = false;
+            return true;
+        }
+        if (!segment.empty() && segment[0] == ':') {
+            if (nodes_[node].param_child < 0) {
+                int child = nodes_.size();
+                nodes_.emplace_back();
+                nodes_[node].param_child = child;
+                nodes_[node].param_name.assign(segment.data() + 1, segment.size() - 1);
+            }
+            node = nodes_[node].param_child;
+        } else {
+            node = AddChild_(node, segment);
+        }
+    }
+    AddRoute_(nodes_[node].exact, method, std::move(handler));
+    compiled_ = false;
+    return true;
+}
+
+void Router::AddRoute_(std::vector<Route>& routes, std::string_view method, Handler handler) {
+    for (Route& route : routes) {
+        if (route.method == method) {
+            route.handler = std::move(handler);
+            return;
+        }
+    }
+    routes.push_back({std::string(method), std::move(handler)});
+}
+
+int Router::AddChild_(int parent, std::string_view segment) {
+    auto key = std::make_pair(parent, std::string(segment));
+    auto it = build_edges_.find(key);
+    if (it != build_edges_.end()) return it->second;
+    int child = nodes_.size();
+    nodes_.emplace_back();
+    edges_.push_back({Hash_(parent, segment), parent, child, key.second});
+    build_edges_.emplace(std::move(key), child);
+    return child;
+}
+
+void Router::Compile() {
+    // 负载因子不超过0.5
+    size_t size = 16;
+    while (size < edges_.size() * 2) size <<= 1;
+    table_.assign(size, -1);
+    mask_ = size - 1;
+    for (size_t i = 0; i < edges_.size(); ++i) {
+        size_t pos = edges_[i].hash & mask_;
+        while (table_[pos] != -1) pos = (pos + 1) & mask_;
+        table_[pos] = i;
+    }
+
+    route_count_ = 0;
+    for (const Node& node : nodes_) route_count_ += node.exact.size() + node.prefix.size();
+    build_edges_.clear();
+    compiled_ = true;
+    LOG_INFO("Router compiled: %zu routes, %zu nodes", route_count_, nodes_.size());
+}
+
+int Router::Child_(int parent, std::string_view segment) const {
+    uint64_t hash = Hash_(parent, segment);
+    for (size_t pos = hash & mask_; table_[pos] != -1; pos = (pos + 1) & mask_) {
+        const Edge& edge = edges_[table_[pos]];
+        if (edge.hash == hash && edge.parent == parent && edge.segment == segment) return edge.child;
+    }
+    return -1;
+}
+
+bool Router::Dispatch(HttpRequest& request, HttpResponse& response) const {
+    Params params;
+    const Handler* handler = Match(request.Method(), request.Path(), params);
+    if (!handler) return false;
+    for (auto& [name, value] : params) request.SetParam(name, value);
+    (*handler)(request, response);
+    return true;
+}
+
+const Router::Handler* Router::Match(std::string_view method, std::string_view path, Params& params) const {
+    assert(compiled_);
+    path = path.substr(0, path.find('?'));  // 查询字符串不参与匹配
+
+    std::string_view segments[kMaxSegments];
+    int count = Split_(path, segments);
+    if (count < 0) return nullptr;
+    return Match_(0, segments, count, 0, method, path, params);
+}
+
+const Router::Handler* Router::Match_(int node, const std::string_view* segments, int count, int index,
+                                      std::string_view method, std::string_view path, Params& params) const {
+    const Node& cur = nodes_[node];
+    if (index == count) {
+        const Handler* handler = Select_(cur.exact, method);
+        if (handler) return handler;
+    } else {
+        int child = Child_(node, segments[index]);
+        if (child >= 0) {
+            const Handler* handler = Match_(child, segments, count, index + 1, method, path, params);
+            if (handler) return handler;
+        }
+        if (cur.param_child >= 0) {
+            params.emplace_back(cur.param_name, segments[index]);
+            const Handler* handler = Match_(cur.param_child, segments, count, index + 1, method, path, params);
+            if (handler) return handler;
+            params.pop_back();
+        }
+    }
+
+    // 更深的节点都不匹配时使用该节点的前缀路由
+    const Handler* handler = Select_(cur.prefix, method);
+    if (handler) {
+        size_t rest = index < count ? segments[index].data() - path.data() : path.size();
+        params.emplace_back("*", path.substr(rest));
+    }
+    return handler;
+}
+
+const Router::Handler* Router::Select_(const std::vector<Route>& routes, std::string_view method) {
+    const Handler* any = nullptr;
+    const Handler* get = nullptr;
+    for (const Route& route : routes) {
+        if (route.method == method) return &route.handler;
+        if (route.method.empty()) any = &route.handler;
+        if (route.method == "GET") get = &route.handler;
+    }
+    if (method == "HEAD" && get) return get;
+    return any;
+}
+
+int Router::Split_(std::string_view path, std::string_view* segments) {
+    if (path.empty() || path[0] != '/') return -1;
+    if (path.size() == 1) return 0;  // "/"对应根节点
+    int count = 0;
+    size_t begin = 1;
+    while (true) {
+        if (count == kMaxSegments) return -1;
+        size_t end = path.find('/', begin);
+        if (end == std::string_view::npos) {
+            segments[count++] = path.substr(begin);
+            return count;
+        }
+        segments[count++] = path.substr(begin, end - begin);
+        begin = end + 1;
+    }
+}
+
+uint64_t Router::Hash_(int parent, std::string_view segment) {
+    // FNV-1a，混入父节点编号
+    uint64_t hash = 14695981039346656037ULL ^ (uint64_t)parent;
+    for (char ch : segment) {
+        hash ^= (unsigned char)ch;
+        hash *= 1099511628211ULL;
+    }
+    return hash ^ (hash >> 29);
+}
+
+Router::Handler Router::ServeFile(std::string path) {
+    return [path = std::move(path)](HttpRequest&, HttpResponse& response) { response.SetPath(path); };
+}
@@ -0,0 +1,91 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../log/log.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+
+// 路由表：按方法与路径注册处理函数，启动时编译为按路径段查找的前缀树。
+// 前缀树的边存放在一张开放寻址的散列表中，以(父节点, 路径段)为键，
+// 分发时每个路径段只需一次散列查找，耗时与注册的路由数量无关
+class Router {
+public:
+    // 处理函数读取解析完成的请求，通过HttpResponse的SetPath/SetCode/SetContent写入响应
+    typedef std::function<void(HttpRequest&, HttpResponse&)> Handler;
+    typedef std::vector<std::pair<std::string_view, std::string_view>> Params;
+
+    Router() : compiled_(false), mask_(0), route_count_(0) { nodes_.emplace_back(); }
+
+    // 注册路由，pattern以'/'开头，按'/'分段：
+    // 普通段精确匹配；":name"匹配任意一段，值通过HttpRequest::Param("name")取得；
+    // 最后一段为"*"时匹配该前缀下的所有路径，剩余部分通过Param("*")取得。
+    // method为空时匹配所有方法，同一方法与路径重复注册时后注册的生效
+    bool Add(std::string_view method, std::string_view pattern, Handler handler);
+    bool Get(std::string_view pattern, Handler handler) { return Add("GET", pattern, std::move(handler)); }
+    bool Post(std::string_view pattern, Handler handler) { return Add("POST", pattern, std::move(handler)); }
+    bool Any(std::string_view pattern, Handler handler) { return Add("", pattern, std::move(handler)); }
+
+    // 将前缀树的边编译为散列表，之后路由表只读，可被多个线程同时使用
+    void Compile();
+    // 查找并执行匹配的处理函数，没有匹配的路由时返回false，按静态文件处理
+    // 匹配优先级：普通段 > 参数段 > 前缀，HEAD请求没有对应路由时使用GET的路由
+    bool Dispatch(HttpRequest& request, HttpResponse& response) const;
+    // 只查找不执行：返回匹配的处理函数，路径参数追加到params中(指向path)，没有匹配时返回nullptr
+    const Handler* Match(std::string_view method, std::string_view path, Params& params) const;
+
+    size_t Size() const { return route_count_; }  // 已注册的路由数量
+
+    static Handler ServeFile(std::string path);  // 返回指定静态文件的处理函数
+
+    static const int kMaxSegments = 32;  // 路径的最大段数，超过时不参与路由
+
+private:
+    struct Route {
+        std::string method;
+        Handler handler;
+    };
+    struct Node {
+        Node() : param_child(-1) {}
+        int param_child;            // ":name"子节点，-1表示没有
+        std::string param_name;     // 参数名
+        std::vector<Route> exact;   // 路径在该节点结束时的路由
+        std::vector<Route> prefix;  // 该节点之下所有路径的路由("*")
+    };
+    struct Edge {
+        uint64_t hash;
+        int parent;
+        int child;
+        std::string segment;
+    };
+
+    // 将路径按'/'分段，返回段数，超过kMaxSegments返回-1
+    static int Split_(std::string_view path, std::string_view* segments);
+    static uint64_t Hash_(int parent, std::string_view segment);
+    static const Handler* Select_(const std::vector<Route>& routes, std::string_view method);
+    static void AddRoute_(std::vector<Route>& routes, std::string_view method, Handler handler);
+
+    int AddChild_(int parent, std::string_view segment);  // 注册时查找或创建子节点
+    int Child_(int parent, std::string_view segment) const;  // 编译后查找子节点
+    // 从node开始匹配segments[index...]，回溯时撤销参数
+    const Handler* Match_(int node, const std::string_view* segments, int count, int index, std::string_view method,
+                          std::string_view path, Params& params) const;
+
+    bool compiled_;
+    std::vector<Node> nodes_;  // 第0个节点为根
+    std::vector<Edge> edges_;
+    std::map<std::pair<int, std::string>, int> build_edges_;  // 注册阶段的边，编译后清空
+    std::vector<int> table_;  // 开放寻址散列表，存放edges_的下标，-1表示空
+    size_t mask_;
+    size_t route_count_;
+};
+
+#endif
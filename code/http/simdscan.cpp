@@ -0,0 +1,134 @@
+#include "simdscan.h"
+
+#include <string.h>  // memchr
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_SCAN_X86
+#endif
+
+namespace {
+
+const char* FindCharScalar(const char* begin, const char* end, char ch) {
+    const void* pos = memchr(begin, ch, end - begin);
+    return pos ? static_cast<const char*>(pos) : end;
+}
+
+const char* FindEitherScalar(const char* begin, const char* end, char a, char b) {
+    for (const char* p = begin; p < end; ++p) {
+        if (*p == a || *p == b) return p;
+    }
+    return end;
+}
+
+#ifdef SIMD_SCAN_X86
+// 每次比较32字节，movemask得到匹配位图
+__attribute__((target("avx2"))) const char* FindCharAvx2(const char* begin, const char* end, char ch) {
+    const __m256i needle = _mm256_set1_epi8(ch);
+    const char* p = begin;
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return FindCharScalar(p, end, ch);
+}
+
+__attribute__((target("avx2"))) const char* FindEitherAvx2(const char* begin, const char* end, char a, char b) {
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    const char* p = begin;
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb));
+        unsigned mask = _mm256_movemask_epi8(hit);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return FindEitherScalar(p, end, a, b);
+}
+
+// pcmpestri每次比较16字节，返回第一个匹配的下标，无匹配时返回16
+__attribute__((target("sse4.2"))) const char* FindCharSse42(const char* begin, const char* end, char ch) {
+    const __m128i needle = _mm_set1_epi8(ch);
+    const char* p = begin;
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int idx = _mm_cmpestri(needle, 1, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16) return p + idx;
+        p += 16;
+    }
+    return FindCharScalar(p, end, ch);
+}
+
+// 两个字符用两次cmpeq比pcmpestri快，只需要SSE2，归入SSE4.2级别
+__attribute__((target("sse2"))) const char* FindEitherSse2(const char* begin, const char* end, char a, char b) {
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const char* p = begin;
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb));
+        unsigned mask = _mm_movemask_epi8(hit);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return FindEitherScalar(p, end, a, b);
+}
+#endif
+
+SimdScan::Level DetectLevel() {
+#ifdef SIMD_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdScan::AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return SimdScan::SSE42;
+#endif
+    return SimdScan::SCALAR;
+}
+
+}  // namespace
+
+SimdScan::Level SimdScan::Best() {
+    static const Level level = DetectLevel();
+    return level;
+}
+
+const char* SimdScan::Name(Level level) {
+    switch (level) {
+        case AVX2:
+            return "avx2";
+        case SSE42:
+            return "sse4.2";
+        default:
+            return "scalar";
+    }
+}
+
+const char* SimdScan::FindChar(Level level, const char* begin, const char* end, char ch) {
+    if (level > Best()) level = Best();
+#ifdef SIMD_SCAN_X86
+    if (level == AVX2) return FindCharAvx2(begin, end, ch);
+    if (level == SSE42) return FindCharSse42(begin, end, ch);
+#endif
+    return FindCharScalar(begin, end, ch);
+}
+
+const char* SimdScan::FindEither(Level level, const char* begin, const char* end, char a, char b) {
+    if (level > Best()) level = Best();
+#ifdef SIMD_SCAN_X86
+    if (level == AVX2) return FindEitherAvx2(begin, end, a, b);
+    if (level == SSE42) return FindEitherSse2(begin, end, a, b);
+#endif
+    return FindEitherScalar(begin, end, a, b);
+}
+
+#ifdef SIMD_SCAN_X86
+const SimdScan::FindCharFunc SimdScan::find_char_ =
+    Best() == AVX2 ? FindCharAvx2 : Best() == SSE42 ? FindCharSse42 : FindCharScalar;
+const SimdScan::FindEitherFunc SimdScan::find_either_ =
+    Best() == AVX2 ? FindEitherAvx2 : Best() == SSE42 ? FindEitherSse2 : FindEitherScalar;
+#else
+const SimdScan::FindCharFunc SimdScan::find_char_ = FindCharScalar;
+const SimdScan::FindEitherFunc SimdScan::find_either_ = FindEitherScalar;
+#endif
@@ -0,0 +1,37 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <stddef.h>
+
+// 字节查找的SIMD实现，启动时根据CPU特性选择一次，HttpParser与FormDecoder共用这一份分派
+class SimdScan {
+public:
+    enum Level {
+        SCALAR,  // memchr或逐字节比较
+        SSE42,   // 每次16字节，单字符查找使用pcmpestri
+        AVX2,    // 每次32字节
+    };
+
+    // 在[begin, end)中查找字符ch，找不到返回end
+    static const char* FindChar(const char* begin, const char* end, char ch) { return find_char_(begin, end, ch); }
+    // 在[begin, end)中查找第一个a或b，找不到返回end
+    static const char* FindEither(const char* begin, const char* end, char a, char b) {
+        return find_either_(begin, end, a, b);
+    }
+
+    // 使用指定级别的实现，高于Best()的级别按Best()处理；测试与基准用来比较各实现的结果与速度
+    static const char* FindChar(Level level, const char* begin, const char* end, char ch);
+    static const char* FindEither(Level level, const char* begin, const char* end, char a, char b);
+
+    static Level Best();                   // 当前CPU支持的最高级别，即FindChar等使用的实现
+    static const char* Name(Level level);  // "avx2"、"sse4.2"或"scalar"
+
+private:
+    typedef const char* (*FindCharFunc)(const char*, const char*, char);
+    typedef const char* (*FindEitherFunc)(const char*, const char*, char, char);
+
+    static const FindCharFunc find_char_;
+    static const FindEitherFunc find_either_;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "userhandler.h"
+
+void UserHandler::AddRoutes(Router& router) {
+    // 表单提交到/login与/register，兼容直接提交到html页面
+    router.Post("/login", Login);
+    router.Post("/login.html", Login);
+    router.Post("/register", SignUp);
+    router.Post("/register.html", SignUp);
+}
+
+void UserHandler::Login(HttpRequest& request, HttpResponse& response) {
+    bool ok = UserVerify_(request.GetPost("username"), request.GetPost("password"), true);
+    response.SetPath(ok ? "/welcome.html" : "/error.html");
+}
+
+void UserHandler::SignUp(HttpRequest& request, HttpResponse& response) {
+    bool ok = UserVerify_(request.GetPost("username"), request.GetPost("password"), false);
+    response.SetPath(ok ? "/welcome.html" : "/error.html");
+}
+
+bool UserHandler::UserVerify_(const std::string& name, const std::string& pwd, bool is_login) {
+    if (name.empty() || pwd.empty()) return false;
+    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
+
+    MYSQL* sql;
+
+    SqlConnRAII sql_raii(&sql, SqlConnPool::Instance());
+    assert(sql);
+
+    bool not_used = false;      // 用户名未被使用过
+  
+    char order[256]{0};
+    MYSQL_RES* res = nullptr;
+
+    if (!is_login) not_used = true;
+    // 查询用户及密码SQL语句
+    snprintf(order, 256, "select username,password from user where username='%s' limit 1", name.c_str());
+    LOG_DEBUG("%s", order);
+
+    // 查询失败
+    if (mysql_query(sql, order)) {
+        mysql_free_result(res);
+        return false;
+    }
+    res = mysql_store_result(sql);    // 获取结果集
+
+    while (MYSQL_ROW row = mysql_fetch_row(res)) {
+        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
+        std::string password(row[1]);
+        if (is_login) {     // 登录
+            if (pwd == password)
+                not_used = true;
+            else {
+                not_used = false;
+                LOG_DEBUG("pwd error!");
+            }
+        } else {        // 注册
+            not_used = false;
+            LOG_DEBUG("user used!");
+        }
+    }
+    mysql_free_result(res);
+
+    if (!is_login && not_used) {        // 注册 且 用户名未被注册
+        LOG_DEBUG("regirster!");
+        bzero(order, 256);
+        // 将用户及密码插入数据库
+        snprintf(order, 256, "insert into user(username,password) values('%s','%s')", name.c_str(), pwd.c_str());
+        LOG_DEBUG("%s", order);
+        if (mysql_query(sql, order)) {
+            LOG_DEBUG("Insert error!");
+            not_used = false;
+        }
+        not_used = true;
+    }
+
+    LOG_DEBUG("UserVerify success!");
+
+    return not_used;
+}
@@ -0,0 +1,27 @@
+#ifndef USER_HANDLER_H
+#define USER_HANDLER_H
+
+#include <mysql/mysql.h>  //mysql
+
+#include <string>
+
+#include "../log/log.h"
+#include "../pool/sqlconnRAII.h"
+#include "../pool/sqlconnpool.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "router.h"
+
+// 登录与注册：读取表单中的用户名和密码，验证成功返回欢迎页面，失败返回错误页面
+class UserHandler {
+public:
+    static void AddRoutes(Router& router);  // 添加登录与注册的路由
+
+    static void Login(HttpRequest& request, HttpResponse& response);
+    static void SignUp(HttpRequest& request, HttpResponse& response);
+
+private:
+    static bool UserVerify_(const std::string& name, const std::string& pwd, bool is_login);
+};
+
+#endif
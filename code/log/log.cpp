@@ -17,9 +17,7 @@ void Log::Init(int level, const char* path, const char* suffix, int max_queue_ca
     }
 
     line_count_ = 0;
-    time_t timer = time(nullptr);             // 获取当前的系统时间。
-    struct tm* sys_time = localtime(&timer);  // 转换为本地时间
-    struct tm t = *sys_time;
+    struct tm t = TimeService::At(TimeService::WallUs() / 1000000).local;  // 当前的本地时间
 
     path_ = path;
     suffix_ = suffix;
@@ -52,12 +50,10 @@ Log& Log::Instance() {
 void Log::FlushLogThread() { Log::Instance().AsyncWrite_(); }
 
 void Log::Write(int level, const char* format, ...) {
-    // 获取时间信息
-    struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr);
-    time_t time_sec = now.tv_sec;
-    struct tm* sys_time = localtime(&time_sec);
-    struct tm t = *sys_time;
+    // 获取时间信息：事件循环线程使用本轮缓存的时间，本地时间与时间前缀每秒只格式化一次
+    int64_t now_us = TimeService::WallUs();
+    const TimeService::Second& second = TimeService::At(now_us / 1000000);
+    struct tm t = second.local;
 
     va_list valist;
 
@@ -87,15 +83,30 @@ void Log::Write(int level, const char* format, ...) {
         std::unique_lock<std::mutex> locker(mtx_);
         line_count_++;
         // 向buff_内写时间
-        int n = snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ", t.tm_year + 1900, t.tm_mon + 1,
-                         t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-        buff_.HasWritten(n);          // 更新，已写n个字符
+        buff_.EnsureWriteable(128);
+        char* p = buff_.BeginWrite();
+        memcpy(p, second.log_prefix, TimeService::kLogPrefixLen);
+        int usec = now_us % 1000000;
+        for (int i = TimeService::kLogPrefixLen + 5; i >= static_cast<int>(TimeService::kLogPrefixLen); --i) {
+            p[i] = '0' + usec % 10;
+            usec /= 10;
+        }
+        p[TimeService::kLogPrefixLen + 6] = ' ';
+        buff_.HasWritten(TimeService::kLogPrefixLen + 7);  // 更新，已写入时间
         AppendLogLevelTitle_(level);  // 追加等级标志
 
         va_start(valist, format);
-        // 写入日志正文
+        // 写入日志正文，空间不够时扩容后重新格式化
+        va_list copy;
+        va_copy(copy, valist);
         int m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, valist);
+        if (m >= 0 && (size_t)m >= buff_.WritableBytes()) {
+            buff_.EnsureWriteable(m + 1);
+            m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, copy);
+        }
+        va_end(copy);
         va_end(valist);
+        if (m < 0) m = 0;
 
         buff_.HasWritten(m);
         buff_.Append("\n\0", 2);
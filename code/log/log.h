@@ -12,6 +12,7 @@
 #include <thread>
 
 #include "../buffer/buffer.h"
+#include "../timer/timeservice.h"
 #include "blockqueue.h"
 
 class Log {
@@ -5,9 +5,15 @@
 #include "server/webserver.h"
 
 int main() {
+    ListenerOptions listener;       // 监听套接字选项，其余字段见server/listener.h
+    listener.backlog = 1024;        // 全连接队列长度
+    listener.defer_accept_sec = 5;  // 连接收到请求数据后才唤醒accept
     WebServer server(1316, 3, 60000, false,              // 端口     ET模式      timeout_ms      优雅退出
                      3306, "root", "root", "webserver",  // Mysql 配置
-                    12, 6, true, 1, 1024);  // 数据库连接池数量  线程池数量  日志开关  日志等级 日志异步
+                    12, 6, true, 1, 1024,  // 数据库连接池数量  线程池数量(多Reactor模式下为事件循环数量)  日志开关  日志等级 日志异步
+                    true, EventBackend::EPOLL,  // 多Reactor模式(false为Reactor+线程池模式)  事件后端(EPOLL/IO_URING)
+                    nullptr,    // 静态资源打包文件(packer生成，nullptr为直接读取resources目录)
+                    listener);  // 监听套接字选项
     server.Start();
     return 0;
 }
\ No newline at end of file
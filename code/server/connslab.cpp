@@ -0,0 +1,52 @@
+#include "connslab.h"
+
+#include <algorithm>
+
+ConnSlab::ConnSlab(size_t capacity)
+    : capacity_(capacity), bytes_(capacity * sizeof(ConnSlot)), high_water_(0) {
+    assert(capacity_ > 0);
+    // MAP_NORESERVE：不为整张表预留交换空间，未访问的页不占用内存
+    void* ptr = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert(ptr != MAP_FAILED);
+    slots_ = static_cast<ConnSlot*>(ptr);
+}
+
+ConnSlab::~ConnSlab() {
+    for (size_t i = 0; i < high_water_; ++i) {
+        delete slots_[i].conn;  // 未使用过的槽为nullptr
+    }
+    munmap(slots_, bytes_);
+}
+
+ConnSlot* ConnSlab::Acquire(int fd, int loop_id) {
+    ConnSlot* slot = Get(fd);
+    if (!slot) return nullptr;
+    assert(!slot->IsOpen());
+    if (!slot->conn) {
+        slot->conn = new HttpConn();
+        size_t water = high_water_.load();
+        while (water < static_cast<size_t>(fd) + 1 && !high_water_.compare_exchange_weak(water, fd + 1)) {
+        }
+    }
+    slot->fd = fd;
+    slot->loop_id.store(loop_id, std::memory_order_relaxed);
+    slot->interest = 0;
+    slot->idle = false;
+    slot->gen.fetch_add(1, std::memory_order_relaxed);
+    slot->state.store(ConnSlot::OPEN, std::memory_order_release);
+    return slot;
+}
+
+void ConnSlab::Release(ConnSlot* slot) {
+    assert(slot);
+    slot->interest = 0;
+    slot->state.store(ConnSlot::FREE, std::memory_order_release);
+}
+
+size_t ConnSlab::DefaultCapacity() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur == RLIM_INFINITY) {
+        return kMaxCapacity;
+    }
+    return std::min<size_t>(limit.rlim_cur, kMaxCapacity);
+}
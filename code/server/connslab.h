@@ -0,0 +1,86 @@
+#ifndef CONN_SLAB_H
+#define CONN_SLAB_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <sys/mman.h>      // mmap, munmap
+#include <sys/resource.h>  // getrlimit
+
+#include <stddef.h>  // offsetof
+
+#include <atomic>
+
+#include "../http/httpconn.h"
+#include "../timer/timingwheel.h"
+
+// 连接槽，保存事件循环每次事件都会访问的热数据，按缓存行对齐，避免不同线程的连接伪共享
+struct alignas(64) ConnSlot {
+    enum STATE : uint32_t {
+        FREE = 0,  // 未使用，mmap得到的零页即为FREE
+        OPEN,      // 连接中
+    };
+    // state、loop_id与gen在线程池模式、超时与预读回调中会被其它线程读取：
+    // Acquire先写loop_id与gen，再以release写入OPEN；读者以acquire读到OPEN后，看到的loop_id与gen属于同一次占用
+    std::atomic<uint32_t> state;  // 连接状态
+    uint32_t interest;            // 当前关注的事件(EPOLLIN/EPOLLOUT)
+    int fd;                       // socket文件描述符
+    std::atomic<int> loop_id;     // 所属事件循环
+    // 所属事件循环按最近活动时间排列的连接链表(以fd链接，0表示没有)，内存超过上限时从表头关闭空闲连接
+    int lru_prev;
+    int lru_next;
+    bool linked;        // 是否在链表中
+    bool idle;          // 已释放缓冲区，等待新的请求；只由所属事件循环读写，线程池模式下由工作线程经mailbox交回设置
+    std::atomic<uint16_t> gen;  // 槽每被占用一次加1，区分先后使用同一fd的连接
+    HttpConn* conn;     // 冷数据：请求、响应与读写缓冲区，首次使用该fd时创建，之后复用
+    TimerEntry timer;   // 超时定时器，嵌入在槽中，由所属事件循环的时间轮链接
+
+    bool IsOpen() const { return state.load(std::memory_order_acquire) == OPEN; }
+    // 槽仍被loop的连接占用；gen不同表示fd已被关闭后复用
+    bool IsOpenIn(int loop) const { return IsOpen() && loop_id.load(std::memory_order_relaxed) == loop; }
+    bool IsOpenIn(int loop, uint16_t generation) const {
+        return IsOpenIn(loop) && gen.load(std::memory_order_relaxed) == generation;
+    }
+
+    static ConnSlot* FromTimer(TimerEntry* entry) {
+        return reinterpret_cast<ConnSlot*>(reinterpret_cast<char*>(entry) - offsetof(ConnSlot, timer));
+    }
+};
+static_assert(sizeof(ConnSlot) == 64, "ConnSlot should fit in one cache line");
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint16_t>::is_always_lock_free,
+              "zero pages from mmap must be valid ConnSlot atomics");
+
+// 以fd为下标、预先分配的连接表，替代unordered_map<int, HttpConn>
+// 槽数组通过匿名mmap一次性分配，只有被访问过的页才会占用物理内存；
+// 所有事件循环共享同一张表，fd在进程内唯一，每个槽只会被其所属的事件循环访问
+class ConnSlab {
+public:
+    explicit ConnSlab(size_t capacity = DefaultCapacity());
+    ~ConnSlab();
+
+    // 返回fd对应的槽，fd超出容量时返回nullptr
+    ConnSlot* Get(int fd) {
+        if (fd < 0 || static_cast<size_t>(fd) >= capacity_) return nullptr;
+        return &slots_[fd];
+    }
+    // 占用fd对应的槽，必要时创建冷数据，fd超出容量时返回nullptr
+    ConnSlot* Acquire(int fd, int loop_id);
+    // 释放槽，冷数据保留以供复用
+    void Release(ConnSlot* slot);
+
+    size_t Capacity() const { return capacity_; }
+
+    // 由RLIMIT_NOFILE决定的容量，上限为kMaxCapacity
+    static size_t DefaultCapacity();
+    static const size_t kMaxCapacity = 1 << 22;
+
+private:
+    ConnSlab(const ConnSlab&) = delete;
+    ConnSlab& operator=(const ConnSlab&) = delete;
+
+    size_t capacity_;
+    size_t bytes_;                    // 槽数组映射的字节数
+    ConnSlot* slots_;                 // 槽数组
+    std::atomic<size_t> high_water_;  // 使用过的最大fd + 1，析构时只需遍历这一部分
+};
+
+#endif
@@ -9,25 +9,29 @@
 
 #include <vector>
 
-class Epoller {
+#include "eventbackend.h"
+
+class Epoller : public EventBackend {
 public:
     // 初始化，调用epoll_create创建epoll句柄
     explicit Epoller(int max_event = 1024);
     // 析构，close(epoll_fd_)
-    ~Epoller();
+    ~Epoller() override;
 
     // 向epoll中添加fd，修改fd，删除fd
-    bool AddFd(int fd, uint32_t events);
-    bool ModFd(int fd, uint32_t events);
-    bool DelFd(int fd);
+    bool AddFd(int fd, uint32_t events) override;
+    bool ModFd(int fd, uint32_t events) override;
+    bool DelFd(int fd) override;
 
     // 调用epoll_wait等待事件发生，返回发生事件的个数
-    int Wait(int timeout_ms = -1);
+    int Wait(int timeout_ms = -1) override;
 
     // 获取发生事件的fd
-    int GetEventFd(size_t i) const;
+    int GetEventFd(size_t i) const override;
     // 获取发生事件的类型
-    uint32_t GetEvents(size_t i) const;
+    uint32_t GetEvents(size_t i) const override;
+
+    const char* Name() const override { return "epoll"; }
 
 private:
     int epoll_fd_;                            // epoll句柄
@@ -0,0 +1,16 @@
+#include "eventbackend.h"
+
+#include "../log/log.h"
+#include "epoller.h"
+#include "uringpoller.h"
+
+std::unique_ptr<EventBackend> EventBackend::Create(int type, int max_event) {
+    if (type == IO_URING) {
+        std::unique_ptr<UringPoller> uring(new UringPoller(max_event));
+        if (uring->Init()) {
+            return uring;
+        }
+        LOG_WARN("io_uring is not available(errno:%d), fall back to epoll", errno);
+    }
+    return std::unique_ptr<EventBackend>(new Epoller(max_event));
+}
@@ -0,0 +1,55 @@
+#ifndef EVENT_BACKEND_H
+#define EVENT_BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+// 事件后端接口，epoll与io_uring两种实现，事件类型统一使用EPOLLIN/EPOLLOUT等epoll标志
+class EventBackend {
+public:
+    enum Type {
+        EPOLL = 0,     // epoll
+        IO_URING = 1,  // io_uring，内核不支持时回退为epoll
+    };
+
+    // 创建指定类型的事件后端，io_uring初始化失败时回退为epoll
+    static std::unique_ptr<EventBackend> Create(int type, int max_event = 1024);
+
+    virtual ~EventBackend() = default;
+
+    // 向事件后端中添加fd，修改fd，删除fd
+    virtual bool AddFd(int fd, uint32_t events) = 0;
+    virtual bool ModFd(int fd, uint32_t events) = 0;
+    virtual bool DelFd(int fd) = 0;
+
+    // 等待事件发生，返回发生事件的个数
+    virtual int Wait(int timeout_ms = -1) = 0;
+
+    // 获取发生事件的fd
+    virtual int GetEventFd(size_t i) const = 0;
+    // 获取发生事件的类型
+    virtual uint32_t GetEvents(size_t i) const = 0;
+
+    virtual const char* Name() const = 0;
+
+    // 完成模式：accept与recv由内核完成，事件中直接带有结果，省去accept4与readv的系统调用。
+    // 只有io_uring后端支持，且只能在调用Wait的线程中使用；不支持时返回false，调用者继续使用就绪事件
+    virtual bool EnableCompletion() { return false; }
+    // 注册监听套接字，内核持续accept：每个新连接产生一个(fd, EPOLLIN)事件，GetAccepted给出新连接的fd
+    virtual bool AddListenFd(int fd) { return false; }
+    // 注册连接，关注EPOLLIN期间由内核持续接收：数据产生(fd, EPOLLIN)事件，GetData给出数据，在下一次Wait前有效；
+    // 对端关闭时产生EPOLLIN | EPOLLRDHUP。EPOLLOUT仍为就绪事件，ModFd与DelFd的用法不变
+    virtual bool AddRecvFd(int fd, uint32_t events) { return false; }
+    // 发送data后关闭fd，两个请求链接在一起，随下一次Wait提交；data在发送完成前必须有效
+    virtual bool SendAndClose(int fd, const char* data, size_t len) { return false; }
+
+    virtual int GetAccepted(size_t i) const { return -1; }
+    virtual const char* GetData(size_t i, size_t* len) const {
+        *len = 0;
+        return nullptr;
+    }
+};
+
+#endif
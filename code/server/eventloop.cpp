@@ -0,0 +1,437 @@
+#include "eventloop.h"
+
+int EventLoop::timer_type_ = EventLoop::TIMING_WHEEL;
+
+EventLoop::EventLoop(int loop_id, int listen_fd, int timeout_ms, uint32_t listen_event, uint32_t conn_event,
+                     ConnSlab* slab, ThreadPool* thread_pool, int backend, ThreadPool* disk_pool)
+    : loop_id_(loop_id),
+      listen_fd_(listen_fd),
+      timeout_ms_(timeout_ms),
+      listen_event_(listen_event),
+      conn_event_(conn_event),
+      is_close_(false),
+      completion_(false),
+      thread_pool_(thread_pool),
+      disk_pool_(disk_pool),
+      poller_(EventBackend::Create(backend)),
+      slab_(slab),
+      lru_head_(0),
+      lru_tail_(0) {
+    assert(listen_fd_ > 0 && slab_);
+    // 线程池模式下读写在工作线程中进行，只使用就绪事件
+    completion_ = IsInLoop_() && poller_->EnableCompletion();
+    // 将listen_fd_添加到事件后端中
+    if (!(completion_ ? poller_->AddListenFd(listen_fd_) : poller_->AddFd(listen_fd_, listen_event_ | EPOLLIN))) {
+        LOG_ERROR("Add listen error!");
+        is_close_ = true;
+    }
+    if (timer_type_ == TIMING_WHEEL) {
+        wheel_.reset(new TimingWheel([this](TimerEntry* entry) { OnTimeout_(ConnSlot::FromTimer(entry)); }));
+        if (wheel_->Fd() < 0 || !poller_->AddFd(wheel_->Fd(), EPOLLIN)) {
+            LOG_WARN("Timing wheel unavailable, fall back to heap timer");
+            wheel_.reset();
+        }
+    }
+    if (!wheel_) timer_.reset(new HeapTimer());
+    if (disk_pool_ || thread_pool_) {
+        mailbox_ = std::make_shared<Mailbox>();
+        mailbox_->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (mailbox_->fd < 0 || !poller_->AddFd(mailbox_->fd, EPOLLIN)) {
+            LOG_WARN("Mailbox unavailable, prefetch in loop thread and never shed idle connections");
+            mailbox_.reset();
+            disk_pool_ = nullptr;
+        }
+    }
+}
+
+EventLoop::~EventLoop() { is_close_ = true; }
+
+void EventLoop::Quit() { is_close_ = true; }
+
+void EventLoop::Loop() {
+    int time_ms = -1;  // -1表无限等待
+    while (!is_close_) {
+        if (timeout_ms_ > 0 && timer_) {
+            time_ms = timer_->GetNextTick();
+        }
+        int event_cnt = poller_->Wait(time_ms);
+        TimeService::Update();  // 本轮的定时器、日志与响应使用同一个缓存的时间
+        for (int i = 0; i < event_cnt; ++i) {
+            // 处理事件
+            int fd = poller_->GetEventFd(i);
+            uint32_t events = poller_->GetEvents(i);
+            if (fd == listen_fd_) {  // 有新连接
+                if (completion_) {
+                    DealAccepted_(poller_->GetAccepted(i));
+                } else {
+                    DealListen_();
+                }
+                continue;
+            }
+            if (wheel_ && fd == wheel_->Fd()) {  // 时间轮到时
+                wheel_->OnTimer();
+                continue;
+            }
+            if (mailbox_ && fd == mailbox_->fd) {  // 其它线程投递了任务
+                RunPosted_();
+                continue;
+            }
+            ConnSlot* client = slab_->Get(fd);
+            if (!client || !client->IsOpen()) {
+                continue;  // 连接已关闭
+            }
+            if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {  // 对端关闭写端，对端关闭，出错
+                CloseConn_(client);         // 关闭连接
+            } else if (events & EPOLLIN) {  // 客户端发送数据
+                if (completion_) {
+                    size_t len;
+                    const char* data = poller_->GetData(i, &len);
+                    DealRecv_(client, data, len);
+                } else {
+                    DealRead_(client);
+                }
+            } else if (events & EPOLLOUT) {  // 客户端可写
+                DealWrite_(client);
+            } else {
+                LOG_ERROR("Unexpected event");
+            }
+        }
+        if (HttpConn::OverMemory()) ShedIdle_();
+    }
+}
+
+// 添加客户端到事件后端中
+void EventLoop::AddClient_(int fd, sockaddr_in addr) {
+    assert(fd > 0);
+    ConnSlot* client = slab_->Acquire(fd, loop_id_);
+    if (!client) {
+        SendError_(fd, "Server busy!");
+        LOG_WARN("Client fd:%d exceeds connection table!", fd);
+        return;
+    }
+    client->conn->Init(fd, addr);  // 为新用户http连接初始化
+    Touch_(client);
+    AddTimer_(client);
+    client->interest = EPOLLIN;
+    // 添加到事件后端中，fd由accept4创建时已是非阻塞的
+    if (completion_) {
+        poller_->AddRecvFd(fd, EPOLLIN | conn_event_);
+    } else {
+        poller_->AddFd(fd, EPOLLIN | conn_event_);
+    }
+    LOG_INFO("Client[%d] in!", fd);
+}
+
+void EventLoop::DealListen_() {
+    struct sockaddr_in addr;
+
+    do {
+        int fd = Listener::Accept(listen_fd_, &addr);
+        if (fd <= 0) return;  // 从这里退出
+        AddClient_(fd, addr);  // 连接数的上限即连接表的容量，fd超出时由AddClient_拒绝
+        // 若listen_fd_是非阻塞的，accept可能会一次性返回多个连接,所以需要循环accept
+    } while (listen_event_ & EPOLLET);
+}
+
+void EventLoop::DealAccepted_(int fd) {
+    // multishot accept不返回对端地址，所有完成事件共用同一个地址缓冲区
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(fd, (struct sockaddr*)&addr, &len) < 0) memset(&addr, 0, sizeof(addr));
+    AddClient_(fd, addr);
+}
+
+void EventLoop::DealRecv_(ConnSlot* client, const char* data, size_t len) {
+    assert(client);
+    client->idle = false;
+    Touch_(client);
+    client->conn->Feed(data, len);
+    // 正在发送或等待预读时只追加到读缓冲区，发送完后由OnWrite_继续处理
+    if (client->interest & EPOLLIN) OnProcess_(client);
+    ExtentTime_(client);
+}
+
+void EventLoop::DealWrite_(ConnSlot* client) {
+    assert(client);
+    client->idle = false;
+    Touch_(client);
+    if (IsInLoop_()) {
+        OnWrite_(client);
+        ExtentTime_(client);  // 按处理后所处的阶段更新定时器
+    } else {
+        ExtentTime_(client);  // 按上次处理后所处的阶段；阶段在线程池中改变后由定时器到期时重新检查
+        // 添加写任务
+        thread_pool_->AddTask(std::bind(&EventLoop::OnWrite_, this, client));
+    }
+}
+
+void EventLoop::DealRead_(ConnSlot* client) {
+    assert(client);
+    client->idle = false;
+    Touch_(client);
+    if (IsInLoop_()) {
+        OnRead_(client);
+        ExtentTime_(client);
+    } else {
+        ExtentTime_(client);
+        // 添加读任务
+        thread_pool_->AddTask(std::bind(&EventLoop::OnRead_, this, client));
+    }
+}
+
+// 向对端发送错误信息
+void EventLoop::SendError_(int fd, const char* info) {
+    assert(fd > 0);
+    if (completion_ && poller_->SendAndClose(fd, info, strlen(info))) return;  // info为字符串常量
+    int ret = send(fd, info, strlen(info), 0);
+    if (ret < 0) {
+        LOG_WARN("send error to client[%d] error!", fd);
+    }
+    close(fd);
+}
+void EventLoop::AddTimer_(ConnSlot* client) {
+    if (timeout_ms_ <= 0) return;
+    uint64_t deadline = client->conn->Deadline();
+    if (wheel_) {
+        // 槽中的条目可能还链接着线程池模式下已关闭的上一个连接，Add会重新放入
+        wheel_->Add(&client->timer, deadline);
+    } else {
+        uint64_t now = TimeService::NowMs();
+        timer_->Add(client->fd, deadline > now ? deadline - now : 0, std::bind(&EventLoop::OnTimeout_, this, client));
+    }
+}
+
+//  更新定时器，因为有新事件发生，连接可能进入了新的阶段或有了进展
+void EventLoop::ExtentTime_(ConnSlot* client) {
+    assert(client);
+    if (timeout_ms_ <= 0 || !client->IsOpen()) return;  // 处理时可能已关闭
+    uint64_t deadline = client->conn->Deadline();
+    if (wheel_) {
+        wheel_->Refresh(&client->timer, deadline);  // 延后时只更新槽中的到期时间
+    } else {
+        uint64_t now = TimeService::NowMs();
+        timer_->Adjust(client->fd, deadline > now ? deadline - now : 0);
+    }
+}
+// 回调函数，当连接超时被调用。从事件后端中删除，从定时器中删除
+void EventLoop::CloseConn_(ConnSlot* client) {
+    assert(client);
+    // 连接关闭后遗留的定时器可能在fd被其它事件循环复用后触发
+    if (!client->IsOpenIn(loop_id_)) return;
+    LOG_INFO("Client[%d] quit!", client->fd);
+    if (IsInLoop_()) {  // 关闭fd前移除，fd可能立即被其它事件循环复用
+        Unlink_(client);
+        if (wheel_) wheel_->Cancel(&client->timer);
+    }
+    poller_->DelFd(client->fd);
+    // 先释放槽再关闭fd，fd关闭前不会被复用
+    slab_->Release(client);
+    client->conn->Close();
+}
+
+void EventLoop::OnTimeout_(ConnSlot* client) {
+    // 线程池模式下连接可能已关闭，fd也可能已被其它事件循环复用
+    if (!client->IsOpenIn(loop_id_)) return;
+    HttpConn* conn = client->conn;
+    if (conn->Deadline() > TimeService::NowMs()) {  // 定时器按之前的阶段设置，连接已进入新的阶段或有了进展
+        AddTimer_(client);
+        return;
+    }
+    HttpConn::CountTimeout(conn->Phase());
+    LOG_INFO("Client[%d] %s timeout!", client->fd, HttpConn::PhaseName(conn->Phase()));
+    CloseConn_(client);
+}
+
+// 读取客户端数据
+void EventLoop::OnRead_(ConnSlot* client) {
+    assert(client);
+    int ret = -1;
+    int read_errno = 0;
+
+    ret = client->conn->Read(&read_errno);
+    if (ret <= 0 && read_errno != EAGAIN) {  // 读取失败
+        CloseConn_(client);
+        return;
+    }
+    OnProcess_(client);
+}
+// 向客户端写数据
+void EventLoop::OnWrite_(ConnSlot* client) {
+    assert(client);
+    int ret = -1;
+    int write_errno = 0;
+
+    ret = client->conn->Write(&write_errno);
+    if (ret < 0 && write_errno == EINPROGRESS) {  // 文件内容不在页缓存中
+        Prefetch_(client);
+        return;
+    }
+    if (client->conn->ToWriteBytes() == 0) {
+        // 传输完成，继续处理读缓冲区中剩余的流水线请求
+        if (client->conn->IsKeepAlive()) {
+            OnProcess_(client);
+            return;
+        }
+    } else if (ret > 0 || write_errno == EAGAIN) {
+        // 继续传输
+        SetInterest_(client, EPOLLOUT);
+        return;
+    }
+    CloseConn_(client);
+}
+
+void EventLoop::OnProcess_(ConnSlot* client) {
+    HttpConn* conn = client->conn;
+    if (conn->Process()) {
+        if (IsInLoop_()) {
+            // 直接尝试写，只有写不完时才关注EPOLLOUT
+            OnWrite_(client);
+        } else {
+            SetInterest_(client, EPOLLOUT);
+        }
+    } else if (conn->ReadPaused()) {
+        // 因内存预算暂停读取时数据还在套接字中，ET模式下不会再有新的边沿，重新注册使其再次触发
+        client->interest = EPOLLIN;
+        poller_->ModFd(client->fd, conn_event_ | EPOLLIN);
+    } else {
+        if (!conn->Idle()) {
+            SetInterest_(client, EPOLLIN);
+            return;
+        }
+        conn->Shrink();  // 等待下一个请求期间不占用缓冲区与请求对象
+        if (IsInLoop_()) {
+            client->idle = true;
+            SetInterest_(client, EPOLLIN);
+        } else if (mailbox_) {
+            // 空闲标记只由所属循环读写：交回循环后再重新关注可读事件，标记之前不会有新的读任务
+            int fd = client->fd;
+            uint16_t gen = client->gen.load(std::memory_order_relaxed);
+            mailbox_->Post([this, fd, gen] { OnIdle_(fd, gen); });
+        } else {
+            SetInterest_(client, EPOLLIN);
+        }
+    }
+}
+
+void EventLoop::OnIdle_(int fd, uint16_t gen) {
+    ConnSlot* client = slab_->Get(fd);
+    if (!client || !client->IsOpenIn(loop_id_, gen)) return;  // 期间连接已超时关闭
+    client->idle = true;
+    SetInterest_(client, EPOLLIN);
+}
+
+void EventLoop::Prefetch_(ConnSlot* client) {
+    OutQueue::ColdRange cold = client->conn->Cold();
+    if (!disk_pool_) {
+        FileCache::Instance().Prefetch(cold.data, cold.len);
+        OnWrite_(client);  // 同一位置不会再次等待预读
+        return;
+    }
+    // 预读完成前不关注可写事件，避免可写的套接字反复触发
+    SetInterest_(client, 0);
+    std::weak_ptr<Mailbox> mailbox = mailbox_;
+    int fd = client->fd;
+    uint16_t gen = client->gen.load(std::memory_order_relaxed);
+    disk_pool_->AddTask([this, cold, mailbox, fd, gen] {
+        FileCache::Instance().Prefetch(cold.data, cold.len);
+        // 不在磁盘线程中修改事件：连接可能已关闭且fd已被新连接复用，交回所属循环检查后再重新关注
+        if (auto box = mailbox.lock()) box->Post([this, fd, gen] { OnPrefetched_(fd, gen); });
+    });
+}
+
+void EventLoop::OnPrefetched_(int fd, uint16_t gen) {
+    ConnSlot* client = slab_->Get(fd);
+    if (!client || !client->IsOpenIn(loop_id_, gen)) {
+        return;  // 预读期间连接已关闭
+    }
+    SetInterest_(client, EPOLLOUT);
+}
+
+void EventLoop::Mailbox::Post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        tasks.push_back(std::move(task));
+    }
+    uint64_t one = 1;
+    ssize_t ret = write(fd, &one, sizeof(one));  // 计数器已非零时同样能唤醒
+    (void)ret;
+}
+
+void EventLoop::RunPosted_() {
+    uint64_t count;
+    ssize_t ret = read(mailbox_->fd, &count, sizeof(count));
+    (void)ret;
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(mailbox_->mtx);
+        tasks.swap(mailbox_->tasks);
+    }
+    for (auto& task : tasks) task();
+}
+
+void EventLoop::SetInterest_(ConnSlot* client, uint32_t events) {
+    // EPOLLONESHOT模式下每次都需要重新注册
+    if (IsInLoop_() && client->interest == events) return;
+    client->interest = events;
+    poller_->ModFd(client->fd, conn_event_ | events);
+}
+
+void EventLoop::Touch_(ConnSlot* client) {
+    if (HttpConn::max_total_bytes_ == 0) return;
+    if (client->linked) {
+        if (client->fd == lru_tail_) return;
+        Unlink_(client);
+    }
+    client->lru_prev = lru_tail_;
+    client->lru_next = 0;
+    if (lru_tail_) {
+        slab_->Get(lru_tail_)->lru_next = client->fd;
+    } else {
+        lru_head_ = client->fd;
+    }
+    lru_tail_ = client->fd;
+    client->linked = true;
+}
+
+void EventLoop::Unlink_(ConnSlot* client) {
+    if (!client->linked) return;
+    if (client->lru_prev) {
+        slab_->Get(client->lru_prev)->lru_next = client->lru_next;
+    } else {
+        lru_head_ = client->lru_next;
+    }
+    if (client->lru_next) {
+        slab_->Get(client->lru_next)->lru_prev = client->lru_prev;
+    } else {
+        lru_tail_ = client->lru_prev;
+    }
+    client->lru_prev = client->lru_next = 0;
+    client->linked = false;
+}
+
+void EventLoop::ShedIdle_() {
+    // 降到上限的90%以下才停止，避免在上限附近每轮都关闭连接
+    size_t target = HttpConn::max_total_bytes_ / 10 * 9;
+    int closed = 0;
+    int fd = lru_head_;
+    for (int scanned = 0; fd && scanned < kMaxShedScan && HttpConn::mem_bytes_ > target; ++scanned) {
+        ConnSlot* client = slab_->Get(fd);
+        fd = client->lru_next;
+        if (!client->IsOpen()) {  // 已由线程池中的任务关闭
+            Unlink_(client);
+        } else if (client->idle) {
+            Unlink_(client);
+            CloseConn_(client);
+            ++closed;
+        }
+    }
+    if (closed > 0) {
+        LOG_WARN("Connection memory %zu over limit %zu, closed %d idle connections", (size_t)HttpConn::mem_bytes_,
+                 HttpConn::max_total_bytes_, closed);
+    }
+}
+
+int EventLoop::SetFdNonblock(int fd) {
+    assert(fd > 0);
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
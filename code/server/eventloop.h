@@ -0,0 +1,129 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>  // fcntl()
+#include <netinet/in.h>
+#include <sys/epoll.h>    // EPOLLIN等事件标志
+#include <sys/eventfd.h>  // eventfd()
+#include <sys/socket.h>
+#include <unistd.h>  // close()
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../http/httpconn.h"
+#include "../log/log.h"
+#include "../pool/threadpool.h"
+#include "../timer/heaptimer.h"
+#include "../timer/timingwheel.h"
+#include "connslab.h"
+#include "eventbackend.h"
+#include "listener.h"
+
+// 事件循环：拥有独立的事件后端(epoll/io_uring)、定时器、连接表以及监听套接字
+// thread_pool为空时，为one loop per thread模式，读写与解析都在本循环线程内完成，
+// 连接在整个生命周期内只属于一个循环，无需跨线程转交，也不需要EPOLLONESHOT重新注册；
+// thread_pool不为空时，为Reactor+线程池模式，读写任务交给线程池处理
+// disk_pool为磁盘I/O线程池：待发送的文件内容不在页缓存中时，由它读入后再通知本循环继续发送，读写线程不阻塞在磁盘上
+// 连接超时默认由时间轮管理，定时器条目嵌入在连接槽中，时间轮的timerfd与连接一起注册在事件后端中
+class EventLoop {
+public:
+    enum TimerType {
+        HEAP_TIMER = 0,    // 小根堆，每次刷新O(log n)，由事件等待的超时驱动
+        TIMING_WHEEL = 1,  // 分层时间轮，添加、刷新与取消都是O(1)，由timerfd驱动
+    };
+
+    EventLoop(int loop_id, int listen_fd, int timeout_ms, uint32_t listen_event, uint32_t conn_event,
+              ConnSlab* slab, ThreadPool* thread_pool = nullptr, int backend = EventBackend::EPOLL,
+              ThreadPool* disk_pool = nullptr);
+    ~EventLoop();
+
+    void Loop();  // 事件循环，直到Quit()被调用
+    void Quit();
+    const char* BackendName() const { return poller_->Name(); }
+    const char* TimerName() const { return wheel_ ? "timing wheel" : "heap"; }
+
+    static int timer_type_;           // 连接超时使用的定时器，timerfd不可用时回退为小根堆
+    static const int kMaxShedScan = 4096;  // 每轮最多检查的连接数，避免长时间阻塞事件循环
+    static int SetFdNonblock(int fd);
+
+private:
+    // 添加客户端
+    void AddClient_(int fd, sockaddr_in addr);
+
+    // 处理连接请求，并调用AddClient_
+    void DealListen_();
+    // 处理读写事件
+    void DealWrite_(ConnSlot* client);
+    void DealRead_(ConnSlot* client);
+    // 完成模式：内核已accept的新连接，内核已接收的数据
+    void DealAccepted_(int fd);
+    void DealRecv_(ConnSlot* client, const char* data, size_t len);
+
+    void SendError_(int fd, const char* info);
+    void AddTimer_(ConnSlot* client);    // 按连接当前阶段的期限放入定时器
+    void ExtentTime_(ConnSlot* client);  // 按连接当前阶段的期限更新定时器
+    void CloseConn_(ConnSlot* client);
+    void OnTimeout_(ConnSlot* client);   // 定时器到期，连接仍未过期限时重新放入
+
+    void OnRead_(ConnSlot* client);
+    void OnWrite_(ConnSlot* client);
+    void OnProcess_(ConnSlot* client);
+    // 把待发送的文件内容交给磁盘I/O线程读入页缓存，完成后重新关注可写事件
+    void Prefetch_(ConnSlot* client);
+    // 预读完成后在本循环中执行：fd仍属于发起预读的连接时才重新关注可写事件
+    void OnPrefetched_(int fd, uint16_t gen);
+    // 线程池模式下连接处理完且已释放缓冲区：在本循环中标记为空闲并重新关注可读事件
+    void OnIdle_(int fd, uint16_t gen);
+    // 执行其它线程投递给本循环的任务
+    void RunPosted_();
+    // 修改连接关注的事件，one loop per thread模式下事件未变化时不调用epoll_ctl
+    void SetInterest_(ConnSlot* client, uint32_t events);
+
+    // 连接有事件时移到活动链表的表尾；链表只在本循环线程中修改，
+    // 线程池模式下工作线程关闭的连接留在链表中，之后遇到时再移除
+    void Touch_(ConnSlot* client);
+    void Unlink_(ConnSlot* client);
+    // 连接占用的内存超过上限时，从最久未活动的连接开始关闭空闲连接
+    void ShedIdle_();
+
+    bool IsInLoop_() const { return thread_pool_ == nullptr; }
+
+    // 其它线程投递给本循环的任务，写eventfd唤醒循环；投递方持有弱引用，循环销毁后不再投递
+    struct Mailbox {
+        int fd = -1;
+        std::mutex mtx;
+        std::vector<std::function<void()>> tasks;
+
+        ~Mailbox() {
+            if (fd >= 0) close(fd);
+        }
+        void Post(std::function<void()> task);
+    };
+
+    int loop_id_;            // 事件循环编号
+    int listen_fd_;          // 监听套接字
+    int timeout_ms_;         // 空闲连接的超时时间，不大于0时不限制连接的各阶段期限
+    uint32_t listen_event_;  // 监听事件
+    uint32_t conn_event_;    // 连接事件
+    std::atomic<bool> is_close_;
+    bool completion_;        // accept与recv由io_uring完成，只用于one loop per thread模式
+
+    ThreadPool* thread_pool_;                  //  线程池，为空表示在本循环内处理
+    ThreadPool* disk_pool_;                    //  磁盘I/O线程池，为空时在当前线程预读
+    std::unique_ptr<HeapTimer> timer_;         //  小根堆定时器，使用时间轮时为空
+    std::unique_ptr<TimingWheel> wheel_;       //  时间轮，使用小根堆时为空
+    std::shared_ptr<EventBackend> poller_;     //  事件后端，epoll或io_uring
+    std::shared_ptr<Mailbox> mailbox_;         //  磁盘I/O线程与工作线程通过它回到本循环，都没有时为空
+    ConnSlab* slab_;                           //  以fd为下标的连接表，所有事件循环共享
+    int lru_head_;                             //  活动链表的表头(最久未活动)与表尾，0表示空
+    int lru_tail_;
+};
+
+#endif
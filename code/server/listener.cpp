@@ -0,0 +1,78 @@
+#include "listener.h"
+
+bool Listener::SetOpt_(int fd, int level, int name, int val, const char* what, bool required) {
+    if (setsockopt(fd, level, name, &val, sizeof(val)) == 0) return true;
+    if (required) {
+        LOG_ERROR("set %s error: %d", what, errno);
+    } else {
+        LOG_WARN("set %s failed: %d, ignored", what, errno);
+    }
+    return false;
+}
+
+int Listener::Create(int port, const ListenerOptions& opts) {
+    struct sockaddr_in addr;
+    addr.sin_family = AF_INET;                 // ipv4
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);  // 任意ip
+    addr.sin_port = htons(port);
+
+    // 监听套接字本身就是非阻塞的，不需要再调用fcntl
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        LOG_ERROR("Create socket error!");
+        return -1;
+    }
+
+    // 优雅关闭，直到剩余数据发送完毕或超时
+    struct linger opt_linger = {0};
+    if (opts.linger) {
+        opt_linger.l_onoff = 1;
+        opt_linger.l_linger = opts.linger_sec;
+    }
+    if (setsockopt(listen_fd, SOL_SOCKET, SO_LINGER, &opt_linger, sizeof(opt_linger)) < 0) {
+        LOG_ERROR("Init linger error!");
+        close(listen_fd);
+        return -1;
+    }
+    // 防止服务器重启后，端口被占用；多个套接字绑定同一端口时，内核按四元组哈希将连接分给不同的监听套接字
+    if (!SetOpt_(listen_fd, SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR", true) ||
+        (opts.reuse_port && !SetOpt_(listen_fd, SOL_SOCKET, SO_REUSEPORT, 1, "SO_REUSEPORT", true))) {
+        close(listen_fd);
+        return -1;
+    }
+
+    // 以下选项由accept得到的连接继承；缓冲区大小需在listen前设置，才能按其协商窗口扩大因子
+    if (opts.nodelay) SetOpt_(listen_fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY", false);
+    if (opts.rcvbuf > 0) SetOpt_(listen_fd, SOL_SOCKET, SO_RCVBUF, opts.rcvbuf, "SO_RCVBUF", false);
+    if (opts.sndbuf > 0) SetOpt_(listen_fd, SOL_SOCKET, SO_SNDBUF, opts.sndbuf, "SO_SNDBUF", false);
+    if (opts.busy_poll_us > 0) SetOpt_(listen_fd, SOL_SOCKET, SO_BUSY_POLL, opts.busy_poll_us, "SO_BUSY_POLL", false);
+    // 只有三次握手后收到了请求数据的连接才会唤醒accept，省去一次空读与一轮epoll等待
+    if (opts.defer_accept_sec > 0) {
+        SetOpt_(listen_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, opts.defer_accept_sec, "TCP_DEFER_ACCEPT", false);
+    }
+    // 带cookie的客户端可在SYN中携带请求，省去一个往返
+    if (opts.fastopen_qlen > 0) {
+        SetOpt_(listen_fd, IPPROTO_TCP, TCP_FASTOPEN, opts.fastopen_qlen, "TCP_FASTOPEN", false);
+    }
+
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        LOG_ERROR("Bind Port:%d error!", port);
+        close(listen_fd);
+        return -1;
+    }
+    if (listen(listen_fd, opts.backlog) < 0) {
+        LOG_ERROR("Listen port:%d error!", port);
+        close(listen_fd);
+        return -1;
+    }
+    return listen_fd;
+}
+
+int Listener::Accept(int listen_fd, struct sockaddr_in* addr) {
+    socklen_t len = sizeof(*addr);
+    int fd;
+    do {
+        fd = accept4(listen_fd, (struct sockaddr*)addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+}
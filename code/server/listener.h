@@ -0,0 +1,41 @@
+#ifndef LISTENER_H
+#define LISTENER_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>  // TCP_NODELAY, TCP_DEFER_ACCEPT, TCP_FASTOPEN
+#include <sys/socket.h>
+#include <unistd.h>  // close()
+
+#include "../log/log.h"
+
+// 监听套接字的选项，每个监听套接字一份
+// 除backlog、defer_accept与fastopen外，其余选项在监听套接字上设置，由accept得到的连接继承，
+// 接受连接时不需要再为每个连接调用setsockopt
+struct ListenerOptions {
+    int backlog = 1024;        // 全连接队列长度，受net.core.somaxconn限制
+    bool reuse_port = false;   // SO_REUSEPORT，多个监听套接字绑定同一端口
+    bool linger = false;       // SO_LINGER，关闭时等待剩余数据发送完毕，最多linger_sec秒
+    int linger_sec = 3;
+    int defer_accept_sec = 5;  // TCP_DEFER_ACCEPT，连接收到数据后才唤醒accept，0为关闭
+    int fastopen_qlen = 256;   // TCP_FASTOPEN的队列长度，0为关闭，还需net.ipv4.tcp_fastopen开启服务端
+    bool nodelay = true;       // TCP_NODELAY，关闭Nagle算法，响应头与正文合帧由OutQueue的TCP_CORK负责
+    int rcvbuf = 0;            // SO_RCVBUF/SO_SNDBUF，0为使用内核的自动调节，设置后不再自动调节
+    int sndbuf = 0;
+    int busy_poll_us = 0;      // SO_BUSY_POLL，读空时忙轮询网卡队列的微秒数，0为关闭
+};
+
+class Listener {
+public:
+    // 创建绑定到port的非阻塞监听套接字并按opts设置选项，失败返回-1
+    // 必需的选项(SO_REUSEADDR、SO_REUSEPORT等)设置失败时返回-1，优化类选项失败时只记录警告
+    static int Create(int port, const ListenerOptions& opts);
+    // 以accept4接受一个连接，直接得到非阻塞、close-on-exec的套接字，没有新连接时返回-1
+    static int Accept(int listen_fd, struct sockaddr_in* addr);
+
+private:
+    static bool SetOpt_(int fd, int level, int name, int val, const char* what, bool required);
+};
+
+#endif
@@ -0,0 +1,518 @@
+#include "uringpoller.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+UringPoller::UringPoller(int max_event)
+    : ring_fd_(-1),
+      multishot_(false),
+      completion_(false),
+      sq_ptr_(MAP_FAILED),
+      sq_len_(0),
+      cq_ptr_(MAP_FAILED),
+      cq_len_(0),
+      sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+      sqes_len_(0),
+      sq_entries_(0),
+      sq_local_tail_(0),
+      pending_(0),
+      ts_{0, 0},
+      buf_ring_(static_cast<struct io_uring_buf*>(MAP_FAILED)),
+      buf_ring_len_(0),
+      recv_bufs_(nullptr),
+      buf_tail_(0),
+      next_seq_(0),
+      stalled_listen_(-1),
+      max_event_(max_event) {
+    assert(max_event > 0);
+    events_.reserve(max_event);
+}
+
+UringPoller::~UringPoller() {
+    if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_len_);
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_len_);
+    if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, sq_len_);
+    if (ring_fd_ >= 0) close(ring_fd_);
+    // 关闭io_uring实例后内核不再使用缓冲区环
+    if (buf_ring_ != MAP_FAILED) munmap(buf_ring_, buf_ring_len_);
+    delete[] recv_bufs_;
+}
+
+bool UringPoller::Init() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // 内核默认CQ容量为SQ的两倍
+    ring_fd_ = syscall(__NR_io_uring_setup, static_cast<unsigned>(max_event_), &params);
+    if (ring_fd_ < 0) return false;
+
+    sq_len_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_len_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+    }
+    sq_ptr_ = mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) return false;
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ptr_ = sq_ptr_;
+    } else {
+        cq_ptr_ =
+            mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED) return false;
+    }
+    sqes_len_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(
+        mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) return false;
+
+    char* sq = static_cast<char*>(sq_ptr_);
+    sq_entries_ = params.sq_entries;
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_local_tail_ = *sq_tail_;
+
+    char* cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // 在已可读的eventfd上试一次multishot poll，不从内核版本或特性位推断
+    int efd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd >= 0) {
+        struct io_uring_sqe probe;
+        memset(&probe, 0, sizeof(probe));
+        probe.opcode = IORING_OP_POLL_ADD;
+        probe.fd = efd;
+        probe.poll32_events = EPOLLIN;
+        probe.len = IORING_POLL_ADD_MULTI;
+        multishot_ = Probe_(probe);
+        close(efd);
+    }
+    return true;
+}
+
+bool UringPoller::EnableCompletion() {
+    if (completion_) return true;
+    if (!multishot_) return false;
+    // 环的内存需要按页对齐，由内核固定在内存中
+    buf_ring_len_ = kRecvBuffers * sizeof(struct io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_len_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) return false;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = kRecvBuffers;
+    reg.bgid = kBufGroup;
+    if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(ring, buf_ring_len_);
+        return false;
+    }
+    buf_ring_ = static_cast<struct io_uring_buf*>(ring);
+    recv_bufs_ = new char[kRecvBuffers * kRecvBufferSize];
+    for (unsigned i = 0; i < kRecvBuffers; ++i) used_bufs_.push_back(i);
+    ReturnBuffers_();
+
+    // multishot recv(6.0)晚于缓冲区环与multishot accept(5.19)，在socketpair上试一次
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0) return false;
+    bool supported = false;
+    if (write(fds[1], "x", 1) == 1) {
+        struct io_uring_sqe probe;
+        memset(&probe, 0, sizeof(probe));
+        probe.opcode = IORING_OP_RECV;
+        probe.fd = fds[0];
+        probe.ioprio = IORING_RECV_MULTISHOT;
+        probe.flags = IOSQE_BUFFER_SELECT;
+        probe.buf_group = kBufGroup;
+        supported = Probe_(probe);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    ReturnBuffers_();  // 试探时用掉的缓冲区
+    completion_ = supported;
+    return completion_;
+}
+
+bool UringPoller::AddListenFd(int fd) {
+    if (!completion_ || fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    Registration* reg = Register_(fd, EPOLLIN);
+    if (!reg) return false;
+    reg->listen = true;
+    PrepAccept_(fd, *reg);
+    return true;
+}
+
+bool UringPoller::AddRecvFd(int fd, uint32_t events) {
+    if (!completion_ || fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    Registration* reg = Register_(fd, events);
+    if (!reg) return false;
+    // 上一个连接的recv可能还没有结束，它的完成事件按序号丢弃
+    reg->recv = true;
+    reg->recv_first = next_seq_;
+    PrepPoll_(fd, *reg);
+    SetRecv_(fd, *reg);
+    return true;
+}
+
+bool UringPoller::SendAndClose(int fd, const char* data, size_t len) {
+    if (!completion_ || fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    // 硬链接：发送失败或只发送了一部分时同样关闭
+    struct io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->flags = IOSQE_IO_HARDLINK;
+    sqe->user_data = kIgnoreData;
+    sqe = GetSqe_();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = kIgnoreData;
+    return true;
+}
+
+bool UringPoller::AddFd(int fd, uint32_t events) {
+    if (fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    Registration* reg = Register_(fd, events);
+    if (!reg) return false;
+    PrepPoll_(fd, *reg);
+    SubmitIfForeign_();
+    return true;
+}
+
+bool UringPoller::ModFd(int fd, uint32_t events) {
+    if (fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    Registration& reg = Reg_(fd);
+    if (!reg.used) return false;
+    if (reg.armed) PrepRemove_(fd, reg);
+    reg.events = events;
+    reg.gen++;
+    PrepPoll_(fd, reg);
+    if (reg.recv) SetRecv_(fd, reg);
+    SubmitIfForeign_();
+    return true;
+}
+
+bool UringPoller::DelFd(int fd) {
+    if (fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    Registration& reg = Reg_(fd);
+    if (!reg.used) return false;
+    if (reg.armed) PrepRemove_(fd, reg);
+    if (reg.listen) PrepCancel_(UserData_(fd, reg.gen, ACCEPT));
+    if (reg.recv_live && !reg.cancelling) PrepCancel_(UserData_(fd, reg.recv_seq, RECV));
+    reg.used = false;
+    reg.events = 0;
+    reg.gen++;
+    if (stalled_listen_ >= 0 && stalled_listen_ != fd) {
+        Registration& stalled = regs_[stalled_listen_];
+        if (stalled.used && stalled.listen) PrepAccept_(stalled_listen_, stalled);
+    }
+    stalled_listen_ = -1;
+    SubmitIfForeign_();
+    return true;
+}
+
+int UringPoller::Wait(int timeout_ms) {
+    unsigned to_submit;
+    bool ready = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) != *cq_head_;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        owner_ = std::this_thread::get_id();
+        ReturnBuffers_();  // 上一批事件已处理完，数据不再使用
+        if (timeout_ms > 0 && !ready) {
+            // 超时请求在有其它完成事件时立即结束(off = 1)，不会残留在内核中
+            ts_.tv_sec = timeout_ms / 1000;
+            ts_.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+            struct io_uring_sqe* sqe = GetSqe_();
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->fd = -1;
+            sqe->addr = reinterpret_cast<uint64_t>(&ts_);
+            sqe->len = 1;
+            sqe->off = 1;
+            sqe->user_data = kTimeoutData;
+        }
+        to_submit = Flush_();
+    }
+
+    unsigned min_complete = (timeout_ms == 0 || ready) ? 0 : 1;
+    if (to_submit > 0 || min_complete > 0) {
+        if (Enter_(to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0) < 0 && errno != EINTR &&
+            errno != ETIME) {
+            return -1;
+        }
+    }
+
+    std::lock_guard<std::mutex> locker(mtx_);
+    events_.clear();
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != tail && events_.size() < max_event_) {
+        Complete_(&cqes_[head & *cq_mask_]);
+        ++head;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return static_cast<int>(events_.size());
+}
+
+int UringPoller::GetEventFd(size_t i) const {
+    assert(i < events_.size());
+    return events_[i].fd;
+}
+
+uint32_t UringPoller::GetEvents(size_t i) const {
+    assert(i < events_.size());
+    return events_[i].events;
+}
+
+int UringPoller::GetAccepted(size_t i) const {
+    assert(i < events_.size());
+    return events_[i].accepted;
+}
+
+const char* UringPoller::GetData(size_t i, size_t* len) const {
+    assert(i < events_.size());
+    *len = events_[i].len;
+    return events_[i].data;
+}
+
+void UringPoller::Complete_(const struct io_uring_cqe* cqe) {
+    if (cqe->user_data == kTimeoutData || cqe->user_data == kIgnoreData) return;
+    int fd = static_cast<int>(cqe->user_data & 0x3fffffff);
+    Kind kind = static_cast<Kind>((cqe->user_data >> 30) & 3);
+    uint32_t gen = static_cast<uint32_t>(cqe->user_data >> 32);
+    if (kind == RECV) {
+        CompleteRecv_(cqe, fd, gen);
+        return;
+    }
+    if (fd >= static_cast<int>(regs_.size()) || !regs_[fd].used || regs_[fd].gen != gen) {
+        return;  // 过期的完成事件
+    }
+    Registration& reg = regs_[fd];
+    if (kind == ACCEPT) {
+        if (cqe->res >= 0) events_.push_back({fd, EPOLLIN, cqe->res, nullptr, 0});
+        if (cqe->flags & IORING_CQE_F_MORE) return;
+        if (cqe->res == -EMFILE || cqe->res == -ENFILE) {
+            // fd用完时立即重新提交会反复失败，等有fd注销(通常是连接关闭)后再提交
+            stalled_listen_ = fd;
+        } else {
+            PrepAccept_(fd, reg);  // 内核结束了multishot accept
+        }
+        return;
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE)) reg.armed = false;
+
+    uint32_t events = cqe->res < 0 ? static_cast<uint32_t>(EPOLLERR) : static_cast<uint32_t>(cqe->res);
+    events_.push_back({fd, events, -1, nullptr, 0});
+    // LT模式：poll触发后即失效，重新注册，随下一次Wait一起提交
+    if (!reg.armed && !(reg.events & EPOLLONESHOT) && cqe->res >= 0) {
+        PrepPoll_(fd, reg);
+    }
+}
+
+void UringPoller::CompleteRecv_(const struct io_uring_cqe* cqe, int fd, uint32_t seq) {
+    const char* data = nullptr;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        data = recv_bufs_ + bid * kRecvBufferSize;
+        used_bufs_.push_back(bid);  // 事件处理完后归还，丢弃的数据也一样
+    }
+    // 序号早于本次注册的recv属于已关闭的连接
+    if (fd >= static_cast<int>(regs_.size()) || !regs_[fd].used || !regs_[fd].recv ||
+        static_cast<int32_t>(seq - regs_[fd].recv_first) < 0) {
+        return;
+    }
+    Registration& reg = regs_[fd];
+    bool last = !(cqe->flags & IORING_CQE_F_MORE);
+    if (last && seq == reg.recv_seq) {
+        reg.recv_live = false;
+        reg.cancelling = false;
+    }
+    // 已取消的recv在取消前收到的数据同样交给连接
+    if (cqe->res > 0) {
+        events_.push_back({fd, EPOLLIN, -1, data, static_cast<size_t>(cqe->res)});
+    } else if (cqe->res == 0) {
+        events_.push_back({fd, EPOLLIN | EPOLLRDHUP, -1, nullptr, 0});  // 对端关闭
+        return;
+    } else if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED) {
+        events_.push_back({fd, EPOLLERR, -1, nullptr, 0});
+        return;
+    }
+    // 缓冲区用完或内核结束了multishot recv：仍关注EPOLLIN时重新提交，缓冲区在下一次Wait提交前归还
+    if (last) SetRecv_(fd, reg);
+}
+
+struct io_uring_sqe* UringPoller::GetSqe_() {
+    // SQ已满，先提交已入队的请求
+    while (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+        Enter_(Flush_(), 0, 0);
+    }
+    unsigned index = sq_local_tail_ & *sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    ++sq_local_tail_;
+    ++pending_;
+    return sqe;
+}
+
+unsigned UringPoller::Flush_() {
+    // SQE填写完毕后才发布队尾，内核只会看到完整的请求
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+    unsigned to_submit = pending_;
+    pending_ = 0;
+    return to_submit;
+}
+
+void UringPoller::PrepPoll_(int fd, Registration& reg) {
+    // poll与epoll的事件位一致，去掉仅对epoll有意义的标志
+    uint32_t events = reg.events & ~(EPOLLET | EPOLLONESHOT);
+    if (reg.recv) {
+        // 可读由recv完成，对端关闭与出错也由recv报告，只有关注可写时才需要poll
+        events &= ~EPOLLIN;
+        if (!(events & EPOLLOUT)) return;
+    }
+    struct io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    if (multishot_ && (reg.events & EPOLLET) && !(reg.events & EPOLLONESHOT)) {
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+    sqe->user_data = UserData_(fd, reg.gen);
+    reg.armed = true;
+}
+
+void UringPoller::PrepRemove_(int fd, Registration& reg) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = UserData_(fd, reg.gen);
+    sqe->user_data = kIgnoreData;
+    reg.armed = false;
+}
+
+bool UringPoller::Probe_(const struct io_uring_sqe& probe) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    *sqe = probe;
+    sqe->user_data = kProbeData;
+    bool supported = false;
+    bool cancelled = false;
+    for (bool done = false; !done;) {
+        if (Enter_(Flush_(), 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) return false;
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const struct io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+            if (cqe->flags & IORING_CQE_F_BUFFER) used_bufs_.push_back(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe->user_data != kProbeData) continue;  // 取消请求自身的完成事件
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                done = true;  // 不支持时以错误结束，支持时在取消后结束
+            } else if (!cancelled) {
+                supported = true;
+                struct io_uring_sqe* cancel = GetSqe_();
+                cancel->opcode = IORING_OP_ASYNC_CANCEL;
+                cancel->fd = -1;
+                cancel->addr = kProbeData;
+                cancel->user_data = kIgnoreData;
+                cancelled = true;
+            }
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    return supported;
+}
+
+void UringPoller::PrepAccept_(int fd, Registration& reg) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = UserData_(fd, reg.gen, ACCEPT);
+}
+
+void UringPoller::PrepRecv_(int fd, Registration& reg) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;  // 由内核从缓冲区环中取缓冲区
+    sqe->buf_group = kBufGroup;
+    reg.recv_seq = next_seq_++;
+    reg.recv_live = true;
+    sqe->user_data = UserData_(fd, reg.recv_seq, RECV);
+}
+
+void UringPoller::PrepCancel_(uint64_t user_data) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = kIgnoreData;
+}
+
+void UringPoller::SetRecv_(int fd, Registration& reg) {
+    bool want = reg.events & EPOLLIN;
+    if (want && !reg.recv_live) {
+        PrepRecv_(fd, reg);
+    } else if (!want && reg.recv_live && !reg.cancelling) {
+        // 取消后等这个请求结束，仍关注EPOLLIN时再提交新的，同一连接上不会同时有两个recv
+        PrepCancel_(UserData_(fd, reg.recv_seq, RECV));
+        reg.cancelling = true;
+    }
+}
+
+void UringPoller::ProvideBuffer_(uint16_t bid) {
+    struct io_uring_buf* buf = &buf_ring_[buf_tail_ & (kRecvBuffers - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(recv_bufs_ + bid * kRecvBufferSize);
+    buf->len = kRecvBufferSize;
+    buf->bid = bid;
+    ++buf_tail_;
+}
+
+void UringPoller::ReturnBuffers_() {
+    if (used_bufs_.empty()) return;
+    for (uint16_t bid : used_bufs_) ProvideBuffer_(bid);
+    used_bufs_.clear();
+    // 缓冲区的信息填写完毕后才发布队尾，队尾位于第一个元素的resv
+    __atomic_store_n(&buf_ring_[0].resv, buf_tail_, __ATOMIC_RELEASE);
+}
+
+void UringPoller::SubmitIfForeign_() {
+    // 事件循环线程内的修改随下一次Wait提交；其它线程的修改需立即生效
+    if (std::this_thread::get_id() != owner_ && pending_ > 0) {
+        Enter_(Flush_(), 0, 0);
+    }
+}
+
+UringPoller::Registration* UringPoller::Register_(int fd, uint32_t events) {
+    Registration& reg = Reg_(fd);
+    if (reg.used) return nullptr;
+    uint32_t gen = reg.gen + 1;
+    reg = Registration();
+    reg.used = true;
+    reg.events = events;
+    reg.gen = gen;
+    return &reg;
+}
+
+UringPoller::Registration& UringPoller::Reg_(int fd) {
+    if (fd >= static_cast<int>(regs_.size())) {
+        regs_.resize(std::max<size_t>(fd + 1, regs_.size() * 2));
+    }
+    return regs_[fd];
+}
+
+int UringPoller::Enter_(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, nullptr, 0);
+}
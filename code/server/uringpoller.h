@@ -0,0 +1,161 @@
+#ifndef URING_POLLER_H
+#define URING_POLLER_H
+
+#include <assert.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/epoll.h>    // EPOLLIN等事件标志
+#include <sys/eventfd.h>  // eventfd()
+#include <sys/mman.h>     // mmap()
+#include <sys/socket.h>   // SOCK_NONBLOCK等accept标志
+#include <sys/syscall.h>  // syscall()
+#include <unistd.h>       // close()
+
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "eventbackend.h"
+
+// 基于io_uring的事件后端
+// fd的增删改以SQE的形式排队，与等待事件合并在同一次io_uring_enter中提交，省去每次epoll_ctl的系统调用；
+// ET模式使用多次触发(multishot)的poll，LT模式在事件触发后自动重新注册。
+// 其它线程(线程池模式下的工作线程)修改fd时立即提交，保证与epoll_ctl相同的可见性。
+// 完成模式下监听套接字使用multishot accept，连接使用multishot recv，数据由内核写入注册的缓冲区环(provided buffers)，
+// 事件处理完后在下一次Wait中归还；每个连接同一时间最多有一个recv请求，取消后等它结束再重新提交，数据不会乱序
+class UringPoller : public EventBackend {
+public:
+    explicit UringPoller(int max_event = 1024);
+    ~UringPoller() override;
+
+    // 创建io_uring实例，内核不支持时返回false
+    bool Init();
+
+    bool AddFd(int fd, uint32_t events) override;
+    bool ModFd(int fd, uint32_t events) override;
+    bool DelFd(int fd) override;
+
+    int Wait(int timeout_ms = -1) override;
+
+    int GetEventFd(size_t i) const override;
+    uint32_t GetEvents(size_t i) const override;
+
+    const char* Name() const override { return completion_ ? "io_uring(completion)" : "io_uring"; }
+
+    bool EnableCompletion() override;
+    bool AddListenFd(int fd) override;
+    bool AddRecvFd(int fd, uint32_t events) override;
+    bool SendAndClose(int fd, const char* data, size_t len) override;
+
+    int GetAccepted(size_t i) const override;
+    const char* GetData(size_t i, size_t* len) const override;
+
+    static const unsigned kRecvBuffers = 128;     // 缓冲区环中的缓冲区数量，必须是2的幂
+    static const size_t kRecvBufferSize = 4096;  // 每个缓冲区的大小，一次recv最多读入这么多
+
+private:
+    // fd的注册信息，gen用于区分同一fd先后的注册，丢弃过期的完成事件
+    struct Registration {
+        uint32_t events = 0;  // 关注的事件，含EPOLLET/EPOLLONESHOT
+        uint32_t gen = 0;     // 注册代数
+        bool used = false;    // 是否已注册
+        bool armed = false;   // 内核中是否有未完成的poll请求
+        // 完成模式
+        bool listen = false;       // 监听套接字，EPOLLIN由multishot accept完成
+        bool recv = false;         // 连接，EPOLLIN由multishot recv完成，poll只关注其余事件
+        bool recv_live = false;    // 内核中有recv请求，包括已取消但还没有结束的
+        bool cancelling = false;   // 已取消recv_seq，结束时若仍关注EPOLLIN再重新提交
+        uint32_t recv_seq = 0;     // 最近一次提交的recv请求的序号
+        uint32_t recv_first = 0;   // 本次注册的第一个recv请求的序号，更早的请求属于之前的连接
+    };
+
+    // 一个事件：就绪事件只有fd与events，完成模式下accept给出新连接，recv给出数据
+    struct Event {
+        int fd;
+        uint32_t events;
+        int accepted;
+        const char* data;
+        size_t len;
+    };
+
+    // user_data的低30位为fd，其上2位为请求类型，高32位为poll与accept的注册代数或recv的序号
+    enum Kind { POLL = 0, ACCEPT = 1, RECV = 2 };
+
+    static const uint64_t kTimeoutData = ~0ULL;      // 超时请求的user_data
+    static const uint64_t kIgnoreData = ~0ULL - 1;  // 无需处理的请求的user_data
+    static const uint64_t kProbeData = ~0ULL - 2;   // Probe_提交的请求的user_data
+    static const uint16_t kBufGroup = 0;            // 缓冲区环的组号
+
+    static uint64_t UserData_(int fd, uint32_t gen, Kind kind = POLL) {
+        return (static_cast<uint64_t>(gen) << 32) | (static_cast<uint64_t>(kind) << 30) | fd;
+    }
+
+    // 以下函数需持有mtx_
+    struct io_uring_sqe* GetSqe_();
+    void PrepPoll_(int fd, Registration& reg);
+    void PrepRemove_(int fd, Registration& reg);
+    void PrepAccept_(int fd, Registration& reg);
+    void PrepRecv_(int fd, Registration& reg);
+    void PrepCancel_(uint64_t user_data);
+    void SetRecv_(int fd, Registration& reg);        // 按关注的事件提交或取消recv
+    void Complete_(const struct io_uring_cqe* cqe);  // 处理一个完成事件，需要时加入events_
+    void CompleteRecv_(const struct io_uring_cqe* cqe, int fd, uint32_t seq);
+    void ProvideBuffer_(uint16_t bid);               // 把缓冲区放回环中，ReturnBuffers_时才对内核可见
+    void ReturnBuffers_();                           // 归还上一批事件用过的缓冲区
+    unsigned Flush_();  // 发布已入队的SQE，返回待提交数量
+    void SubmitIfForeign_();
+    Registration& Reg_(int fd);
+    Registration* Register_(int fd, uint32_t events);  // 开始一次新的注册，fd已注册时返回nullptr
+
+    int Enter_(unsigned to_submit, unsigned min_complete, unsigned flags);
+
+    // 提交一个multishot请求，完成事件带IORING_CQE_F_MORE时内核支持，随后取消并等到请求结束；
+    // 只在Init与EnableCompletion中、开始Wait之前调用
+    bool Probe_(const struct io_uring_sqe& probe);
+
+    int ring_fd_;
+    bool multishot_;   // 内核是否支持multishot poll，Init中实际提交一次确认
+    bool completion_;  // 是否已启用完成模式
+
+    // SQ与CQ环形队列
+    void* sq_ptr_;
+    size_t sq_len_;
+    void* cq_ptr_;
+    size_t cq_len_;
+    struct io_uring_sqe* sqes_;
+    size_t sqes_len_;
+
+    unsigned sq_entries_;
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_mask_;
+    unsigned* sq_array_;
+    unsigned sq_local_tail_;  // 尚未发布给内核的队尾
+    unsigned pending_;        // 已入队未提交的SQE数量
+
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned* cq_mask_;
+    struct io_uring_cqe* cqes_;
+
+    struct __kernel_timespec ts_;  // Wait的超时时间
+    std::thread::id owner_;        // 调用Wait的事件循环线程
+    std::mutex mtx_;
+
+    // 完成模式的缓冲区环
+    // 与内核共享的环，内核从中取缓冲区；C++中io_uring_buf_ring的柔性数组布局不可靠，按io_uring_buf数组访问
+    struct io_uring_buf* buf_ring_;
+    size_t buf_ring_len_;
+    char* recv_bufs_;                     // kRecvBuffers个缓冲区
+    uint16_t buf_tail_;                   // 环的队尾，ReturnBuffers_时发布
+    std::vector<uint16_t> used_bufs_;     // 本批事件用过、下一次Wait时归还的缓冲区
+    uint32_t next_seq_;                   // 下一个recv请求的序号
+    int stalled_listen_;                  // 因fd用完暂停accept的监听套接字，没有时为-1
+
+    size_t max_event_;
+    std::vector<Registration> regs_;  // 以fd为下标的注册信息
+    std::vector<Event> events_;       // 保存发生事件的数组
+};
+
+#endif
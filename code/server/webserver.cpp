@@ -2,14 +2,17 @@
 
 WebServer::WebServer(int port, int trig_mode, int timeout_ms, bool opt_linger, int sql_port, const char* sql_uesr_,
                      const char* sql_pwd, const char* db_name, int conn_pool_num, int thread_num, bool open_log,
-                     int log_level, int log_que_size)
+                     int log_level, int log_que_size, bool multi_reactor, int event_backend, const char* bundle,
+                     const ListenerOptions& listener)
     : port_(port),
-      open_linger_(opt_linger),
+      listener_opts_(listener),
       timeout_ms_(timeout_ms),
       is_close_(false),
-      timer_(new HeapTimer()),
-      thread_pool_(new ThreadPool(thread_num)),
-      epoller_(new Epoller()) {
+      multi_reactor_(multi_reactor),
+      loop_num_(multi_reactor ? thread_num : 1),
+      event_backend_(event_backend) {
+    listener_opts_.linger = opt_linger;
+    listener_opts_.reuse_port = multi_reactor_;
     // getcwd()函数用于获取当前工作目录，即当前进程所在的目录
     src_dir_ = getcwd(nullptr, 256);
     assert(src_dir_);
@@ -18,11 +21,31 @@ WebServer::WebServer(int port, int trig_mode, int timeout_ms, bool opt_linger, i
 
     HttpConn::user_count_ = 0;
     HttpConn::src_dir_ = src_dir_;
+    HttpConn::idle_timeout_ms_ = timeout_ms_;
+    bool use_bundle = bundle && FileCache::Instance().UseBundle(bundle);
+    InitRoutes_();
+    HttpConn::router_ = &router_;
     SqlConnPool::Instance().Init("localhost", sql_port, sql_uesr_, sql_pwd, db_name, conn_pool_num);
 
     InitEventMode_(trig_mode);
     if (!InitSocket_()) is_close_ = true;
 
+    if (!is_close_) {
+        if (!multi_reactor_) {
+            thread_pool_.reset(new ThreadPool(thread_num));
+        }
+        // 磁盘I/O线程池同时压缩较大的可压缩文件
+        if (FileCache::check_residency_ || FileCache::gzip_) {
+            disk_pool_.reset(new ThreadPool(kDiskThreads));
+            if (FileCache::gzip_) FileCache::Instance().SetCompressPool(disk_pool_.get());
+        }
+        slab_.reset(new ConnSlab());
+        for (size_t i = 0; i < listen_fds_.size(); ++i) {
+            loops_.emplace_back(new EventLoop(i, listen_fds_[i], timeout_ms_, listen_event_, conn_event_, slab_.get(),
+                                              thread_pool_.get(), event_backend_, disk_pool_.get()));
+        }
+    }
+
     if (open_log) {
         Log::Instance().Init(log_level, "./log", ".log", log_que_size);
         if (is_close_) {
@@ -30,121 +53,76 @@ WebServer::WebServer(int port, int trig_mode, int timeout_ms, bool opt_linger, i
         } else {
             LOG_INFO("========== Server init ==========");
             LOG_INFO("Port:%d, OpenLinger: %s", port_, opt_linger ? "true" : "false");
+            LOG_INFO("Listener backlog: %d, defer accept: %ds, fastopen: %d, nodelay: %s, rcvbuf: %d, sndbuf: %d, "
+                     "busy poll: %dus",
+                     listener_opts_.backlog, listener_opts_.defer_accept_sec, listener_opts_.fastopen_qlen,
+                     listener_opts_.nodelay ? "true" : "false", listener_opts_.rcvbuf, listener_opts_.sndbuf,
+                     listener_opts_.busy_poll_us);
             LOG_INFO("Listen Mode: %s, OpenConn Mode: %s", (listen_event_ & EPOLLET ? "ET" : "LT"),
                      (conn_event_ & EPOLLET ? "ET" : "LT"));
             LOG_INFO("LogSys level: %d", log_level);
-            LOG_INFO("srcDir: %s", HttpConn::src_dir_);
+            LOG_INFO("srcDir: %s", use_bundle ? bundle : HttpConn::src_dir_);
             LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", conn_pool_num, thread_num);
+            LOG_INFO("Reactor Mode: %s, EventLoop num: %d", multi_reactor_ ? "multi-reactor" : "reactor+threadpool",
+                     loop_num_);
+            LOG_INFO("Event Backend: %s", loops_.empty() ? "none" : loops_[0]->BackendName());
+            LOG_INFO("Connection Timer: %s", loops_.empty() ? "none" : loops_[0]->TimerName());
+            LOG_INFO("Timeout: idle %dms, header %dms, body %dms, write %dms, min rate %zu B/s", timeout_ms_,
+                     HttpConn::header_timeout_ms_, HttpConn::body_timeout_ms_, HttpConn::write_timeout_ms_,
+                     HttpConn::min_rate_);
+            LOG_INFO("Connection table capacity: %zu", slab_ ? slab_->Capacity() : 0);
         }
     }
 }
 
 WebServer::~WebServer() {
-    close(listen_fd_);
+    loops_.clear();
+    FileCache::Instance().SetCompressPool(nullptr);
+    FileCache::Stats stats = FileCache::Instance().GetStats();
+    LOG_INFO("File cache: hits %llu, misses %llu, evictions %llu, invalidations %llu, entries %zu, bytes %zu",
+             (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.evictions,
+             (unsigned long long)stats.invalidations, stats.entries, stats.bytes);
+    LOG_INFO("File cache: cold sends %llu, prefetched %llu bytes in %llu us", (unsigned long long)stats.cold,
+             (unsigned long long)stats.prefetched, (unsigned long long)stats.prefetch_us);
+    LOG_INFO("Connection timeouts: idle %llu, header %llu, body %llu, write %llu",
+             (unsigned long long)HttpConn::Timeouts(HttpConn::IDLE),
+             (unsigned long long)HttpConn::Timeouts(HttpConn::HEADER),
+             (unsigned long long)HttpConn::Timeouts(HttpConn::BODY),
+             (unsigned long long)HttpConn::Timeouts(HttpConn::WRITE));
+    for (int fd : listen_fds_) close(fd);
     is_close_ = true;
     free(src_dir_);
     SqlConnPool::Instance().ClosePool();
 }
 
 void WebServer::Start() {
-    int time_ms = -1;  // -1表无限等待
-    if (!is_close_) {
-        LOG_INFO("========== Server start ==========");
-    }
-
-    while (!is_close_) {
-        if (timeout_ms_ > 0) {
-            time_ms = timer_->GetNextTick();
-        }
-        int event_cnt = epoller_->Wait(time_ms);
-        for (int i = 0; i < event_cnt; ++i) {
-            // 处理事件
-            int fd = epoller_->GetEventFd(i);
-            uint32_t events = epoller_->GetEvents(i);
-            if (fd == listen_fd_) {  // 有新连接
-                DealListen_();
-            } else if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {  // 对端关闭写端，对端关闭，出错
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);    // 关闭连接
-            } else if (events & EPOLLIN) {  // 客户端发送数据
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);
-            } else if (events & EPOLLOUT) {  // 客户端可写
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);
-            } else {
-                LOG_ERROR("Unexpected event");
-            }
-        }
+    if (is_close_) return;
+    LOG_INFO("========== Server start ==========");
+    // 其余事件循环各占一个线程，第0个事件循环在当前线程运行
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < loops_.size(); ++i) {
+        threads.emplace_back(&EventLoop::Loop, loops_[i].get());
     }
+    loops_[0]->Loop();
+    for (auto& t : threads) t.join();
 }
 
 bool WebServer::InitSocket_() {
-    int ret;
-    struct sockaddr_in addr;
     // 端口号必须在0-65535之间，但其中0-1023为系统保留端口号
     if (port_ > 65535 || port_ < 1024) {
         LOG_ERROR("Port:%d error!", port_);
         return false;
     }
-
-    addr.sin_family = AF_INET;                 // ipv4
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);  // 任意ip
-    addr.sin_port = htons(port_);
-
-    struct linger opt_linger = {0};
-    if (open_linger_) {
-        // 优雅关闭，直到剩余数据发送完毕或超时
-        opt_linger.l_onoff = 1;   // 开启优雅关闭
-        opt_linger.l_linger = 3;  // 超时时间为3s
-    }
-    // ipv4 tcp
-    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_fd_ < 0) {
-        LOG_ERROR("Create socket error!", port_);
-        return false;
-    }
-    // 对listen_fd_设置优雅关闭
-    ret = setsockopt(listen_fd_, SOL_SOCKET, SO_LINGER, &opt_linger, sizeof(opt_linger));
-    if (ret < 0) {
-        close(listen_fd_);
-        LOG_ERROR("Init linger error!", port_);
-        return false;
-    }
-
-    // 设置端口复用
-    // 防止服务器重启后，端口被占用
-    int optval = 1;
-    ret = setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
-    if (ret == -1) {
-        LOG_DEBUG("set socket setsockopt error!");
-        close(listen_fd_);
-        return false;
-    }
-    // 将套接字地址绑定到套接字描述符listen_fd_上
-    ret = bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr));
-    if (ret < 0) {
-        LOG_ERROR("Bind Port:%d error!", port_);
-        close(listen_fd_);
-        return false;
-    }
-    // 将listen_fd_被动的监听套接字，开始监听客户端的连接请求。
-    ret = listen(listen_fd_, 1024);
-    if (ret < 0) {
-        LOG_ERROR("Listen port:%d error!", port_);
-        close(listen_fd_);
-        return false;
-    }
-
-    // 将listen_fd_添加到epoll中
-    ret = epoller_->AddFd(listen_fd_, listen_event_ | EPOLLIN);
-    if (ret == 0) {
-        LOG_ERROR("Add listen error!");
-        close(listen_fd_);
-        return false;
+    // 多Reactor模式下，每个事件循环拥有一个SO_REUSEPORT监听套接字，由内核在它们之间分配新连接
+    for (int i = 0; i < loop_num_; ++i) {
+        int fd = Listener::Create(port_, listener_opts_);
+        if (fd < 0) {
+            for (int opened : listen_fds_) close(opened);
+            listen_fds_.clear();
+            return false;
+        }
+        listen_fds_.push_back(fd);
     }
-    // 设置listen_fd_为非阻塞
-    SetFdNonblock(listen_fd_);
     LOG_INFO("Server port:%d", port_);
     return true;
 }
@@ -157,7 +135,8 @@ void WebServer::InitEventMode_(int trig_mode) {
     // 是为了控制同一个套接字文件描述符在一个时间点只能被一个线程进行处理，避免多个线程同时对同一个套接字进行处理而出现错误的情况。
     // conn_event_为什么要设置EPOLLHUP？
     // 因为在ET模式下，如果不设置EPOLLHUP，当客户端关闭连接时，服务器端会一直收到EPOLLIN事件，导致服务器端的CPU占用率很高。
-    conn_event_ = EPOLLONESHOT | EPOLLHUP;
+    // 多Reactor模式下连接只由所属的事件循环线程处理，不需要EPOLLONESHOT
+    conn_event_ = multi_reactor_ ? EPOLLHUP : (EPOLLONESHOT | EPOLLHUP);
 
     switch (trig_mode) {
         case 0:
@@ -179,120 +158,13 @@ void WebServer::InitEventMode_(int trig_mode) {
     }
     HttpConn::is_ET_ = (conn_event_ & EPOLLET);
 }
-// 添加客户端到epoll中
-void WebServer::AddClient_(int fd, sockaddr_in addr) {
-    assert(fd > 0);
-    users_[fd].Init(fd, addr);  // 为新用户http连接初始化
-    if (timeout_ms_ > 0) {      // 如果设置了超时时间，就添加到定时器中
-        timer_->Add(fd, timeout_ms_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
-    }
-    epoller_->AddFd(fd, EPOLLIN | conn_event_);  // 添加到epoll中
-    SetFdNonblock(fd);                           // 设置非阻塞
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
-}
-
-void WebServer::DealListen_() {
-    struct sockaddr_in addr;
-    socklen_t len = sizeof(addr);
-
-    do {
-        int fd = accept(listen_fd_, (struct sockaddr*)&addr, &len);
-        if (fd <= 0)
-            return;  // 从这里退出
-        else if (HttpConn::user_count_ >= kMaxFd) {
-            SendError_(fd, "Server busy!");
-            LOG_WARN("Clients is full!");
-            return;
-        }
-        AddClient_(fd, addr);
-        // 若listen_fd_是非阻塞的，accept可能会一次性返回多个连接,所以需要循环accept
-    } while (listen_event_ & EPOLLET);
-}
-
-void WebServer::DealWrite_(HttpConn* client) {
-    assert(client);
-    ExtentTime_(client);  // 更新定时器
-    // 添加写任务
-    thread_pool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
-}
-
-void WebServer::DealRead_(HttpConn* client) {
-    assert(client);
-    ExtentTime_(client);  // 更新定时器
-    // 添加读任务
-    thread_pool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
-}
-
-// 向对端发送错误信息
-void WebServer::SendError_(int fd, const char* info) {
-    assert(fd > 0);
-    int ret = send(fd, info, strlen(info), 0);
-    if (ret < 0) {
-        LOG_WARN("send error to client[%d] error!", fd);
-    }
-    close(fd);
-}
-//  更新定时器，因为有新事件发生，所以需要更新定时器
-void WebServer::ExtentTime_(HttpConn* client) {
-    assert(client);
-    if (timeout_ms_ > 0) {
-        timer_->Adjust(client->GetFd(), timeout_ms_);
-    }
-}
-// 回调函数，当连接超时被调用。从epoll中删除，从定时器中删除
-void WebServer::CloseConn_(HttpConn* client) {
-    assert(client);
-    LOG_INFO("Client[%d] quit!", client->GetFd());
-    epoller_->DelFd(client->GetFd());
-    client->Close();
-}
-
-// 读取客户端数据
-void WebServer::OnRead_(HttpConn* client) {
-    assert(client);
-    int ret = -1;
-    int read_errno = 0;
-
-    ret = client->Read(&read_errno);
-    if (ret <= 0 && read_errno != EAGAIN) {  // 读取失败
-        CloseConn_(client);
-        return;
-    }
-    OnProcess(client);  
-}
-// 向客户端写数据
-void WebServer::OnWrite_(HttpConn* client) {
-    assert(client);
-    int ret = -1;
-    int write_errno = 0;
-
-    ret = client->Write(&write_errno);
-    if (client->ToWriteBytes() == 0) {
-        // 传输完成
-        if (client->IsKeepAlive()) {  
-            OnProcess(client);
-            return;
-        }
-    } else if (ret < 0) {
-        if (write_errno == EAGAIN) {
-            // 继续传输
-            epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLOUT);
-            return;
-        }
-    }
-    CloseConn_(client);
-}
 
-void WebServer::OnProcess(HttpConn* client) {
-
-    if (client->Process()) {
-        epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLOUT);
-    } else {
-        epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLIN);
+void WebServer::InitRoutes_() {
+    // 默认页面：不带后缀的页面名映射到对应的html文件
+    router_.Any("/", Router::ServeFile("/index.html"));
+    for (const char* page : {"index", "register", "login", "welcome", "video", "picture"}) {
+        router_.Any(std::string("/") + page, Router::ServeFile(std::string("/") + page + ".html"));
     }
-}
-
-int WebServer::SetFdNonblock(int fd) {
-    assert(fd > 0);
-    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
+    UserHandler::AddRoutes(router_);
+    router_.Compile();
 }
@@ -10,65 +10,65 @@
 #include <unistd.h>  // close()
 
 #include <iostream>
-#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <vector>
 
+#include "../http/filecache.h"
 #include "../http/httpconn.h"
+#include "../http/router.h"
+#include "../http/userhandler.h"
 #include "../log/log.h"
 #include "../pool/sqlconnRAII.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/threadpool.h"
-#include "../timer/heaptimer.h"
-#include "epoller.h"
+#include "eventloop.h"
+#include "listener.h"
 
 class WebServer {
 public:
     // 初始化数据库连接池，线程池，触发模式，监听端口，优雅关闭连接，日志
+    // multi_reactor为true时，启动thread_num个事件循环(one loop per thread)，每个循环使用SO_REUSEPORT独立监听；
+    // 为false时，使用单个事件循环 + thread_num个线程的线程池
+    // event_backend为事件后端(EventBackend::EPOLL/IO_URING)，io_uring不可用时回退为epoll
+    // bundle为packer生成的静态资源打包文件，不为空时静态文件都从中提供，不访问资源目录
+    // listener为每个监听套接字的选项，其中linger与reuse_port由opt_linger与multi_reactor决定
     WebServer(int port, int trig_mode, int timeout_ms, bool opt_linger, int sql_port, const char* sql_uesr_,
               const char* sql_pwd, const char* db_name, int conn_pool_num, int thread_num, bool open_log, int log_level,
-              int log_que_size);
+              int log_que_size, bool multi_reactor = false, int event_backend = EventBackend::EPOLL,
+              const char* bundle = nullptr, const ListenerOptions& listener = ListenerOptions());
 
     ~WebServer();
     void Start();
 
 private:
-    // 初始化socket连接
+    // 初始化socket连接，为每个事件循环创建监听套接字
     bool InitSocket_();
     // 初始化触发模式
     void InitEventMode_(int trig_mode);
-    // 添加客户端
-    void AddClient_(int fd, sockaddr_in addr);
+    // 注册路由并编译路由表
+    void InitRoutes_();
 
-    // 处理连接请求，并调用AddClient_
-    void DealListen_();
-    // 处理读写事件
-    void DealWrite_(HttpConn* client);
-    void DealRead_(HttpConn* client);
+    static const int kDiskThreads = 2;  // 磁盘I/O线程数
 
-    void SendError_(int fd, const char* info);
-    void ExtentTime_(HttpConn* client);
-    void CloseConn_(HttpConn* client);
-
-    void OnRead_(HttpConn* client);
-    void OnWrite_(HttpConn* client);
-    void OnProcess(HttpConn* client);
-
-    static const int kMaxFd = 65536;
-    static int SetFdNonblock(int fd);
-
-    int port_;          // 端口
-    bool open_linger_;  // 优雅关闭连接
-    int timeout_ms_;    //  超时时间
-    bool is_close_;     //  是否关闭
-    int listen_fd_;     //   监听套接字
-    char* src_dir_;     //   资源目录
+    int port_;            // 端口
+    ListenerOptions listener_opts_;  // 监听套接字选项
+    int timeout_ms_;      //  超时时间
+    bool is_close_;       //  是否关闭
+    bool multi_reactor_;  //  是否为多Reactor模式
+    int loop_num_;        //  事件循环数量
+    int event_backend_;   //  事件后端类型
+    char* src_dir_;       //   资源目录
 
     uint32_t listen_event_;  //  监听事件
     u_int32_t conn_event_;   //  连接事件
 
-    std::unique_ptr<HeapTimer> timer_;         //  定时器
-    std::unique_ptr<ThreadPool> thread_pool_;  //  线程池
-    std::unique_ptr<Epoller> epoller_;         //  epoll
-    std::unordered_map<int, HttpConn> users_;  //  用户列表以及对应的http连接
+    Router router_;                                  //  路由表，启动后只读
+    std::unique_ptr<ConnSlab> slab_;                 //  以fd为下标的连接表
+    std::vector<int> listen_fds_;                    //  监听套接字，每个事件循环一个
+    std::unique_ptr<ThreadPool> thread_pool_;        //  线程池，仅Reactor+线程池模式使用
+    std::unique_ptr<ThreadPool> disk_pool_;          //  磁盘I/O线程池，把不在页缓存中的文件内容读入内存，压缩较大的文件
+    std::vector<std::unique_ptr<EventLoop>> loops_;  //  事件循环
 };
 
 #endif
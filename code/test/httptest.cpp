@@ -0,0 +1,760 @@
+// HTTP连接的端到端测试：HttpConn的一端是socketpair，另一端由测试充当客户端，不需要启动服务器与数据库
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../buffer/buffer.h"
+#include "../http/compressor.h"
+#include "../http/filecache.h"
+#include "../http/hpack.h"
+#include "../http/httpform.h"
+#include "../http/httpconn.h"
+#include "../http/httpparser.h"
+#include "../http/router.h"
+#include "../http/simdscan.h"
+
+static int failures = 0;
+
+// 可变参数，条件中可以出现花括号初始化列表中的逗号
+#define CHECK(...)                                                                    \
+    do {                                                                              \
+        if (!(__VA_ARGS__)) {                                                         \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #__VA_ARGS__); \
+            ++failures;                                                               \
+        }                                                                             \
+    } while (0)
+
+// 一个连接：客户端写入请求，HttpConn读取、处理并写出全部响应，返回客户端收到的数据
+class Conn {
+public:
+    Conn() {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds_);
+        fcntl(fds_[0], F_SETFL, O_NONBLOCK);
+        fcntl(fds_[1], F_SETFL, O_NONBLOCK);
+        sockaddr_in addr = {};
+        conn_.Init(fds_[0], addr);
+    }
+    ~Conn() {
+        conn_.Close();
+        close(fds_[1]);
+    }
+
+    std::string Exchange(const std::string& request) {
+        write(fds_[1], request.data(), request.size());
+        int err = 0;
+        conn_.Read(&err);
+        while (conn_.Process()) {
+            while (conn_.ToWriteBytes() > 0) {
+                if (conn_.Write(&err) < 0 && err != EAGAIN && err != EINPROGRESS) break;
+                Drain_();
+            }
+            if (!conn_.IsKeepAlive()) break;
+        }
+        Drain_();
+        std::string result;
+        result.swap(received_);
+        return result;
+    }
+
+    bool Idle() const { return conn_.Idle(); }
+    size_t MemoryBytes() const { return conn_.MemoryBytes(); }
+
+private:
+    void Drain_() {
+        char buf[65536];
+        ssize_t n;
+        while ((n = read(fds_[1], buf, sizeof(buf))) > 0) received_.append(buf, n);
+    }
+
+    int fds_[2];
+    HttpConn conn_;
+    std::string received_;
+};
+
+// 按Content-length把客户端收到的HTTP/1.1数据拆成各个响应，head[i]为true时第i个响应没有正文
+struct Response {
+    std::string header;
+    std::string body;
+};
+static std::vector<Response> SplitResponses(const std::string& bytes, const std::vector<bool>& head) {
+    std::vector<Response> responses;
+    size_t pos = 0;
+    for (size_t i = 0; i < head.size(); ++i) {
+        size_t end = bytes.find("\r\n\r\n", pos);
+        if (end == std::string::npos) break;
+        Response response;
+        response.header = bytes.substr(pos, end + 4 - pos);
+        pos = end + 4;
+        size_t len = 0;
+        size_t field = response.header.find("Content-length: ");
+        if (field != std::string::npos) len = std::stoul(response.header.substr(field + 16));
+        if (!head[i]) {
+            response.body = bytes.substr(pos, len);
+            pos += len;
+        }
+        responses.push_back(response);
+    }
+    if (pos != bytes.size()) responses.push_back({bytes.substr(pos), ""});  // 多出的数据
+    return responses;
+}
+
+// HEAD与GET流水线：HEAD响应的Content-length与GET相同但没有正文，之后的响应紧接着它的响应头
+static void TestHeadPipelined() {
+    Conn conn;
+    std::string request = "HEAD /index.html HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n"
+                          "GET /index.html HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n"
+                          "HEAD /hello HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n"
+                          "GET /hello HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    std::vector<Response> responses = SplitResponses(conn.Exchange(request), {true, false, true, false});
+    CHECK(responses.size() == 4);
+    if (responses.size() != 4) return;
+    for (const Response& response : responses) CHECK(response.header.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CHECK(responses[1].body.size() > 0);
+    CHECK(responses[0].header.find("Content-length: " + std::to_string(responses[1].body.size()) + "\r\n") !=
+          std::string::npos);
+    CHECK(responses[3].body == "hello");
+    CHECK(responses[2].header.find("Content-length: 5\r\n") != std::string::npos);
+}
+
+// 重复的Content-Length取值不同时返回400并关闭连接，相同时正常处理
+static void TestDuplicateContentLength() {
+    {
+        Conn conn;
+        std::string response = conn.Exchange(
+            "POST /echo HTTP/1.1\r\nHost: x\r\nContent-Length: 3\r\nContent-Length: 5\r\n\r\nabcde");
+        CHECK(response.compare(0, 12, "HTTP/1.1 400") == 0);
+    }
+    {
+        Conn conn;
+        std::string response = conn.Exchange(
+            "POST /echo HTTP/1.1\r\nHost: x\r\nContent-Length: 3\r\nContent-Length: 3\r\n\r\nabc");
+        CHECK(response.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+        CHECK(response.size() >= 5 && response.compare(response.size() - 5, 5, "3:abc") == 0);
+    }
+}
+
+static std::string Gunzip(const std::string& data) {
+    z_stream stream = {};
+    if (inflateInit2(&stream, 15 + 16) != Z_OK) return std::string();
+    std::string out;
+    char buf[16384];
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = data.size();
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+        stream.next_out = (Bytef*)buf;
+        stream.avail_out = sizeof(buf);
+        ret = inflate(&stream, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    return ret == Z_STREAM_END ? out : std::string();
+}
+
+static std::string ReadFile(const std::string& path) {
+    std::ifstream file(std::string(TEST_RESOURCES) + path, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+// 响应头中name字段的值，没有时为空
+static std::string HeaderValue(const std::string& header, const std::string& name) {
+    size_t pos = header.find("\r\n" + name + ": ");
+    if (pos == std::string::npos) return std::string();
+    pos += name.size() + 4;
+    return header.substr(pos, header.find("\r\n", pos) - pos);
+}
+
+static std::string Get(const std::string& path, const std::string& headers) {
+    Conn conn;
+    return conn.Exchange("GET " + path + " HTTP/1.1\r\nHost: x\r\n" + headers + "\r\n");
+}
+
+// 各级别的查找实现与逐字节查找的结果相同：长度跨过16与32字节的块边界，起点取各种对齐，
+// 目标字符在每一个位置出现(之前的字节都不是目标字符)或不出现；高于本机CPU的级别按Best()处理
+static void TestSimdScan() {
+    std::vector<char> storage(256 + 64);
+    for (int level = SimdScan::SCALAR; level <= SimdScan::AVX2; ++level) {
+        auto lv = static_cast<SimdScan::Level>(level);
+        for (size_t align = 0; align < 32; ++align) {
+            char* buf = storage.data() + align;
+            for (size_t len = 0; len <= 100; ++len) {
+                for (size_t hit = 0; hit <= len; ++hit) {  // hit == len表示没有目标字符
+                    for (size_t i = 0; i < len; ++i) buf[i] = static_cast<char>('a' + i % 26);
+                    if (hit < len) buf[hit] = '\r';
+                    if (hit + 1 < len) buf[hit + 1] = '+';  // 目标之后的字符不影响结果
+                    const char* end = buf + len;
+                    CHECK(SimdScan::FindChar(lv, buf, end, '\r') == buf + hit);
+                    CHECK(SimdScan::FindEither(lv, buf, end, '%', '\r') == buf + hit);
+                    // 字母每26个字节重复一次，'z'可能在'\r'之前
+                    const char* first = std::find_if(static_cast<const char*>(buf), end, [](char ch) { return ch == 'z' || ch == '\r'; });
+                    CHECK(SimdScan::FindEither(lv, buf, end, 'z', '\r') == first);
+                }
+            }
+        }
+        // 0x80以上的字节：cmpeq与pcmpestri按无符号字节比较
+        std::string high(70, '\xff');
+        high[40] = '\x80';
+        CHECK(SimdScan::FindChar(lv, high.data(), high.data() + high.size(), '\x80') == high.data() + 40);
+        CHECK(SimdScan::FindEither(lv, high.data(), high.data() + high.size(), '\x80', '\x81') == high.data() + 40);
+    }
+    // "\r\n"跨块：'\r'在块的最后一个字节，前面还有不跟'\n'的'\r'
+    for (size_t pos = 1; pos < 70; ++pos) {
+        std::string line(80, 'x');
+        line[pos - 1] = '\r';
+        line[pos] = '\r';
+        line[pos + 1] = '\n';
+        CHECK(HttpParser::FindCrlf(line.data(), line.data() + line.size()) == line.data() + pos);
+        CHECK(HttpParser::FindCrlf(line.data(), line.data() + pos + 1) == line.data() + pos + 1);  // '\n'不在范围内
+    }
+}
+
+// ReadFd：空缓冲区读到少量数据时复制到小块，读到的多时接管尾块；已有未读数据时追加，数据保持连续
+static void TestBufferReadFd() {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    std::string small(100, 's');
+    std::string big(40 * 1024, 'b');
+    std::string more(30 * 1024, 'm');  // 超出尾块剩余的可写空间
+    int err = 0;
+    Buffer buff;
+    CHECK(write(fds[1], small.data(), small.size()) == static_cast<ssize_t>(small.size()));
+    CHECK(buff.ReadFd(fds[0], &err) == static_cast<ssize_t>(small.size()));
+    CHECK(buff.Capacity() == 1024);
+    CHECK(buff.RetrieveAllToStr() == small);
+    buff.Release();
+
+    CHECK(write(fds[1], big.data(), big.size()) == static_cast<ssize_t>(big.size()));
+    CHECK(buff.ReadFd(fds[0], &err) == static_cast<ssize_t>(big.size()));
+    CHECK(buff.Capacity() == Buffer::kSpillSize);
+    CHECK(buff.ReadableBytes() == big.size());
+    buff.Retrieve(1000);
+
+    CHECK(write(fds[1], more.data(), more.size()) == static_cast<ssize_t>(more.size()));
+    CHECK(buff.ReadFd(fds[0], &err) == static_cast<ssize_t>(more.size()));
+    CHECK(buff.RetrieveAllToStr() == big.substr(1000) + more);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void TestParseRange() {
+    std::vector<std::pair<size_t, size_t>> ranges;
+    typedef std::vector<std::pair<size_t, size_t>> Ranges;
+    CHECK(HttpParser::ParseRange("bytes=0-99", 1000, ranges) && ranges == Ranges{{0, 100}});
+    CHECK(HttpParser::ParseRange("bytes=-100", 1000, ranges) && ranges == Ranges{{900, 1000}});  // 后缀
+    CHECK(HttpParser::ParseRange("bytes=-5000", 1000, ranges) && ranges == Ranges{{0, 1000}});   // 后缀超过文件
+    CHECK(HttpParser::ParseRange("bytes=990-", 1000, ranges) && ranges == Ranges{{990, 1000}});  // 到结尾
+    CHECK(HttpParser::ParseRange("bytes=900-5000", 1000, ranges) && ranges == Ranges{{900, 1000}});
+    CHECK(HttpParser::ParseRange("Bytes = 1-2 , ,4-5", 1000, ranges) && ranges == Ranges{{1, 3}, {4, 6}});
+    // 重叠与相邻的范围合并，按起点排序
+    CHECK(HttpParser::ParseRange("bytes=50-60,0-10,5-20,21-30", 1000, ranges) &&
+          ranges == Ranges{{0, 31}, {50, 61}});
+    CHECK(HttpParser::ParseRange("bytes=-10,0-", 1000, ranges) && ranges == Ranges{{0, 1000}});
+    // 没有可满足的范围：返回true，范围为空(416)
+    CHECK(HttpParser::ParseRange("bytes=1000-", 1000, ranges) && ranges.empty());
+    CHECK(HttpParser::ParseRange("bytes=-0", 1000, ranges) && ranges.empty());
+    CHECK(HttpParser::ParseRange("bytes=0-0", 0, ranges) && ranges.empty());
+    // 语法错误：忽略Range
+    CHECK(!HttpParser::ParseRange("items=0-1", 1000, ranges));
+    CHECK(!HttpParser::ParseRange("bytes=5-1", 1000, ranges));
+    CHECK(!HttpParser::ParseRange("bytes=1", 1000, ranges));
+    CHECK(!HttpParser::ParseRange("bytes=a-1", 1000, ranges));
+    CHECK(!HttpParser::ParseRange("bytes=", 1000, ranges));
+    CHECK(!HttpParser::ParseRange("bytes=99999999999999999999-", 1000, ranges));
+    std::string many = "bytes=0-0";
+    for (size_t i = 1; i < HttpParser::kMaxRanges; ++i) many += "," + std::to_string(i * 2) + "-" + std::to_string(i * 2);
+    CHECK(HttpParser::ParseRange(many, 1000, ranges) && ranges.size() == HttpParser::kMaxRanges);
+    CHECK(!HttpParser::ParseRange(many + ",100-100", 1000, ranges));  // 超过kMaxRanges
+}
+
+// 单个范围、multipart/byteranges、416与If-Range
+static void TestRangeResponses() {
+    std::string file = ReadFile("index.html");
+    CHECK(file.size() > 2000);
+    std::string size = std::to_string(file.size());
+
+    std::vector<Response> r = SplitResponses(Get("/index.html", "Range: bytes=100-199\r\n"), {false});
+    CHECK(r.size() == 1 && r[0].header.compare(0, 12, "HTTP/1.1 206") == 0);
+    if (r.size() == 1) {
+        CHECK(HeaderValue(r[0].header, "Content-Range") == "bytes 100-199/" + size);
+        CHECK(r[0].body == file.substr(100, 100));
+    }
+
+    r = SplitResponses(Get("/index.html", "Range: bytes=-10\r\n"), {false});
+    CHECK(r.size() == 1 && r[0].body == file.substr(file.size() - 10));
+
+    // 多个范围：各部分带自己的Content-Type与Content-Range，重叠的范围已合并
+    r = SplitResponses(Get("/index.html", "Range: bytes=0-9,5-19,1000-1009\r\n"), {false});
+    CHECK(r.size() == 1);
+    if (r.size() == 1) {
+        std::string type = HeaderValue(r[0].header, "Content-type");
+        CHECK(type.compare(0, 31, "multipart/byteranges; boundary=") == 0);
+        std::string boundary = type.substr(31);
+        std::string expected = "--" + boundary + "\r\nContent-Type: text/html\r\nContent-Range: bytes 0-19/" + size +
+                               "\r\n\r\n" + file.substr(0, 20) + "\r\n--" + boundary +
+                               "\r\nContent-Type: text/html\r\nContent-Range: bytes 1000-1009/" + size + "\r\n\r\n" +
+                               file.substr(1000, 10) + "\r\n--" + boundary + "--\r\n";
+        CHECK(r[0].body == expected);
+    }
+
+    r = SplitResponses(Get("/index.html", "Range: bytes=" + size + "-\r\n"), {false});
+    CHECK(r.size() == 1 && r[0].header.compare(0, 12, "HTTP/1.1 416") == 0);
+    if (r.size() == 1) CHECK(HeaderValue(r[0].header, "Content-Range") == "bytes */" + size);
+
+    // 语法错误的Range被忽略
+    r = SplitResponses(Get("/index.html", "Range: bytes=5-1\r\n"), {false});
+    CHECK(r.size() == 1 && r[0].header.compare(0, 12, "HTTP/1.1 200") == 0 && r[0].body == file);
+
+    // If-Range：ETag强比较或与Last-Modified相同时按范围响应，否则发送整个文件
+    r = SplitResponses(Get("/index.html", ""), {false});
+    CHECK(r.size() == 1);
+    if (r.size() != 1) return;
+    std::string etag = HeaderValue(r[0].header, "ETag");
+    std::string last_modified = HeaderValue(r[0].header, "Last-Modified");
+    CHECK(!etag.empty() && !last_modified.empty());
+    r = SplitResponses(Get("/index.html", "Range: bytes=0-9\r\nIf-Range: " + etag + "\r\n"), {false});
+    CHECK(r.size() == 1 && r[0].body == file.substr(0, 10));
+    r = SplitResponses(Get("/index.html", "Range: bytes=0-9\r\nIf-Range: W/" + etag + "\r\n"), {false});
+    CHECK(r.size() == 1 && r[0].body == file);  // 弱标签不能用于If-Range
+    r = SplitResponses(Get("/index.html", "Range: bytes=0-9\r\nIf-Range: \"other\"\r\n"), {false});
+    CHECK(r.size() == 1 && r[0].body == file);
+    r = SplitResponses(Get("/index.html", "Range: bytes=0-9\r\nIf-Range: " + last_modified + "\r\n"), {false});
+    CHECK(r.size() == 1 && r[0].body == file.substr(0, 10));
+    r = SplitResponses(Get("/index.html", "Range: bytes=0-9\r\nIf-Range: Thu, 01 Jan 1970 00:00:00 GMT\r\n"),
+                       {false});
+    CHECK(r.size() == 1 && r[0].body == file);
+}
+
+// 条件请求：If-None-Match(弱比较、列表、*)优先于If-Modified-Since，gzip版本有自己的ETag
+static void TestNotModified() {
+    std::string file = ReadFile("index.html");
+    std::vector<Response> r = SplitResponses(Get("/index.html", ""), {false});
+    CHECK(r.size() == 1);
+    if (r.size() != 1) return;
+    std::string etag = HeaderValue(r[0].header, "ETag");
+    std::string last_modified = HeaderValue(r[0].header, "Last-Modified");
+    auto code = [](const std::string& path, const std::string& headers) {
+        std::vector<Response> r = SplitResponses(Get(path, headers), {false});
+        return r.size() == 1 ? r[0].header.substr(9, 3) : std::string();
+    };
+
+    r = SplitResponses(Get("/index.html", "If-None-Match: " + etag + "\r\n"), {false});
+    CHECK(r.size() == 1);
+    if (r.size() == 1) {
+        CHECK(r[0].header.compare(0, 12, "HTTP/1.1 304") == 0);
+        CHECK(r[0].body.empty());
+        CHECK(HeaderValue(r[0].header, "ETag") == etag);
+        CHECK(HeaderValue(r[0].header, "Content-length").empty());
+    }
+    CHECK(code("/index.html", "If-None-Match: W/" + etag + "\r\n") == "304");
+    CHECK(code("/index.html", "If-None-Match: \"a\", " + etag + "\r\n") == "304");
+    CHECK(code("/index.html", "If-None-Match: *\r\n") == "304");
+    CHECK(code("/index.html", "If-None-Match: \"other\"\r\n") == "200");
+    CHECK(code("/index.html", "If-Modified-Since: " + last_modified + "\r\n") == "304");
+    CHECK(code("/index.html", "If-Modified-Since: Thu, 01 Jan 1970 00:00:00 GMT\r\n") == "200");
+    CHECK(code("/index.html", "If-Modified-Since: not a date\r\n") == "200");
+    // If-None-Match存在时忽略If-Modified-Since
+    CHECK(code("/index.html", "If-None-Match: \"other\"\r\nIf-Modified-Since: " + last_modified + "\r\n") == "200");
+
+    // gzip版本的ETag带"-gz"，只与该版本匹配
+    r = SplitResponses(Get("/index.html", "Accept-Encoding: gzip\r\n"), {false});
+    CHECK(r.size() == 1);
+    if (r.size() != 1) return;
+    std::string gz_etag = HeaderValue(r[0].header, "ETag");
+    CHECK(HeaderValue(r[0].header, "Content-Encoding") == "gzip");
+    CHECK(gz_etag == etag.substr(0, etag.size() - 1) + "-gz\"");
+    CHECK(Gunzip(r[0].body) == file);
+    r = SplitResponses(Get("/index.html", "Accept-Encoding: gzip\r\nIf-None-Match: " + gz_etag + "\r\n"), {false});
+    CHECK(r.size() == 1 && r[0].header.compare(0, 12, "HTTP/1.1 304") == 0);
+    if (r.size() == 1) {
+        CHECK(HeaderValue(r[0].header, "ETag") == gz_etag);
+        CHECK(HeaderValue(r[0].header, "Content-Encoding") == "gzip");
+    }
+    CHECK(code("/index.html", "If-None-Match: " + gz_etag + "\r\n") == "200");
+    CHECK(code("/index.html", "Accept-Encoding: gzip\r\nIf-None-Match: " + etag + "\r\n") == "200");
+
+    // HEAD的304与流水线：304之后的200响应紧接着304的响应头
+    Conn conn;
+    std::string keep = "Host: x\r\nConnection: keep-alive\r\n";
+    std::string request = "HEAD /index.html HTTP/1.1\r\n" + keep + "If-None-Match: " + etag + "\r\n\r\n" +
+                          "GET /index.html HTTP/1.1\r\n" + keep + "If-None-Match: " + etag + "\r\n\r\n" +
+                          "GET /index.html HTTP/1.1\r\n" + keep + "\r\n" +
+                          "GET /index.html HTTP/1.1\r\n" + keep + "If-Modified-Since: " + last_modified + "\r\n\r\n";
+    r = SplitResponses(conn.Exchange(request), {true, false, false, false});
+    CHECK(r.size() == 4);
+    if (r.size() != 4) return;
+    CHECK(r[0].header.compare(0, 12, "HTTP/1.1 304") == 0);
+    CHECK(r[1].header.compare(0, 12, "HTTP/1.1 304") == 0 && r[1].body.empty());
+    CHECK(r[2].header.compare(0, 12, "HTTP/1.1 200") == 0 && r[2].body == file);
+    CHECK(r[3].header.compare(0, 12, "HTTP/1.1 304") == 0 && r[3].body.empty());
+}
+
+// 超过inline_compress_size_的文件放入缓存后由压缩线程池压缩：完成前发送原文件(已带Vary)，完成后发送gzip版本；
+// 没有线程池时不压缩
+static void TestAsyncGzip() {
+    ThreadPool pool(1);
+    FileCache::Instance().SetCompressPool(&pool);
+    std::string text = ReadFile("js/jquery.js");
+    CHECK(text.size() > FileCache::inline_compress_size_);
+    std::vector<Response> r = SplitResponses(Get("/js/jquery.js", "Accept-Encoding: gzip\r\n"), {false});
+    CHECK(r.size() == 1);
+    if (r.size() != 1) return;
+    CHECK(HeaderValue(r[0].header, "Vary") == "Accept-Encoding");
+    if (HeaderValue(r[0].header, "Content-Encoding").empty()) CHECK(r[0].body == text);
+    for (int i = 0; i < 500 && HeaderValue(r[0].header, "Content-Encoding").empty(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        r = SplitResponses(Get("/js/jquery.js", "Accept-Encoding: gzip\r\n"), {false});
+        if (r.size() != 1) return;
+    }
+    CHECK(HeaderValue(r[0].header, "Content-Encoding") == "gzip");
+    CHECK(Gunzip(r[0].body) == text);
+    FileCache::Instance().SetCompressPool(nullptr);
+
+    r = SplitResponses(Get("/css/animate.css", "Accept-Encoding: gzip\r\n"), {false});
+    CHECK(r.size() == 1 && HeaderValue(r[0].header, "Content-Encoding").empty() &&
+          HeaderValue(r[0].header, "Vary").empty() && r[0].body == ReadFile("css/animate.css"));
+}
+
+static std::string StreamedText() {
+    std::string text;
+    for (int i = 0; i < 2000; ++i) text += "line " + std::to_string(i) + "\n";
+    return text;
+}
+
+// 分段生成的正文边生成边压缩，解压后与原文相同；不接受压缩时原样发送并带Vary
+static void TestStreamedCompression() {
+    Conn conn;
+    std::string request = "GET /stream HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\nAccept-Encoding: gzip\r\n\r\n"
+                          "GET /stream HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n";
+    std::vector<Response> responses = SplitResponses(conn.Exchange(request), {false, false});
+    CHECK(responses.size() == 2);
+    if (responses.size() != 2) return;
+    CHECK(responses[0].header.find("Content-Encoding: gzip\r\n") != std::string::npos);
+    CHECK(responses[0].body.size() < StreamedText().size());
+    CHECK(Gunzip(responses[0].body) == StreamedText());
+    CHECK(responses[1].header.find("Content-Encoding") == std::string::npos);
+    CHECK(responses[1].header.find("Vary: Accept-Encoding\r\n") != std::string::npos);
+    CHECK(responses[1].body == StreamedText());
+
+    CHECK(!Compressor::Compressible("font/woff"));
+    CHECK(!Compressor::Compressible("font/woff2"));
+    CHECK(Compressor::Compressible("font/ttf"));
+    CHECK(Compressor::Compressible("text/html; charset=utf-8"));
+}
+
+// 路由的处理函数把名字写入g_route，Route返回path匹配的路由名与参数，如"user id=7"，没有匹配时返回"none"
+static std::string g_route;
+
+static Router::Handler Named(const char* name) {
+    return [name](HttpRequest&, HttpResponse&) { g_route = name; };
+}
+
+static std::string Route(const Router& router, std::string_view method, std::string_view path) {
+    Router::Params params;
+    const Router::Handler* handler = router.Match(method, path, params);
+    if (!handler) return "none";
+    HttpRequest request;
+    HttpResponse response;
+    (*handler)(request, response);
+    std::string result = g_route;
+    for (auto& [name, value] : params) result += " " + std::string(name) + "=" + std::string(value);
+    return result;
+}
+
+// 匹配优先级：普通段 > 参数段 > 前缀；更具体的分支走不通时回溯到参数段与前缀，并撤销回溯分支上的参数
+static void TestRouterPrecedence() {
+    Router router;
+    router.Get("/", Named("root"));
+    router.Get("/users/new", Named("new"));
+    router.Get("/users/new/edit", Named("new-edit"));
+    router.Get("/users/:id", Named("user"));
+    router.Get("/users/:id/posts/:post", Named("post"));
+    router.Get("/users/*", Named("users-prefix"));
+    router.Get("/files/:dir/:name", Named("file"));
+    router.Get("/files/*", Named("files-prefix"));
+    router.Any("/any", Named("any"));
+    router.Post("/any", Named("any-post"));
+    router.Compile();
+
+    CHECK(Route(router, "GET", "/") == "root");
+    CHECK(Route(router, "GET", "/users/new") == "new");                   // 普通段优先于参数段
+    CHECK(Route(router, "GET", "/users/7") == "user id=7");
+    CHECK(Route(router, "GET", "/users/7?tab=1") == "user id=7");         // 查询字符串不参与匹配
+    CHECK(Route(router, "GET", "/users/new/edit") == "new-edit");
+    // "new"分支没有posts，回溯到参数段
+    CHECK(Route(router, "GET", "/users/new/posts/3") == "post id=new post=3");
+    // 参数分支也走不通，回溯到前缀，参数分支上的id被撤销
+    CHECK(Route(router, "GET", "/users/7/posts") == "users-prefix *=7/posts");
+    CHECK(Route(router, "GET", "/users/new/other/x") == "users-prefix *=new/other/x");
+    CHECK(Route(router, "GET", "/users") == "users-prefix *=");            // 前缀也匹配自身，剩余部分为空
+    CHECK(Route(router, "GET", "/users/") == "user id=");                 // 空段由参数段匹配
+    CHECK(Route(router, "GET", "/files/a/b") == "file dir=a name=b");
+    CHECK(Route(router, "GET", "/files/a/b/c") == "files-prefix *=a/b/c");
+    CHECK(Route(router, "GET", "/files/a") == "files-prefix *=a");
+    // 方法：精确方法优先，HEAD使用GET的路由，空方法匹配其余方法
+    CHECK(Route(router, "POST", "/any") == "any-post");
+    CHECK(Route(router, "PUT", "/any") == "any");
+    CHECK(Route(router, "HEAD", "/users/7") == "user id=7");
+    CHECK(Route(router, "POST", "/users/7") == "none");
+    CHECK(Route(router, "GET", "/missing") == "none");
+    CHECK(Route(router, "GET", "relative") == "none");
+}
+
+// 把multipart的各个事件记录成一个字符串，相邻的数据段合并，结果与数据的分段方式无关
+class PartLog : public MultipartParser::PartHandler {
+public:
+    bool OnPartBegin(const MultipartParser::Part& part) override {
+        log += "[" + std::string(part.name) + "|" + std::string(part.filename) + "|" + std::string(part.content_type) + "]";
+        return true;
+    }
+    bool OnPartData(const char* data, size_t len) override {
+        log.append(data, len);
+        return true;
+    }
+    bool OnPartEnd() override {
+        log += "[end]";
+        return true;
+    }
+
+    std::string log;
+};
+
+// 依次在cuts的位置切开body并逐段交给解析器，返回事件记录，解析失败时返回"failed"
+static std::string ParseMultipart(const std::string& body, const std::vector<size_t>& cuts) {
+    PartLog log;
+    MultipartParser parser;
+    if (!parser.Init("multipart/form-data; boundary=xyz", &log)) return "failed";
+    size_t pos = 0;
+    for (size_t cut : cuts) {
+        if (!parser.OnData(body.data() + pos, cut - pos)) return "failed";
+        pos = cut;
+    }
+    if (!parser.OnData(body.data() + pos, body.size() - pos) || !parser.OnFinish()) return "failed";
+    return log.log;
+}
+
+// 分隔符"\r\n--xyz"可能在任意位置被切开，数据中还有分隔符的前缀("\r\n--xy"、"\r\r\n--")；
+// 一次交给解析器、逐字节交给解析器、在任意一个位置切成两段的结果都相同
+static void TestMultipartSplit() {
+    std::string body = "preamble\r\n--xyz\r\n"
+                       "Content-Disposition: form-data; name=\"a\"\r\n\r\n"
+                       "1\r\n--xy\r\r\n--x\r\n"
+                       "\r\n--xyz\r\n"
+                       "Content-Disposition: form-data; name=\"f\"; filename=\"f.txt\"\r\nContent-Type: text/plain\r\n\r\n"
+                       "\r\n\r\n--\r\n--xyZ"
+                       "\r\n--xyz--\r\nepilogue";
+    std::string expected = "[a||]1\r\n--xy\r\r\n--x\r\n[end][f|f.txt|text/plain]\r\n\r\n--\r\n--xyZ[end]";
+    CHECK(ParseMultipart(body, {}) == expected);
+
+    std::vector<size_t> bytes;
+    for (size_t i = 1; i < body.size(); ++i) bytes.push_back(i);
+    CHECK(ParseMultipart(body, bytes) == expected);
+
+    for (size_t i = 0; i <= body.size(); ++i) {
+        std::string result = ParseMultipart(body, {i});
+        CHECK(result == expected);
+        if (result != expected) fprintf(stderr, "  split at %zu\n", i);
+    }
+    // 分隔符被切成三段：每一对切点都落在第二个分隔符内
+    size_t second = body.find("\r\n--xyz\r\nContent-Disposition: form-data; name=\"f\"");
+    for (size_t i = second; i <= second + 7; ++i) {
+        for (size_t j = i; j <= second + 7; ++j) CHECK(ParseMultipart(body, {i, j}) == expected);
+    }
+
+    // 没有结束分隔符、分隔符之后既不是"\r\n"也不是"--"
+    CHECK(ParseMultipart("--xyz\r\n\r\ndata\r\n--xy", {}) == "failed");
+    CHECK(ParseMultipart("--xyz\r\n\r\ndata\r\n--xyzab", {}) == "failed");
+    // 第一个分隔符之前没有"\r\n"
+    CHECK(ParseMultipart("--xyz\r\n\r\nv\r\n--xyz--", {3}) == "[||]v[end]");
+}
+
+// HTTP/2帧与HPACK(只用不索引的字面量)
+static std::string Frame(uint8_t type, uint8_t flags, uint32_t stream_id, const std::string& payload) {
+    std::string frame;
+    frame += static_cast<char>(payload.size() >> 16);
+    frame += static_cast<char>(payload.size() >> 8);
+    frame += static_cast<char>(payload.size());
+    frame += static_cast<char>(type);
+    frame += static_cast<char>(flags);
+    frame += static_cast<char>(stream_id >> 24);
+    frame += static_cast<char>(stream_id >> 16);
+    frame += static_cast<char>(stream_id >> 8);
+    frame += static_cast<char>(stream_id);
+    return frame + payload;
+}
+
+static std::string Literal(const std::string& name, const std::string& value) {
+    std::string field(1, '\0');
+    field += static_cast<char>(name.size());
+    field += name;
+    field += static_cast<char>(value.size());
+    return field + value;
+}
+
+// 收集客户端收到的帧中stream_id的DATA负载
+static std::string StreamData(const std::string& bytes, uint32_t stream_id) {
+    std::string data;
+    for (size_t pos = 0; pos + 9 <= bytes.size();) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(bytes.data() + pos);
+        size_t len = (p[0] << 16) | (p[1] << 8) | p[2];
+        uint32_t id = ((p[5] & 0x7f) << 24) | (p[6] << 16) | (p[7] << 8) | p[8];
+        if (pos + 9 + len > bytes.size()) break;
+        if (p[3] == 0 && id == stream_id) data.append(bytes, pos + 9, len);
+        pos += 9 + len;
+    }
+    return data;
+}
+
+static void TestH2Post() {
+    Conn conn;
+    std::string body = "user=abc&password=123";
+    std::string headers = Literal(":method", "POST") + Literal(":scheme", "http") + Literal(":path", "/echo") +
+                          Literal(":authority", "x") + Literal("content-type", "application/x-www-form-urlencoded");
+    std::string request = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + Frame(4, 0, 0, "") + Frame(1, 0x4, 1, headers) +
+                          Frame(0, 0x1, 1, body);
+    std::string response = conn.Exchange(request);
+    CHECK(StreamData(response, 1) == "21:" + body);
+}
+
+// 请求体还没有收完的HTTP/2流使连接不空闲，内存超限时不能作为空闲连接关闭
+static void TestH2OpenStreamNotIdle() {
+    Conn conn;
+    std::string headers = Literal(":method", "POST") + Literal(":scheme", "http") + Literal(":path", "/echo") +
+                          Literal(":authority", "x");
+    std::string request = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + Frame(4, 0, 0, "") + Frame(1, 0x4, 1, headers) +
+                          Frame(0, 0, 1, "user=");
+    conn.Exchange(request);
+    CHECK(!conn.Idle());
+    std::string response = conn.Exchange(Frame(0, 0x1, 1, "abc"));
+    CHECK(StreamData(response, 1) == "8:user=abc");
+    CHECK(conn.Idle());
+}
+
+// 流中缓存的请求体计入连接的内存，流结束后释放
+static void TestH2MemoryBytes() {
+    Conn conn;
+    conn.Exchange("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + Frame(4, 0, 0, ""));
+    size_t before = conn.MemoryBytes();
+    std::string headers = Literal(":method", "POST") + Literal(":scheme", "http") + Literal(":path", "/echo") +
+                          Literal(":authority", "x");
+    for (int i = 0; i < 20; ++i) headers += Literal("x-padding", std::string(100, 'p'));  // 解码后的请求头
+    std::string request = Frame(1, 0x4, 1, headers);
+    for (int i = 0; i < 3; ++i) request += Frame(0, 0, 1, std::string(16000, 'a'));
+    conn.Exchange(request);
+    size_t buffered = conn.MemoryBytes();
+    CHECK(buffered >= before + 3 * 16000 + 2000);
+    std::string response = conn.Exchange(Frame(0, 0x1, 1, "b"));
+    CHECK(StreamData(response, 1).size() == sizeof("48001:") - 1 + 48001);
+    CHECK(conn.MemoryBytes() + 48000 <= buffered);
+}
+
+// 解码客户端收到的帧中stream_id的响应头(HEADERS与CONTINUATION)
+static HpackDecoder::HeaderList StreamHeaders(const std::string& bytes, uint32_t stream_id, HpackDecoder& decoder) {
+    std::string block;
+    HpackDecoder::HeaderList headers;
+    for (size_t pos = 0; pos + 9 <= bytes.size();) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(bytes.data() + pos);
+        size_t len = (p[0] << 16) | (p[1] << 8) | p[2];
+        uint32_t id = ((p[5] & 0x7f) << 24) | (p[6] << 16) | (p[7] << 8) | p[8];
+        if (pos + 9 + len > bytes.size()) break;
+        if ((p[3] == 1 || p[3] == 9) && id == stream_id) {
+            block.append(bytes, pos + 9, len);
+            bool too_large = false;
+            if ((p[4] & 0x4) && !decoder.Decode(reinterpret_cast<const uint8_t*>(block.data()), block.size(), headers,
+                                                SIZE_MAX, too_large)) {
+                headers.clear();
+            }
+        } else if (p[3] == 1 || p[3] == 9) {  // 其它流的头部块也要解码，保持动态表一致
+            HpackDecoder::HeaderList other;
+            bool too_large = false;
+            if (p[4] & 0x4) decoder.Decode(p + 9, len, other, SIZE_MAX, too_large);
+        }
+        pos += 9 + len;
+    }
+    return headers;
+}
+
+static std::string Status(const HpackDecoder::HeaderList& headers) {
+    for (auto& [name, value] : headers) {
+        if (name == ":status") return value;
+    }
+    return std::string();
+}
+
+// HPACK炸弹：一个4KB的动态表条目被一字节的索引引用上万次，解码后的头部列表超过SETTINGS_MAX_HEADER_LIST_SIZE时
+// 不再展开并返回431；动态表仍保持一致，同一连接上之后的请求正常处理
+static void TestH2HeaderListLimit() {
+    Conn conn;
+    std::string value(4000, 'a');
+    std::string big = "\x40\x05x-big\x7f";  // 加入动态表的字面量，值的长度用多字节整数编码
+    size_t rest = value.size() - 127;
+    while (rest >= 128) {
+        big += static_cast<char>((rest & 0x7f) | 0x80);
+        rest >>= 7;
+    }
+    big += static_cast<char>(rest);
+    big += value;
+    std::string pseudo = Literal(":method", "GET") + Literal(":scheme", "http") + Literal(":path", "/index.html") +
+                         Literal(":authority", "x");
+    std::string block = pseudo + big + std::string(60000, '\xbe');  // 0xbe：动态表的第一个条目(62)
+    std::string request = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + Frame(4, 0, 0, "");
+    for (size_t pos = 0; pos < block.size(); pos += Http2Conn::kMaxFrameSize) {
+        std::string piece = block.substr(pos, Http2Conn::kMaxFrameSize);
+        bool last = pos + Http2Conn::kMaxFrameSize >= block.size();
+        request += Frame(pos == 0 ? 1 : 9, (last ? 0x4 : 0) | (pos == 0 ? 0x1 : 0), 1, piece);
+    }
+    request += Frame(1, 0x5, 3, pseudo + "\xbe");
+    std::string response = conn.Exchange(request);
+    HpackDecoder decoder;
+    CHECK(Status(StreamHeaders(response, 1, decoder)) == "431");
+    HpackDecoder decoder2;
+    CHECK(Status(StreamHeaders(response, 3, decoder2)) == "200");
+    CHECK(StreamData(response, 3).size() > 0);
+}
+
+int main() {
+    Router router;
+    router.Post("/echo", [](HttpRequest& request, HttpResponse& response) {
+        BodyBuffer& body = request.Body();
+        response.SetContent(std::to_string(body.Size()) + ":" + body.Memory(), "text/plain");
+    });
+    router.Get("/hello", [](HttpRequest&, HttpResponse& response) { response.SetContent("hello", "text/plain"); });
+    router.Get("/stream", [](HttpRequest&, HttpResponse& response) {
+        response.BeginContent("text/plain");
+        for (int i = 0; i < 2000; ++i) response.AppendContent("line " + std::to_string(i) + "\n");
+    });
+    router.Compile();
+    HttpConn::router_ = &router;
+    HttpConn::src_dir_ = TEST_RESOURCES;
+    HttpConn::is_ET_ = true;
+
+    TestHeadPipelined();
+    TestDuplicateContentLength();
+    TestStreamedCompression();
+    TestAsyncGzip();
+    TestMultipartSplit();
+    TestRouterPrecedence();
+    TestSimdScan();
+    TestBufferReadFd();
+    TestParseRange();
+    TestRangeResponses();
+    TestNotModified();
+    TestH2Post();
+    TestH2OpenStreamNotIdle();
+    TestH2MemoryBytes();
+    TestH2HeaderListLimit();
+
+    if (failures == 0) printf("httptest ok\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -50,13 +50,16 @@ void HeapTimer::SwapNode_(size_t i, size_t j) {
 
     std::swap(heap_[i], heap_[j]);
     ref_[heap_[i].id] = i;
-    ref_[heap_[j].id] = i;
+    ref_[heap_[j].id] = j;
 }
 
 void HeapTimer::Adjust(int id, int timeout) {
     assert(!heap_.empty() && ref_.count(id) > 0);
-    heap_[ref_[id]].expires = Clock::now() + MS(timeout);
-    SiftDown_(ref_[id], heap_.size());
+    size_t i = ref_[id];
+    heap_[i].expires = TimeService::NowMs() + timeout;
+    if (!SiftDown_(i, heap_.size())) {
+        SiftUp_(i);
+    }
 }
 
 void HeapTimer::Add(int id, int timeout, const TimeoutCallBack& cb) {
@@ -66,11 +69,11 @@ void HeapTimer::Add(int id, int timeout, const TimeoutCallBack& cb) {
         // 新节点，入堆
         i = heap_.size();
         ref_[id] = i;
-        heap_.push_back({id, Clock::now() + MS(timeout), cb});
+        heap_.push_back({id, TimeService::NowMs() + timeout, cb});
         SiftUp_(i);
     } else {
         i = ref_[id];
-        heap_[i].expires = Clock::now() + MS(timeout);
+        heap_[i].expires = TimeService::NowMs() + timeout;
         heap_[i].cb = cb;
         if (!SiftDown_(i, heap_.size())) {
             SiftUp_(i);
@@ -97,13 +100,16 @@ void HeapTimer::Tick() {
         return;
     }
 
+    uint64_t now = TimeService::NowMs();  // 事件循环本轮缓存的时间
     while (!heap_.empty()) {
-        TimerNode node = heap_.front();
-        if (std::chrono::duration_cast<MS>(node.expires - Clock::now()).count() > 0) {
+        TimerNode& node = heap_.front();
+        if (node.expires > now) {
             break;
         }
-        node.cb();
+        // 先出堆再回调，回调中可以添加定时器；回调移出节点，不复制
+        TimeoutCallBack cb = std::move(node.cb);
         Pop();
+        cb();
     }
 }
 
@@ -116,8 +122,8 @@ int HeapTimer::GetNextTick() {
     Tick();
     int64_t res = -1;
     if (!heap_.empty()) {
-        res = std::chrono::duration_cast<MS>(heap_.front().expires - Clock::now()).count();
-        if (res < 0) res = 0;
+        uint64_t now = TimeService::NowMs();
+        res = heap_.front().expires > now ? heap_.front().expires - now : 0;
     }
     return res;
 }
@@ -6,21 +6,18 @@
 
 #include <algorithm>
 #include <cassert>
-#include <chrono>  // 时间库
 #include <functional>
 #include <queue>
 #include <unordered_map>
 
 #include "../log/log.h"
+#include "timeservice.h"
 
 typedef std::function<void()> TimeoutCallBack;
-typedef std::chrono::high_resolution_clock Clock;  // 时钟
-typedef std::chrono::milliseconds MS;              // 以毫秒为单位的时间量的类型
-typedef Clock::time_point TimeStamp;               // 时间戳/时间点
 
 struct TimerNode {
     int id;
-    TimeStamp expires;
+    uint64_t expires;  // 到期时间，TimeService::NowMs()的毫秒数
     TimeoutCallBack cb;
     bool operator<(const TimerNode& t) const { return expires < t.expires; }
 };
@@ -29,7 +26,7 @@ struct HeapTimer {
 public:
     HeapTimer() { heap_.reserve(64); }
     ~HeapTimer() { Clear(); }
-    void Adjust(int id, int timeout);
+    void Adjust(int id, int timeout);  // 重新设置id的超时时间，可以提前或延后
     void Add(int id, int timeout, const TimeoutCallBack& cb);
     void DoWork(int id);
     void Clear();
@@ -0,0 +1,74 @@
+#include "timeservice.h"
+
+#include <stdio.h>   // snprintf
+#include <string.h>  // memcpy
+
+#include "../http/httpparser.h"
+
+TimeService::Second TimeService::seconds_[kSlots];
+std::mutex TimeService::mtx_;
+
+TimeService::Cache& TimeService::Local_() {
+    static thread_local Cache cache;
+    return cache;
+}
+
+int64_t TimeService::ReadUs_(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t TimeService::Update() {
+    Cache& cache = Local_();
+    cache.mono_us = ReadUs_(CLOCK_MONOTONIC);
+    if (!cache.valid || cache.mono_us >= cache.next_sync_us) {
+        // 每秒读取一次墙上时间校准偏移，系统时间被调整时最多1秒后跟上
+        cache.wall_offset_us = ReadUs_(CLOCK_REALTIME) - cache.mono_us;
+        cache.next_sync_us = cache.mono_us + kSyncIntervalUs;
+        cache.valid = true;
+    }
+    At((cache.mono_us + cache.wall_offset_us) / 1000000);  // 新的一秒由第一个发现的事件循环格式化，响应与日志直接使用
+    return cache.mono_us / 1000;
+}
+
+uint64_t TimeService::NowMs() {
+    const Cache& cache = Local_();
+    return (cache.valid ? cache.mono_us : ReadUs_(CLOCK_MONOTONIC)) / 1000;
+}
+
+int64_t TimeService::WallUs() {
+    const Cache& cache = Local_();
+    return cache.valid ? cache.mono_us + cache.wall_offset_us : ReadUs_(CLOCK_REALTIME);
+}
+
+const TimeService::Second& TimeService::At(time_t sec) {
+    Second& second = seconds_[sec % kSlots];
+    if (second.sec.load(std::memory_order_acquire) == sec) return second;
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (second.sec.load(std::memory_order_relaxed) == sec) return second;  // 其它线程已格式化
+    // 写入这一秒的槽位后再发布，读取其它槽位的线程不受影响
+    localtime_r(&sec, &second.local);
+    const struct tm& t = second.local;
+    char prefix[64];  // 按int的最大宽度留出空间，实际长度为kLogPrefixLen
+    snprintf(prefix, sizeof(prefix), "%04d-%02d-%02d %02d:%02d:%02d.", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+             t.tm_hour, t.tm_min, t.tm_sec);
+    memcpy(second.log_prefix, prefix, kLogPrefixLen);
+    memcpy(second.date_line, "Date: ", 6);
+    size_t len = 6 + HttpParser::FormatHttpDate(sec, second.date_line + 6);
+    memcpy(second.date_line + len, "\r\n", 2);
+    second.date_len = len + 2;
+    second.sec.store(sec, std::memory_order_release);
+    return second;
+}
+
+std::string_view TimeService::DateHeader() {
+    const Second& second = At(WallUs() / 1000000);
+    return std::string_view(second.date_line, second.date_len);
+}
+
+std::string_view TimeService::Date() {
+    std::string_view line = DateHeader();
+    return line.substr(6, line.size() - 8);  // 去掉"Date: "与"\r\n"
+}
@@ -0,0 +1,52 @@
+#ifndef TIME_SERVICE_H
+#define TIME_SERVICE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+#include <mutex>
+#include <string_view>
+
+// 时间服务：事件循环每轮调用一次Update()，读取一次单调时钟缓存在本线程，墙上时间由单调时钟加上每秒校准一次的偏移得到；
+// 之后本线程的定时器、日志与响应读取时间都使用缓存，不再调用时钟。
+// 没有调用过Update()的线程(线程池、日志刷新、inotify等)读取时直接调用vDSO时钟。
+// 墙上时间按秒预先格式化为本地时间、日志时间前缀与HTTP的Date行，每秒只格式化一次，各线程共享
+class TimeService {
+public:
+    // 某一秒预先格式化的时间
+    struct Second {
+        std::atomic<time_t> sec;  // 格式化完成后发布，读取前检查
+        struct tm local;          // 本地时间
+        char log_prefix[20];      // 日志时间前缀"YYYY-MM-DD HH:MM:SS."，后接微秒，不以'\0'结尾
+        char date_line[48];       // "Date: <IMF-fixdate>\r\n"
+        size_t date_len;
+    };
+    static const size_t kLogPrefixLen = 20;
+
+    // 刷新本线程缓存的时间，秒数变化时格式化新的一秒；返回单调时钟的毫秒数
+    static uint64_t Update();
+    static uint64_t NowMs();  // CLOCK_MONOTONIC的毫秒数
+    static int64_t WallUs();  // CLOCK_REALTIME的微秒数，事件循环线程中与系统时间的调整最多相差1秒
+    // sec这一秒格式化后的时间，还没有格式化时先格式化；返回的槽位在kSlots秒后才被重新写入
+    static const Second& At(time_t sec);
+    static std::string_view DateHeader();  // 当前秒的Date行
+    static std::string_view Date();        // 当前秒的HTTP日期
+
+private:
+    struct Cache {
+        int64_t mono_us = 0;
+        int64_t wall_offset_us = 0;  // 墙上时间与单调时钟之差
+        int64_t next_sync_us = 0;    // 下次校准偏移的单调时间
+        bool valid = false;          // 本线程调用过Update()
+    };
+    static Cache& Local_();
+    static int64_t ReadUs_(clockid_t clock);
+    static const int64_t kSyncIntervalUs = 1000000;
+
+    static const int kSlots = 4;
+    static Second seconds_[kSlots];  // 按秒数取模存放
+    static std::mutex mtx_;          // 格式化新的一秒
+};
+
+#endif
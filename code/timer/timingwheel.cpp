@@ -0,0 +1,221 @@
+#include "timingwheel.h"
+
+namespace {
+// words中从from开始的第一个非零位，没有时返回-1
+int FirstBit(const uint64_t* words, int nwords, int from) {
+    for (int w = from >> 6; w < nwords; ++w) {
+        uint64_t bits = words[w];
+        if (w == (from >> 6)) bits &= ~0ULL << (from & 63);
+        if (bits) return w * 64 + __builtin_ctzll(bits);
+    }
+    return -1;
+}
+}  // namespace
+
+TimingWheel::TimingWheel(ExpireCallBack on_expire)
+    : root_bits_{}, level_bits_{}, now_(TimeService::NowMs()), armed_(0), count_(0), on_expire_(std::move(on_expire)) {
+    for (TimerEntry& head : root_) head.prev = head.next = &head;
+    for (auto& level : levels_) {
+        for (TimerEntry& head : level) head.prev = head.next = &head;
+    }
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd_ < 0) LOG_ERROR("Create timerfd error: %d", errno);
+}
+
+TimingWheel::~TimingWheel() {
+    // 条目嵌入在使用者的对象中，可能比时间轮活得更久，断开它们与哨兵的链接
+    auto detach = [](TimerEntry* head) {
+        while (head->next != head) Unlink_(head->next);
+    };
+    for (TimerEntry& head : root_) detach(&head);
+    for (auto& level : levels_) {
+        for (TimerEntry& head : level) detach(&head);
+    }
+    if (timer_fd_ >= 0) close(timer_fd_);
+}
+
+void TimingWheel::Add(TimerEntry* entry, uint64_t expires) {
+    assert(entry);
+    if (Linked(entry)) {
+        Unlink_(entry);
+        --count_;
+    }
+    entry->expires = expires;
+    Insert_(entry);
+    ++count_;
+    if (armed_ == 0 || entry->expires < armed_) Arm_();
+}
+
+void TimingWheel::Refresh(TimerEntry* entry, uint64_t expires) {
+    assert(entry);
+    if (!Linked(entry)) {
+        Add(entry, expires);
+        return;
+    }
+    if (expires >= entry->expires) {
+        entry->expires = expires;  // 延后：留在原来的槽中，轮到时再重新放入
+        return;
+    }
+    Unlink_(entry);
+    entry->expires = expires;
+    Insert_(entry);
+    if (expires < armed_) Arm_();
+}
+
+void TimingWheel::Cancel(TimerEntry* entry) {
+    assert(entry);
+    if (!Linked(entry)) return;
+    Unlink_(entry);
+    --count_;
+}
+
+void TimingWheel::OnTimer() {
+    uint64_t expirations;
+    while (read(timer_fd_, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+    }
+    armed_ = 0;
+    Advance(TimeService::NowMs());  // 事件循环在timerfd到时之后读取的时间，不早于设置的时间
+    Arm_();
+}
+
+void TimingWheel::Advance(uint64_t now_ms) {
+    while (now_ <= now_ms) {
+        int idx = now_ & (kRootSize - 1);
+        if (idx == 0) {
+            // 第0层转完一圈，第1层当前槽下移；第1层也转完一圈时继续下移上一层
+            for (int level = 1; level <= kLevels && Cascade_(level); ++level) {
+            }
+        }
+        uint64_t& word = root_bits_[idx >> 6];
+        uint64_t bit = 1ULL << (idx & 63);
+        bool due = word & bit;
+        word &= ~bit;
+        uint64_t lap = now_ - idx;
+        ++now_;  // 先前进，回调中添加的已到期条目放入下一个槽，不会等到下一圈
+        if (due) Expire_(&root_[idx]);
+        // 直接跳到第0层这一圈内下一个非空的槽，没有时跳到这一圈的结尾
+        int next = idx + 1 < kRootSize ? FirstBit(root_bits_, kRootSize / 64, idx + 1) : -1;
+        uint64_t target = lap + (next < 0 ? kRootSize : next);
+        now_ = std::max(now_, std::min(target, now_ms + 1));
+    }
+}
+
+void TimingWheel::Insert_(TimerEntry* entry) {
+    uint64_t expires = std::max(entry->expires, now_);  // 已过期的放入当前槽
+    uint64_t delta = expires - now_;
+    if (delta < static_cast<uint64_t>(kRootSize)) {
+        int idx = expires & (kRootSize - 1);
+        PushBack_(&root_[idx], entry);
+        root_bits_[idx >> 6] |= 1ULL << (idx & 63);
+        return;
+    }
+    const uint64_t max_delta = (1ULL << (Shift_(kLevels) + kLevelBits)) - 1;
+    if (delta > max_delta) expires = now_ + max_delta;  // 超过最远时间的先放在最高层，轮到时再按实际到期时间放入
+    for (int level = 1; level <= kLevels; ++level) {
+        if (expires - now_ < (1ULL << (Shift_(level) + kLevelBits))) {
+            int idx = (expires >> Shift_(level)) & (kLevelSize - 1);
+            PushBack_(&levels_[level - 1][idx], entry);
+            level_bits_[level - 1] |= 1ULL << idx;
+            return;
+        }
+    }
+    assert(false);
+}
+
+void TimingWheel::Unlink_(TimerEntry* entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->prev = entry->next = nullptr;
+}
+
+void TimingWheel::PushBack_(TimerEntry* head, TimerEntry* entry) {
+    entry->prev = head->prev;
+    entry->next = head;
+    head->prev->next = entry;
+    head->prev = entry;
+}
+
+bool TimingWheel::Cascade_(int level) {
+    int idx = (now_ >> Shift_(level)) & (kLevelSize - 1);
+    uint64_t bit = 1ULL << idx;
+    if (level_bits_[level - 1] & bit) {
+        level_bits_[level - 1] &= ~bit;
+        TimerEntry* head = &levels_[level - 1][idx];
+        // 槽中的条目都在下一层的一圈之内，重新放入时不会回到这个槽
+        while (head->next != head) {
+            TimerEntry* entry = head->next;
+            Unlink_(entry);
+            Insert_(entry);
+        }
+    }
+    return idx == 0;
+}
+
+void TimingWheel::Expire_(TimerEntry* head) {
+    if (head->next == head) return;  // 条目已被取消
+    // 先移到局部链表：回调中添加的条目不会在这一轮处理，回调取消局部链表中的条目也是安全的
+    TimerEntry local;
+    local.next = head->next;
+    local.prev = head->prev;
+    local.next->prev = &local;
+    local.prev->next = &local;
+    head->prev = head->next = head;
+    while (local.next != &local) {
+        TimerEntry* entry = local.next;
+        Unlink_(entry);
+        if (entry->expires >= now_) {  // 刷新过，尚未到期(now_已指向下一个槽)
+            Insert_(entry);
+            continue;
+        }
+        --count_;
+        on_expire_(entry);
+    }
+}
+
+uint64_t TimingWheel::NextTick_() const {
+    if (count_ == 0) return 0;
+    // 第0层：这一圈内之后的非空槽，或下一圈中的槽
+    int idx = now_ & (kRootSize - 1);
+    uint64_t lap = now_ - idx;
+    uint64_t next = UINT64_MAX;
+    int slot = FirstBit(root_bits_, kRootSize / 64, idx);
+    if (slot >= 0) {
+        next = lap + slot;
+        if (idx != 0) return next;  // 不在一圈的开头时，上层在这一圈结束前不会下移
+    } else if ((slot = FirstBit(root_bits_, kRootSize / 64, 0)) >= 0) {
+        next = lap + kRootSize + slot;
+    }
+    // 上层的槽在下移时处理：该层这一圈内之后的槽，或下一圈中的槽
+    for (int level = 1; level <= kLevels; ++level) {
+        uint64_t bits = level_bits_[level - 1];
+        if (!bits) continue;
+        int shift = Shift_(level);
+        int lidx = (now_ >> shift) & (kLevelSize - 1);
+        uint64_t level_lap = (now_ >> shift) - lidx;
+        // now_恰好在该层的槽边界上时，当前槽还没有下移
+        int from = (now_ & ((1ULL << shift) - 1)) == 0 ? lidx : lidx + 1;
+        uint64_t after = from < kLevelSize ? bits & (~0ULL << from) : 0;
+        if (after) {
+            next = std::min(next, (level_lap + __builtin_ctzll(after)) << shift);
+        } else {
+            next = std::min(next, (level_lap + kLevelSize + __builtin_ctzll(bits)) << shift);
+        }
+    }
+    return next;
+}
+
+void TimingWheel::Arm_() {
+    if (timer_fd_ < 0) return;
+    uint64_t next = NextTick_();
+    if (next == armed_) return;
+    struct itimerspec spec = {};
+    if (next > 0) {  // 为0时停止timerfd
+        spec.it_value.tv_sec = next / 1000;
+        spec.it_value.tv_nsec = (next % 1000) * 1000000;
+    }
+    if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+        LOG_ERROR("Set timerfd error: %d", errno);
+        return;
+    }
+    armed_ = next;
+}
@@ -0,0 +1,85 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>  // close()
+
+#include <algorithm>
+#include <functional>
+
+#include "../log/log.h"
+#include "timeservice.h"
+
+// 定时器条目，嵌入在使用者的对象中(如连接槽)，定时器不为条目分配内存
+struct TimerEntry {
+    TimerEntry* prev;  // 所在槽的双向循环链表，不在时间轮中时为nullptr
+    TimerEntry* next;
+    uint64_t expires;  // 到期时间，CLOCK_MONOTONIC的毫秒数
+};
+
+// 分层时间轮，精度1ms：第0层256个槽，每槽1ms；第1~4层各64个槽，每层每槽的跨度是下一层一圈的长度，
+// 最远可表示2^32ms(约49天)，更远的到期时间按最远处理。
+// 添加、刷新与取消都是O(1)：刷新只修改到期时间，条目留在原来的槽中，轮到该槽时发现未到期再重新放入(惰性刷新)，
+// 频繁刷新的连接不需要每次都移动链表节点；上层的条目在下层转完一圈时下移一层。
+// 由timerfd驱动：Fd()注册到事件循环中，可读时调用OnTimer()；timerfd按绝对时间设置为下一个非空槽的时间，
+// 没有需要处理的槽时不唤醒
+class TimingWheel {
+public:
+    typedef std::function<void(TimerEntry*)> ExpireCallBack;
+
+    // on_expire在条目到期时调用，调用前条目已从时间轮中移除，可以在其中重新添加
+    explicit TimingWheel(ExpireCallBack on_expire);
+    ~TimingWheel();
+
+    // 添加在expires(毫秒，与TimeService::NowMs()同一时钟)到期的条目，条目已在时间轮中时重新放入
+    void Add(TimerEntry* entry, uint64_t expires);
+    // 把到期时间改为expires；延后时只修改到期时间
+    void Refresh(TimerEntry* entry, uint64_t expires);
+    void Cancel(TimerEntry* entry);
+    static bool Linked(const TimerEntry* entry) { return entry->next != nullptr; }
+
+    int Fd() const { return timer_fd_; }
+    // timerfd可读时调用：处理到当前时间为止的槽，调用到期条目的回调，并重新设置timerfd
+    void OnTimer();
+    // 处理到now_ms为止的槽，不读取timerfd
+    void Advance(uint64_t now_ms);
+
+    size_t Size() const { return count_; }
+
+private:
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    static const int kRootBits = 8;
+    static const int kRootSize = 1 << kRootBits;  // 第0层的槽数
+    static const int kLevelBits = 6;
+    static const int kLevelSize = 1 << kLevelBits;  // 第1~4层每层的槽数
+    static const int kLevels = 4;
+
+    static int Shift_(int level) { return kRootBits + (level - 1) * kLevelBits; }  // 第level(>=1)层槽号的起始位
+
+    void Insert_(TimerEntry* entry);  // 按到期时间放入对应的槽
+    static void Unlink_(TimerEntry* entry);
+    static void PushBack_(TimerEntry* head, TimerEntry* entry);
+    bool Cascade_(int level);  // 把第level层当前槽中的条目下移，返回该层是否转完一圈
+    void Expire_(TimerEntry* head);  // 处理第0层的一个槽：到期的调用回调，惰性刷新过的重新放入
+    uint64_t NextTick_() const;  // 下一个需要处理的时间，没有条目时返回0
+    void Arm_();  // 按NextTick_()设置timerfd
+
+    TimerEntry root_[kRootSize];            // 第0层各槽的链表头(哨兵)
+    TimerEntry levels_[kLevels][kLevelSize];  // 第1~4层各槽的链表头
+    uint64_t root_bits_[kRootSize / 64];    // 第0层非空的槽，取消条目时不清除，处理到该槽时再清除
+    uint64_t level_bits_[kLevels];          // 第1~4层非空的槽
+
+    uint64_t now_;    // 已处理到的时间(不含)，小于now_的槽都已处理
+    uint64_t armed_;  // timerfd设置的时间，0表示未设置
+    size_t count_;    // 条目数
+    int timer_fd_;
+    ExpireCallBack on_expire_;
+};
+
+#endif
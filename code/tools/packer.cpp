@@ -0,0 +1,20 @@
+#include <stdio.h>
+
+#include "../http/bundle.h"
+
+// 静态资源打包工具：packer <资源目录> <打包文件>
+// 生成的打包文件通过WebServer的bundle参数提供。打包文件先写入临时文件再rename，替换过程中不会读到写了一半的文件；
+// 服务器只在启动时映射一次打包文件，替换后需要重启才会提供新版本的站点
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <resources dir> <bundle file>\n", argv[0]);
+        return 1;
+    }
+    int count = StaticBundle::Pack(argv[1], argv[2]);
+    if (count < 0) {
+        fprintf(stderr, "pack %s failed\n", argv[1]);
+        return 1;
+    }
+    printf("packed %d files into %s\n", count, argv[2]);
+    return 0;
+}